@@ -104,6 +104,7 @@ enum token {
   MEMHASH = 46,
   RELATION = 47,
   ATTRIBUTE = 48,
+  BPLUSTREE = 49,
 
   INTEGER_VALUE = 251,
   FLOAT_VALUE = 252,
@@ -206,6 +206,26 @@
 #define DB_HEAP_CACHE_LIMIT		1
 #endif /* DB_HEAP_CACHE_LIMIT */
 
+/* The maximum number of B+-tree indexes. */
+#ifndef DB_BPLUSTREE_INDEX_LIMIT
+#define DB_BPLUSTREE_INDEX_LIMIT	1
+#endif /* DB_BPLUSTREE_INDEX_LIMIT */
+
+/* The size of a node in the B+-tree index. */
+#ifndef DB_BPLUSTREE_NODE_SIZE
+#define DB_BPLUSTREE_NODE_SIZE		128
+#endif /* DB_BPLUSTREE_NODE_SIZE */
+
+/* The maximum number of nodes in a B+-tree index. */
+#ifndef DB_BPLUSTREE_NODE_LIMIT
+#define DB_BPLUSTREE_NODE_LIMIT		512
+#endif /* DB_BPLUSTREE_NODE_LIMIT */
+
+/* The maximum number of nodes cached in the B+-tree index. */
+#ifndef DB_BPLUSTREE_CACHE_LIMIT
+#define DB_BPLUSTREE_CACHE_LIMIT	2
+#endif /* DB_BPLUSTREE_CACHE_LIMIT */
+
 /*----------------------------------------------------------------------------*/
 
 /* LVM options. */
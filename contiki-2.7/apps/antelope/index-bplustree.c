@@ -0,0 +1,851 @@
+/*
+ * Copyright (c) 2010, Swedish Institute of Computer Science
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+
+/**
+ * \file
+ *     A B+-tree index for flash memory.
+ *
+ *     The leaves of the tree hold (key, tuple ID) pairs sorted by key,
+ *     and are stored in a leaf file. The internal nodes are stored in
+ *     the index file, together with the meta data of the tree. A range
+ *     query descends the tree once to find the first key of the range,
+ *     and then reads the keys in order from one leaf after another.
+ *     A few nodes are cached in RAM.
+ *
+ *     Writes are arranged to suit flash memory, which can only be
+ *     written once between erasures. The number of entries in a node
+ *     is not stored, but given by its first empty slot. When a new key
+ *     goes after all keys of a full node, the node is not split in
+ *     half; the key starts a new node instead. Keys inserted in
+ *     increasing order, such as time stamps, are thereby appended to
+ *     the end of the leaf file, and an internal node is only rewritten
+ *     now and then. Other insertions rewrite the changed part of a
+ *     node, which Coffee handles with its micro logs.
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "cfs/cfs.h"
+#include "lib/memb.h"
+
+#include "db-options.h"
+#include "index.h"
+#include "result.h"
+#include "storage.h"
+
+#define DEBUG DEBUG_NONE
+#include "net/uip-debug.h"
+
+#define NODE_META	1
+#define NODE_INTERNAL	2
+#define NODE_LEAF	3
+
+/* The meta data is stored in the first node of the index file. */
+#define META_NODE	0
+
+/* The maximum height of a tree. */
+#define MAX_DEPTH	8
+
+/* Internal nodes are split in half, except on the right edge of the
+   tree, so there are at most half as many of them as there are leaves. */
+#define INTERNAL_LIMIT	(DB_BPLUSTREE_NODE_LIMIT / 2 + 1)
+
+#if DB_BPLUSTREE_NODE_SIZE < 64 || DB_BPLUSTREE_NODE_SIZE > 2048
+#error "DB_BPLUSTREE_NODE_SIZE must be between 64 and 2048 bytes."
+#endif
+
+/*
+ * The root of the tree is the internal node with the greatest height.
+ * Each new root is written after all other nodes, and the node header
+ * is never rewritten, so changing the root does not rewrite anything
+ * in the index file.
+ */
+struct node_header {
+  uint8_t type;
+  uint8_t root_height;
+  uint8_t unused[2];
+};
+
+/*
+ * An entry in an internal node points to the child that holds the keys
+ * starting from its key. The key of the first entry is ignored, so the
+ * first child holds all smaller keys. The value is the node ID of the
+ * child, or the tuple ID in a leaf, plus one so that a used slot is
+ * never zero.
+ */
+struct entry {
+  int32_t key;
+  uint32_t value;
+};
+
+#define NODE_ENTRIES	((DB_BPLUSTREE_NODE_SIZE - sizeof(struct node_header)) \
+			 / sizeof(struct entry))
+
+struct node {
+  struct node_header header;
+  struct entry entries[NODE_ENTRIES];
+};
+
+struct meta {
+  struct node_header header;
+  char leaf_file[DB_MAX_FILENAME_LENGTH];
+};
+
+struct tree {
+  db_storage_id_t node_storage;
+  db_storage_id_t leaf_storage;
+  uint16_t root;
+  uint16_t node_count;
+  uint16_t leaf_count;
+  uint8_t height;
+};
+typedef struct tree tree_t;
+
+/* A path from the root to a leaf, and the slot taken in each node. */
+struct cursor {
+  uint16_t node_id[MAX_DEPTH];
+  uint8_t slot[MAX_DEPTH];
+};
+
+struct node_cache {
+  tree_t *tree;
+  uint8_t leaf;
+  uint8_t count;
+  uint16_t node_id;
+  struct node node;
+};
+
+/* Keep a cache of nodes read from storage. */
+static struct node_cache node_cache[DB_BPLUSTREE_CACHE_LIMIT];
+static uint8_t next_victim;
+MEMB(trees, tree_t, DB_BPLUSTREE_INDEX_LIMIT);
+
+/* A node that is being built before it is written to storage. */
+static struct node new_node;
+
+static db_result_t create(index_t *);
+static db_result_t destroy(index_t *);
+static db_result_t load(index_t *);
+static db_result_t release(index_t *);
+static db_result_t insert(index_t *, attribute_value_t *, tuple_id_t);
+static db_result_t delete(index_t *, attribute_value_t *);
+static tuple_id_t get_next(index_iterator_t *);
+
+index_api_t index_bplustree = {
+  INDEX_BPLUSTREE,
+  INDEX_API_EXTERNAL | INDEX_API_RANGE_QUERIES,
+  create,
+  destroy,
+  load,
+  release,
+  insert,
+  delete,
+  get_next
+};
+
+static void
+invalidate_cache(tree_t *tree)
+{
+  int i;
+
+  for(i = 0; i < DB_BPLUSTREE_CACHE_LIMIT; i++) {
+    if(node_cache[i].tree == tree) {
+      node_cache[i].tree = NULL;
+    }
+  }
+}
+
+/*
+ * Read a node, or a part of it. Unlike storage_read(), this does not
+ * seek beyond the end of the file, because Coffee would then take the
+ * skipped space as written, and use a micro log for later appends to
+ * it. The space after the end of the file is read as zeros.
+ */
+static db_result_t
+node_read(tree_t *tree, int leaf, uint16_t node_id, void *data,
+          unsigned size)
+{
+  db_storage_id_t fd;
+  cfs_offset_t offset, end;
+
+  fd = leaf ? tree->leaf_storage : tree->node_storage;
+  offset = (cfs_offset_t)node_id * sizeof(struct node);
+
+  memset(data, 0, size);
+
+  end = cfs_seek(fd, 0, CFS_SEEK_END);
+  if(end == (cfs_offset_t)-1) {
+    return DB_STORAGE_ERROR;
+  }
+  if(offset >= end) {
+    return DB_OK;
+  }
+  if(end - offset < size) {
+    size = end - offset;
+  }
+
+  if(cfs_seek(fd, offset, CFS_SEEK_SET) != offset ||
+     cfs_read(fd, data, size) != size) {
+    return DB_STORAGE_ERROR;
+  }
+
+  return DB_OK;
+}
+
+static db_result_t
+node_write(tree_t *tree, int leaf, uint16_t node_id, void *data,
+           unsigned offset, unsigned size)
+{
+  return storage_write(leaf ? tree->leaf_storage : tree->node_storage, data,
+                       (unsigned long)node_id * sizeof(struct node) + offset,
+                       size);
+}
+
+static db_result_t
+write_entries(struct node_cache *cache, unsigned start, unsigned end)
+{
+  if(start >= end) {
+    return DB_OK;
+  }
+  return node_write(cache->tree, cache->leaf, cache->node_id,
+                    &cache->node.entries[start],
+                    offsetof(struct node, entries) +
+                    start * sizeof(struct entry),
+                    (end - start) * sizeof(struct entry));
+}
+
+/*
+ * Get a node from the cache, or read it from storage. The returned
+ * node may be replaced by the next call, so callers must not hold on
+ * to it while loading another node.
+ */
+static struct node_cache *
+node_load(tree_t *tree, int leaf, uint16_t node_id)
+{
+  struct node_cache *cache;
+  int i;
+
+  for(i = 0; i < DB_BPLUSTREE_CACHE_LIMIT; i++) {
+    if(node_cache[i].tree == tree && node_cache[i].leaf == leaf &&
+       node_cache[i].node_id == node_id) {
+      return &node_cache[i];
+    }
+  }
+
+  cache = &node_cache[next_victim];
+  next_victim = (next_victim + 1) % DB_BPLUSTREE_CACHE_LIMIT;
+
+  cache->tree = NULL;
+  if(DB_ERROR(node_read(tree, leaf, node_id, &cache->node,
+                        sizeof(cache->node)))) {
+    PRINTF("DB: Failed to read B+-tree node %u\n", (unsigned)node_id);
+    return NULL;
+  }
+
+  if(cache->node.header.type != (leaf ? NODE_LEAF : NODE_INTERNAL)) {
+    PRINTF("DB: Invalid B+-tree node %u\n", (unsigned)node_id);
+    return NULL;
+  }
+
+  for(i = 0; i < NODE_ENTRIES; i++) {
+    if(cache->node.entries[i].value == 0) {
+      break;
+    }
+  }
+  cache->count = i;
+  cache->tree = tree;
+  cache->leaf = leaf;
+  cache->node_id = node_id;
+
+  return cache;
+}
+
+/*
+ * Find the path from the root to the leaf where a key belongs. To find
+ * the first occurrence of a key, the search must follow the child to
+ * the left of an equal separator, because the key may also be stored
+ * in the end of that child.
+ */
+static db_result_t
+descend(tree_t *tree, long key, int first, struct cursor *cursor)
+{
+  struct node_cache *cache;
+  uint16_t node_id;
+  int level;
+  unsigned i;
+
+  node_id = tree->root;
+  for(level = 0; level < tree->height; level++) {
+    cursor->node_id[level] = node_id;
+    cache = node_load(tree, 0, node_id);
+    if(cache == NULL || cache->count == 0) {
+      return DB_INDEX_ERROR;
+    }
+
+    for(i = 1; i < cache->count; i++) {
+      if(cache->node.entries[i].key > key ||
+         (first && cache->node.entries[i].key == key)) {
+        break;
+      }
+    }
+    cursor->slot[level] = i - 1;
+    node_id = cache->node.entries[i - 1].value - 1;
+  }
+
+  cursor->node_id[level] = node_id;
+  cursor->slot[level] = 0;
+
+  return DB_OK;
+}
+
+/* Move the cursor to the first slot of the next leaf. */
+static db_result_t
+next_leaf(tree_t *tree, struct cursor *cursor)
+{
+  struct node_cache *cache;
+  int level;
+
+  /* Find the lowest node on the path that has more children. */
+  for(level = tree->height - 1;; level--) {
+    if(level < 0) {
+      return DB_FINISHED;
+    }
+    cache = node_load(tree, 0, cursor->node_id[level]);
+    if(cache == NULL) {
+      return DB_INDEX_ERROR;
+    }
+    if(cursor->slot[level] + 1 < cache->count) {
+      break;
+    }
+  }
+
+  /* Take the next child, and follow the leftmost children below it. */
+  cursor->slot[level]++;
+  for(; level < tree->height; level++) {
+    cache = node_load(tree, 0, cursor->node_id[level]);
+    if(cache == NULL) {
+      return DB_INDEX_ERROR;
+    }
+    cursor->node_id[level + 1] =
+      cache->node.entries[cursor->slot[level]].value - 1;
+    cursor->slot[level + 1] = 0;
+  }
+
+  return DB_OK;
+}
+
+static db_result_t
+insert_entry(tree_t *tree, struct cursor *cursor, struct entry *entry)
+{
+  struct node_cache *cache;
+  struct entry *entries;
+  unsigned count, pos, half, i;
+  uint16_t new_id;
+  int level, leaf;
+
+  for(level = tree->height;; level--) {
+    leaf = level == tree->height;
+    cache = node_load(tree, leaf, cursor->node_id[level]);
+    if(cache == NULL) {
+      return DB_INDEX_ERROR;
+    }
+    entries = cache->node.entries;
+    count = cache->count;
+
+    if(leaf) {
+      /* Insert after any equal keys, so that they stay in insertion
+         order. */
+      for(pos = 0; pos < count && entries[pos].key <= entry->key; pos++);
+    } else {
+      /* The new child goes right after the child that was split, which
+         matters when several children start with the same key. */
+      pos = cursor->slot[level] + 1;
+    }
+
+    if(count < NODE_ENTRIES) {
+      memmove(&entries[pos + 1], &entries[pos],
+              (count - pos) * sizeof(struct entry));
+      entries[pos] = *entry;
+      cache->count++;
+      return write_entries(cache, pos, count + 1);
+    }
+
+    /* Before the leaf is split, make sure that the split can propagate
+       up to a new root, so that the tree is not left without a link to
+       a new node. */
+    if(leaf && (tree->leaf_count >= DB_BPLUSTREE_NODE_LIMIT ||
+                tree->node_count + tree->height + 1 > INTERNAL_LIMIT ||
+                tree->height + 1 >= MAX_DEPTH)) {
+      PRINTF("DB: No more B+-tree nodes available\n");
+      return DB_LIMIT_ERROR;
+    }
+    new_id = leaf ? tree->leaf_count : tree->node_count;
+
+    memset(&new_node, 0, sizeof(new_node));
+    new_node.header.type = cache->node.header.type;
+
+    if(pos == count) {
+      /* The new node gets only the new key, and this node stays as
+         it is. */
+      new_node.entries[0] = *entry;
+      half = count;
+    } else {
+      /* Split the node in half, including the new key. */
+      half = (count + 1) / 2;
+      for(i = half; i <= count; i++) {
+        if(i < pos) {
+          new_node.entries[i - half] = entries[i];
+        } else if(i == pos) {
+          new_node.entries[i - half] = *entry;
+        } else {
+          new_node.entries[i - half] = entries[i - 1];
+        }
+      }
+      if(pos < half) {
+        memmove(&entries[pos + 1], &entries[pos],
+                (half - pos - 1) * sizeof(struct entry));
+        entries[pos] = *entry;
+      }
+      memset(&entries[half], 0, (count - half) * sizeof(struct entry));
+    }
+
+    /*
+     * Write the new node before it is linked to from the tree. Its
+     * empty slots are not written, so that the file ends with the last
+     * entry, and Coffee can append later entries without a micro log.
+     */
+    if(DB_ERROR(node_write(tree, leaf, new_id, &new_node, 0,
+                           offsetof(struct node, entries) +
+                           (count + 1 - half) * sizeof(struct entry)))) {
+      invalidate_cache(tree);
+      return DB_STORAGE_ERROR;
+    }
+    if(leaf) {
+      tree->leaf_count++;
+    } else {
+      tree->node_count++;
+    }
+
+    cache->count = half;
+    if(DB_ERROR(write_entries(cache, pos < half ? pos : half, count))) {
+      invalidate_cache(tree);
+      return DB_STORAGE_ERROR;
+    }
+
+    PRINTF("DB: Split B+-tree node %u at entry %u into node %u\n",
+           (unsigned)cache->node_id, half, (unsigned)new_id);
+
+    /* The smallest key of the new node separates it from this node in
+       the parent. */
+    entry->key = new_node.entries[0].key;
+    entry->value = new_id + 1;
+
+    if(level == 0) {
+      break;
+    }
+  }
+
+  /* The root was split, so the tree grows by one level. */
+  new_id = tree->node_count;
+  memset(&new_node, 0, sizeof(new_node));
+  new_node.header.type = NODE_INTERNAL;
+  new_node.header.root_height = tree->height + 1;
+  new_node.entries[0].value = cursor->node_id[0] + 1;
+  new_node.entries[1] = *entry;
+  if(DB_ERROR(node_write(tree, 0, new_id, &new_node, 0,
+                         offsetof(struct node, entries) +
+                         2 * sizeof(struct entry)))) {
+    return DB_STORAGE_ERROR;
+  }
+  tree->node_count++;
+
+  tree->root = new_id;
+  tree->height++;
+
+  return DB_OK;
+}
+
+/* Find the root, which is the internal node with the greatest height,
+   or the first leaf if the tree has no internal nodes. */
+static db_result_t
+find_root(tree_t *tree)
+{
+  struct node_header header;
+  uint16_t node_id;
+
+  tree->root = 0;
+  tree->height = 0;
+  for(node_id = META_NODE + 1; node_id < tree->node_count; node_id++) {
+    if(DB_ERROR(node_read(tree, 0, node_id, &header, sizeof(header)))) {
+      return DB_STORAGE_ERROR;
+    }
+    if(header.root_height > tree->height) {
+      tree->root = node_id;
+      tree->height = header.root_height;
+    }
+  }
+
+  return tree->height < MAX_DEPTH ? DB_OK : DB_STORAGE_ERROR;
+}
+
+/* Find the number of nodes in a file, given that they are allocated
+   in order. */
+static db_result_t
+count_nodes(tree_t *tree, int leaf, uint16_t low, uint16_t high,
+            uint16_t *count)
+{
+  struct node_header header;
+  uint16_t middle;
+
+  while(low < high) {
+    middle = low + (high - low) / 2;
+    if(DB_ERROR(node_read(tree, leaf, middle, &header, sizeof(header)))) {
+      return DB_STORAGE_ERROR;
+    }
+    if(header.type == 0) {
+      high = middle;
+    } else {
+      low = middle + 1;
+    }
+  }
+
+  *count = low;
+  return DB_OK;
+}
+
+/* Nodes are rewritten in place when keys are not inserted in order,
+   so the files are not opened with flash-aware I/O semantics. */
+static db_result_t
+open_tree(index_t *index, char *leaf_file)
+{
+  tree_t *tree;
+
+  index->opaque_data = tree = memb_alloc(&trees);
+  if(tree == NULL) {
+    PRINTF("DB: Failed to allocate a B+-tree\n");
+    return DB_ALLOCATION_ERROR;
+  }
+
+  tree->node_storage = cfs_open(index->descriptor_file, CFS_READ | CFS_WRITE);
+  tree->leaf_storage = cfs_open(leaf_file, CFS_READ | CFS_WRITE);
+  if(tree->node_storage < 0 || tree->leaf_storage < 0) {
+    release(index);
+    return DB_STORAGE_ERROR;
+  }
+
+  return DB_OK;
+}
+
+static db_result_t
+create(index_t *index)
+{
+  struct meta meta;
+  char *filename;
+  tree_t *tree;
+
+  memset(&meta, 0, sizeof(meta));
+  meta.header.type = NODE_META;
+
+  /* Generate the file of the internal nodes, which is the main index
+     file that is referenced from the metadata of the relation. */
+  filename = storage_generate_file("bplus",
+                 (unsigned long)INTERNAL_LIMIT * sizeof(struct node));
+  if(filename == NULL) {
+    PRINTF("DB: Failed to generate a B+-tree file\n");
+    return DB_INDEX_ERROR;
+  }
+  memcpy(index->descriptor_file, filename,
+	 sizeof(index->descriptor_file));
+
+  filename = storage_generate_file("leaf",
+                 (unsigned long)DB_BPLUSTREE_NODE_LIMIT * sizeof(struct node));
+  if(filename == NULL) {
+    PRINTF("DB: Failed to generate a B+-tree leaf file\n");
+    cfs_remove(index->descriptor_file);
+    index->descriptor_file[0] = '\0';
+    return DB_INDEX_ERROR;
+  }
+  memcpy(meta.leaf_file, filename, sizeof(meta.leaf_file));
+
+  if(DB_ERROR(open_tree(index, meta.leaf_file))) {
+    goto error;
+  }
+  tree = index->opaque_data;
+
+  /* The tree starts as an empty leaf. */
+  memset(&new_node, 0, sizeof(new_node));
+  new_node.header.type = NODE_LEAF;
+  if(DB_ERROR(node_write(tree, 0, META_NODE, &meta, 0, sizeof(meta))) ||
+     DB_ERROR(node_write(tree, 1, 0, &new_node, 0,
+                         sizeof(new_node.header)))) {
+    release(index);
+    goto error;
+  }
+  tree->root = 0;
+  tree->height = 0;
+  tree->node_count = META_NODE + 1;
+  tree->leaf_count = 1;
+
+  PRINTF("DB: Created a B+-tree index in the files %s and %s\n",
+         index->descriptor_file, meta.leaf_file);
+
+  return DB_OK;
+
+error:
+  cfs_remove(meta.leaf_file);
+  cfs_remove(index->descriptor_file);
+  index->descriptor_file[0] = '\0';
+  return DB_STORAGE_ERROR;
+}
+
+static db_result_t
+read_meta(index_t *index, struct meta *meta)
+{
+  db_storage_id_t fd;
+  db_result_t result;
+
+  fd = cfs_open(index->descriptor_file, CFS_READ);
+  if(fd < 0) {
+    return DB_STORAGE_ERROR;
+  }
+
+  result = DB_OK;
+  if(cfs_read(fd, meta, sizeof(*meta)) != sizeof(*meta) ||
+     meta->header.type != NODE_META) {
+    result = DB_STORAGE_ERROR;
+  }
+
+  cfs_close(fd);
+
+  return result;
+}
+
+static db_result_t
+destroy(index_t *index)
+{
+  struct meta meta;
+
+  /* The index has been released already, so only the files remain. */
+  if(DB_SUCCESS(read_meta(index, &meta))) {
+    cfs_remove(meta.leaf_file);
+  }
+  cfs_remove(index->descriptor_file);
+
+  return DB_OK;
+}
+
+static db_result_t
+load(index_t *index)
+{
+  struct meta meta;
+  tree_t *tree;
+
+  if(DB_ERROR(read_meta(index, &meta))) {
+    return DB_STORAGE_ERROR;
+  }
+
+  if(DB_ERROR(open_tree(index, meta.leaf_file))) {
+    return DB_STORAGE_ERROR;
+  }
+  tree = index->opaque_data;
+
+  if(DB_ERROR(count_nodes(tree, 0, META_NODE + 1, INTERNAL_LIMIT,
+                          &tree->node_count)) ||
+     DB_ERROR(count_nodes(tree, 1, 1, DB_BPLUSTREE_NODE_LIMIT,
+                          &tree->leaf_count)) ||
+     DB_ERROR(find_root(tree))) {
+    release(index);
+    return DB_STORAGE_ERROR;
+  }
+
+  PRINTF("DB: Loaded a B+-tree index of height %u with %u leaves from %s\n",
+	 (unsigned)tree->height, (unsigned)tree->leaf_count,
+         index->descriptor_file);
+
+  return DB_OK;
+}
+
+static db_result_t
+release(index_t *index)
+{
+  tree_t *tree;
+
+  tree = index->opaque_data;
+
+  invalidate_cache(tree);
+  if(tree->leaf_storage >= 0) {
+    cfs_close(tree->leaf_storage);
+  }
+  if(tree->node_storage >= 0) {
+    cfs_close(tree->node_storage);
+  }
+  memb_free(&trees, tree);
+  index->opaque_data = NULL;
+
+  return DB_OK;
+}
+
+static db_result_t
+insert(index_t *index, attribute_value_t *key, tuple_id_t value)
+{
+  tree_t *tree;
+  struct cursor cursor;
+  struct entry entry;
+
+  tree = (tree_t *)index->opaque_data;
+
+  entry.key = db_value_to_long(key);
+  entry.value = value + 1;
+
+  if(DB_ERROR(descend(tree, entry.key, 0, &cursor)) ||
+     DB_ERROR(insert_entry(tree, &cursor, &entry))) {
+    PRINTF("DB: Failed to insert key %ld into a B+-tree index\n",
+           db_value_to_long(key));
+    return DB_INDEX_ERROR;
+  }
+
+  return DB_OK;
+}
+
+static db_result_t
+delete(index_t *index, attribute_value_t *value)
+{
+  tree_t *tree;
+  struct cursor cursor;
+  struct node_cache *cache;
+  struct entry *entries;
+  db_result_t result;
+  long key;
+  unsigned i, count, kept, first;
+
+  tree = (tree_t *)index->opaque_data;
+  key = db_value_to_long(value);
+
+  if(DB_ERROR(descend(tree, key, 1, &cursor))) {
+    return DB_INDEX_ERROR;
+  }
+
+  /*
+   * Remove the entries with the key from the leaves where they are
+   * stored. Leaves are not merged when they become sparse, and an
+   * empty leaf stays in the tree.
+   */
+  do {
+    cache = node_load(tree, 1, cursor.node_id[tree->height]);
+    if(cache == NULL) {
+      return DB_INDEX_ERROR;
+    }
+    entries = cache->node.entries;
+    count = cache->count;
+
+    first = count;
+    for(i = kept = 0; i < count; i++) {
+      if(entries[i].key == key) {
+        if(first == count) {
+          first = i;
+        }
+      } else {
+        entries[kept++] = entries[i];
+      }
+    }
+
+    if(kept < count) {
+      memset(&entries[kept], 0, (count - kept) * sizeof(struct entry));
+      cache->count = kept;
+      if(DB_ERROR(write_entries(cache, first, count))) {
+        invalidate_cache(tree);
+        return DB_STORAGE_ERROR;
+      }
+    }
+
+    if(kept > 0 && entries[kept - 1].key > key) {
+      return DB_OK;
+    }
+    result = next_leaf(tree, &cursor);
+  } while(result == DB_OK);
+
+  return DB_ERROR(result) ? DB_INDEX_ERROR : DB_OK;
+}
+
+static tuple_id_t
+get_next(index_iterator_t *iterator)
+{
+  struct iteration_cache {
+    index_iterator_t *index_iterator;
+    struct cursor cursor;
+  };
+  static struct iteration_cache cache;
+  tree_t *tree;
+  struct node_cache *ncache;
+  struct entry *entry;
+  uint8_t *slot;
+  long min;
+  long max;
+
+  tree = (tree_t *)iterator->index->opaque_data;
+  min = db_value_to_long(&iterator->min_value);
+  max = db_value_to_long(&iterator->max_value);
+
+  if(cache.index_iterator != iterator || iterator->next_item_no == 0) {
+    /* Find the leaf that holds the first key of the range. */
+    if(DB_ERROR(descend(tree, min, 1, &cache.cursor))) {
+      return INVALID_TUPLE;
+    }
+    cache.index_iterator = iterator;
+  }
+
+  slot = &cache.cursor.slot[tree->height];
+  for(;;) {
+    ncache = node_load(tree, 1, cache.cursor.node_id[tree->height]);
+    if(ncache == NULL) {
+      return INVALID_TUPLE;
+    }
+
+    if(*slot >= ncache->count) {
+      if(next_leaf(tree, &cache.cursor) != DB_OK) {
+        return INVALID_TUPLE;
+      }
+      continue;
+    }
+
+    entry = &ncache->node.entries[(*slot)++];
+    if(entry->key < min) {
+      continue;
+    } else if(entry->key > max) {
+      return INVALID_TUPLE;
+    }
+
+    iterator->next_item_no++;
+    PRINTF("DB: Found key %ld with value %lu\n", (long)entry->key,
+           (unsigned long)entry->value - 1);
+    return (tuple_id_t)entry->value - 1;
+  }
+}
@@ -43,7 +43,8 @@ typedef enum {
   INDEX_NONE = 0,
   INDEX_INLINE = 1,
   INDEX_MEMHASH = 2,
-  INDEX_MAXHEAP = 3
+  INDEX_MAXHEAP = 3,
+  INDEX_BPLUSTREE = 4
 } index_type_t;
 
 #define INDEX_READY		0x00
@@ -97,6 +98,7 @@ typedef struct index_api index_api_t;
 extern index_api_t index_inline;
 extern index_api_t index_maxheap;
 extern index_api_t index_memhash;
+extern index_api_t index_bplustree;
 
 void index_init(void);
 db_result_t index_create(index_type_t, relation_t *, attribute_t *);
@@ -58,6 +58,10 @@
 #include "cfs/cfs.h"
 #include "cfs-coffee-arch.h"
 #include "cfs/cfs-coffee.h"
+#include "sys/clock.h"
+#include "sys/ctimer.h"
+#include "sys/etimer.h"
+#include "sys/process.h"
 
 /* Micro logs enable modifications on storage types that do not support
    in-place updates. This applies primarily to flash memories. */
@@ -90,6 +94,91 @@
 #define COFFEE_EXTENDED_WEAR_LEVELLING	1
 #endif
 
+/*
+ * Keep an index of the file system in RAM, so that opening files and
+ * allocating pages do not require a scan of all file headers. The
+ * index costs a few bytes per sector and three bytes per file.
+ */
+#ifndef COFFEE_RAM_INDEX
+#define COFFEE_RAM_INDEX	0
+#endif
+
+/* The number of files that the RAM index can hold. If more files
+   exist, lookups of unindexed names fall back to a flash scan. */
+#ifndef COFFEE_INDEX_FILES
+#define COFFEE_INDEX_FILES	32
+#endif
+
+/* The number of regions per cached file for which the latest micro
+   log record is kept in RAM. Reads of these regions do not need to
+   search the log index table. */
+#ifndef COFFEE_LOG_MAP_SIZE
+#define COFFEE_LOG_MAP_SIZE	0
+#endif
+
+/*
+ * Buffer writes to a micro log record in RAM for up to this many
+ * clock ticks, so that consecutive small writes to the same region
+ * use a single log record. Reading the file, writing another region
+ * or calling cfs_coffee_flush() writes the buffered record out.
+ */
+#ifndef COFFEE_LOG_COALESCE_TIME
+#define COFFEE_LOG_COALESCE_TIME	0
+#endif
+
+/* Merge files whose micro logs are filled beyond a threshold (in
+   percent) from a background process, instead of when a write finds
+   the log full. */
+#ifndef COFFEE_LOG_COMPACTION
+#define COFFEE_LOG_COMPACTION	0
+#endif
+
+#ifndef COFFEE_LOG_COMPACTION_THRESHOLD
+#define COFFEE_LOG_COMPACTION_THRESHOLD	75
+#endif
+
+#ifndef COFFEE_LOG_COMPACTION_INTERVAL
+#define COFFEE_LOG_COMPACTION_INTERVAL	(10 * CLOCK_SECOND)
+#endif
+
+/*
+ * Enable ring files, which own whole sectors and discard their oldest
+ * sector when they are full. See cfs_coffee_reserve_ring().
+ */
+#ifndef COFFEE_RING_FILES
+#define COFFEE_RING_FILES	0
+#endif
+
+/* Count flash operations, log merges and garbage collection pauses
+   for cfs_coffee_stats(). */
+#ifndef COFFEE_STATS
+#define COFFEE_STATS	0
+#endif
+
+/*
+ * Keep an erase counter for each sector in the last two sectors of the
+ * Coffee area, and allocate new sectors from the least worn ones.
+ * The storage must be formatted again when this setting is changed.
+ */
+#ifndef COFFEE_ERASE_COUNTERS
+#define COFFEE_ERASE_COUNTERS	0
+#endif
+
+#if COFFEE_ERASE_COUNTERS
+#if (COFFEE_SIZE / COFFEE_SECTOR_SIZE + 2) * 4 > COFFEE_SECTOR_SIZE
+#error "COFFEE_ERASE_COUNTERS requires a sector that can hold all counters."
+#endif
+#endif
+
+#if !COFFEE_MICRO_LOGS
+#undef COFFEE_LOG_MAP_SIZE
+#define COFFEE_LOG_MAP_SIZE	0
+#undef COFFEE_LOG_COALESCE_TIME
+#define COFFEE_LOG_COALESCE_TIME	0
+#undef COFFEE_LOG_COMPACTION
+#define COFFEE_LOG_COMPACTION	0
+#endif
+
 #if COFFEE_START & (COFFEE_SECTOR_SIZE - 1)
 #error COFFEE_START must point to the first byte in a sector.
 #endif
@@ -100,6 +189,8 @@
 #define COFFEE_FD_APPEND	0x4
 
 #define COFFEE_FILE_MODIFIED	0x1
+#define COFFEE_FILE_LOG_MAPPED	0x2
+#define COFFEE_FILE_RING	0x4
 
 #define INVALID_PAGE		((coffee_page_t)-1)
 #define UNKNOWN_OFFSET		((cfs_offset_t)-1)
@@ -125,6 +216,17 @@
 #define FILE_MODIFIED(file)	((file)->flags & COFFEE_FILE_MODIFIED)
 #define FILE_FREE(file)		((file)->max_pages == 0)
 #define FILE_UNREFERENCED(file)	((file)->references == 0)
+#define FILE_LOG_MAPPED(file)	((file)->flags & COFFEE_FILE_LOG_MAPPED)
+#define FILE_RING(file)		((file)->flags & COFFEE_FILE_RING)
+#if COFFEE_LOG_COALESCE_TIME
+#define FILE_BUFFERED(f)	(log_buffer.fd >= 0 && \
+				 coffee_fd_set[log_buffer.fd].file == (f))
+#else
+#define FILE_BUFFERED(f)	0
+#endif
+
+/* Log record numbers are kept in a byte in the log map. */
+#define LOG_MAPPABLE(records)	((records) < 0xff)
 
 /* File header flags. */
 #define HDR_FLAG_VALID		0x1	/* Completely written header. */
@@ -133,6 +235,7 @@
 #define HDR_FLAG_MODIFIED	0x8	/* Modified file, log exists. */
 #define HDR_FLAG_LOG		0x10	/* Log file. */
 #define HDR_FLAG_ISOLATED	0x20	/* Isolated page. */
+#define HDR_FLAG_RING		0x40	/* Ring file. */
 
 /* File header macros. */
 #define CHECK_FLAG(hdr, flag)	((hdr).flags & (flag))
@@ -143,14 +246,25 @@
 #define HDR_MODIFIED(hdr)	CHECK_FLAG(hdr, HDR_FLAG_MODIFIED)
 #define HDR_ISOLATED(hdr)	CHECK_FLAG(hdr, HDR_FLAG_ISOLATED)
 #define HDR_OBSOLETE(hdr) 	CHECK_FLAG(hdr, HDR_FLAG_OBSOLETE)
+#define HDR_RING(hdr)		CHECK_FLAG(hdr, HDR_FLAG_RING)
 #define HDR_ACTIVE(hdr)		(HDR_ALLOCATED(hdr) && \
 				!HDR_OBSOLETE(hdr)  && \
 				!HDR_ISOLATED(hdr))
 
 /* Shortcuts derived from the hardware-dependent configuration of Coffee. */
+#if COFFEE_ERASE_COUNTERS
+/* The last two sectors hold the erase counters instead of files. */
+#define COUNTER_SECTORS		2
+#define COFFEE_SECTOR_COUNT	\
+	(unsigned)(COFFEE_SIZE / COFFEE_SECTOR_SIZE - COUNTER_SECTORS)
+#define COFFEE_PAGE_COUNT	\
+	((coffee_page_t)(COFFEE_SECTOR_COUNT * COFFEE_PAGES_PER_SECTOR))
+#define COUNTER_SECTOR(area)	(COFFEE_SECTOR_COUNT + (area))
+#else
 #define COFFEE_SECTOR_COUNT	(unsigned)(COFFEE_SIZE / COFFEE_SECTOR_SIZE)
 #define COFFEE_PAGE_COUNT	\
 	((coffee_page_t)(COFFEE_SIZE / COFFEE_PAGE_SIZE))
+#endif
 #define COFFEE_PAGES_PER_SECTOR	\
 	((coffee_page_t)(COFFEE_SECTOR_SIZE / COFFEE_PAGE_SIZE))
 
@@ -159,6 +273,7 @@ struct sector_status {
   coffee_page_t active;
   coffee_page_t obsolete;
   coffee_page_t free;
+  coffee_page_t spill;
 };
 
 /* The structure of cached file objects. */
@@ -169,6 +284,15 @@ struct file {
   int16_t record_count;
   uint8_t references;
   uint8_t flags;
+#if COFFEE_LOG_MAP_SIZE
+  /* The latest log record of each region, plus one. */
+  uint8_t log_map[COFFEE_LOG_MAP_SIZE];
+#endif
+#if COFFEE_RING_FILES
+  /* The oldest data sector of a ring file and its sequence number. */
+  uint16_t ring_tail;
+  uint16_t ring_seq;
+#endif
 };
 
 /* The file descriptor structure. */
@@ -193,6 +317,49 @@ struct file_header {
   char name[COFFEE_NAME_LENGTH];
 };
 
+#if COFFEE_RING_FILES
+/*
+ * Each data sector of a ring file starts with a stamp that holds the
+ * sequence number of the sector. The stamps tell where the head and
+ * the tail of the file are after a reboot.
+ */
+struct ring_stamp {
+  uint16_t seq;
+  uint16_t check;
+};
+
+#define RING_STAMP_VALID(stamp)	((stamp).check == (uint16_t)~(stamp).seq)
+#define RING_DATA_SIZE		\
+	((cfs_offset_t)(COFFEE_SECTOR_SIZE - sizeof(struct ring_stamp)))
+#define RING_FIRST_SECTOR(page)	((page) / COFFEE_PAGES_PER_SECTOR + 1)
+#define RING_SECTORS(page, max_pages)	\
+	(((page) + (max_pages)) / COFFEE_PAGES_PER_SECTOR - \
+	 RING_FIRST_SECTOR(page))
+#endif /* COFFEE_RING_FILES */
+
+#if COFFEE_ERASE_COUNTERS
+/*
+ * A counter sector starts with a snapshot of the erase counters of all
+ * sectors, the counter sectors included. It is followed by a log of the
+ * sectors that have been erased since, each stored as its number plus
+ * one. When the log is full, the snapshot is written to the other
+ * counter sector with the next generation number, and the magic number
+ * is written last. The previous snapshot thus stays valid until the new
+ * one is complete, and the valid snapshot with the highest generation
+ * is the current one.
+ */
+struct erase_counters {
+  uint32_t magic;
+  uint32_t generation;
+  uint32_t count[COFFEE_SECTOR_COUNT + COUNTER_SECTORS];
+};
+
+#define COUNTERS_MAGIC		0xc0ffeeUL
+#define COUNTER_LOG_START	sizeof(struct erase_counters)
+#define COUNTER_LOG_ENTRIES	\
+	((COFFEE_SECTOR_SIZE - COUNTER_LOG_START) / sizeof(uint16_t))
+#endif /* COFFEE_ERASE_COUNTERS */
+
 /* This is needed because of a buggy compiler. */
 struct log_param {
   cfs_offset_t offset;
@@ -200,6 +367,30 @@ struct log_param {
   uint16_t size;
 };
 
+#if COFFEE_RAM_INDEX
+/*
+ * The RAM index mirrors the allocation state of the storage. Within a
+ * sector, allocated pages always precede the free pages, so the free
+ * extents are given by the number of used pages in each sector.
+ */
+struct coffee_index {
+  coffee_page_t file_page[COFFEE_INDEX_FILES];
+  uint8_t file_hash[COFFEE_INDEX_FILES];
+  uint16_t file_count;
+  coffee_page_t used[COFFEE_SECTOR_COUNT];
+  coffee_page_t active[COFFEE_SECTOR_COUNT];
+  coffee_page_t obsolete[COFFEE_SECTOR_COUNT];
+  /* Pages at the start of a sector that belong to an extent
+     starting in a previous sector. */
+  coffee_page_t spill[COFFEE_SECTOR_COUNT];
+  uint8_t flags;
+};
+
+#define INDEX_VALID		0x1	/* Built from the storage. */
+#define INDEX_OVERFLOW		0x2	/* Some files are not indexed. */
+#define INDEX_REBUILD		0x4	/* Room for unindexed files. */
+#endif /* COFFEE_RAM_INDEX */
+
 /*
  * The protected memory consists of structures that should not be 
  * overwritten during system checkpointing because they may be used by 
@@ -211,11 +402,87 @@ static struct protected_mem_t {
   struct file_desc coffee_fd_set[COFFEE_FD_SET_SIZE];
   coffee_page_t next_free;
   char gc_wait;
+#if COFFEE_RAM_INDEX
+  struct coffee_index index;
+#endif
+#if COFFEE_ERASE_COUNTERS
+  struct erase_counters counters;
+  uint16_t counter_log;
+  uint8_t counter_area;
+#endif
 } protected_mem;
 static struct file * const coffee_files = protected_mem.coffee_files;
 static struct file_desc * const coffee_fd_set = protected_mem.coffee_fd_set;
 static coffee_page_t * const next_free = &protected_mem.next_free;
 static char * const gc_wait = &protected_mem.gc_wait;
+#if COFFEE_RAM_INDEX
+static struct coffee_index * const coffee_index = &protected_mem.index;
+#endif
+#if COFFEE_ERASE_COUNTERS
+static struct erase_counters * const erase_counters = &protected_mem.counters;
+static uint16_t * const counter_log = &protected_mem.counter_log;
+static uint8_t * const counter_area = &protected_mem.counter_area;
+#endif
+
+#if COFFEE_STATS
+static struct cfs_coffee_stats coffee_stats;
+
+/*
+ * The flash operations are counted by wrapping the macros of the
+ * platform. The wrappers are defined before the macros are redefined
+ * to call them, so they still expand to the platform operations.
+ */
+static void
+stats_read(void *buf, unsigned size, unsigned long offset)
+{
+  coffee_stats.reads++;
+  COFFEE_READ(buf, size, offset);
+}
+
+static void
+stats_write(const void *buf, unsigned size, unsigned long offset)
+{
+  coffee_stats.writes++;
+  COFFEE_WRITE(buf, size, offset);
+}
+
+static void
+stats_erase(uint16_t sector)
+{
+  coffee_stats.erases++;
+  COFFEE_ERASE(sector);
+}
+
+#undef COFFEE_READ
+#define COFFEE_READ(buf, size, offset)	stats_read((buf), (size), (offset))
+#undef COFFEE_WRITE
+#define COFFEE_WRITE(buf, size, offset)	stats_write((buf), (size), (offset))
+#undef COFFEE_ERASE
+#define COFFEE_ERASE(sector)		stats_erase(sector)
+#endif /* COFFEE_STATS */
+
+static coffee_page_t next_file(coffee_page_t page, struct file_header *hdr);
+
+#if COFFEE_LOG_COALESCE_TIME
+/*
+ * The log buffer holds one log record that has not been written yet.
+ * It keeps an internal file descriptor open, so that the file stays
+ * cached and follows the file if it is merged.
+ */
+static struct {
+  int fd;
+  uint16_t region;
+  struct ctimer timer;
+  char buf[COFFEE_PAGE_SIZE];
+} log_buffer = { -1 };
+
+static int flush_log_buffer(void);
+static int get_available_fd(void);
+#endif /* COFFEE_LOG_COALESCE_TIME */
+
+#if COFFEE_LOG_COMPACTION
+PROCESS(coffee_compaction_process, "Coffee log compaction");
+#endif
 
 /*---------------------------------------------------------------------------*/
 static void
@@ -242,6 +509,261 @@ absolute_offset(coffee_page_t page, cfs_offset_t offset)
   return page * COFFEE_PAGE_SIZE + sizeof(struct file_header) + offset;
 }
 /*---------------------------------------------------------------------------*/
+#if COFFEE_ERASE_COUNTERS
+static void
+write_counter_snapshot(void)
+{
+  uint32_t magic;
+  uint8_t area;
+
+  area = !*counter_area;
+  COFFEE_ERASE(COUNTER_SECTOR(area));
+  erase_counters->count[COUNTER_SECTOR(area)]++;
+  erase_counters->generation++;
+  COFFEE_WRITE(&erase_counters->generation,
+               sizeof(*erase_counters) - sizeof(magic),
+               COUNTER_SECTOR(area) * COFFEE_SECTOR_SIZE + sizeof(magic));
+  magic = COUNTERS_MAGIC;
+  COFFEE_WRITE(&magic, sizeof(magic), COUNTER_SECTOR(area) * COFFEE_SECTOR_SIZE);
+  *counter_area = area;
+  *counter_log = 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+load_erase_counters(void)
+{
+  uint16_t entries[16];
+  uint32_t header[2][2];
+  unsigned i, n;
+  uint8_t area;
+
+  if(erase_counters->magic == COUNTERS_MAGIC) {
+    return;
+  }
+
+  /* Find the valid snapshot with the highest generation. */
+  for(area = 0; area < COUNTER_SECTORS; area++) {
+    COFFEE_READ(header[area], sizeof(header[area]),
+                COUNTER_SECTOR(area) * COFFEE_SECTOR_SIZE);
+  }
+  if(header[0][0] != COUNTERS_MAGIC && header[1][0] != COUNTERS_MAGIC) {
+    PRINTF("Coffee: Initializing the erase counters\n");
+    memset(erase_counters, 0, sizeof(*erase_counters));
+    erase_counters->magic = COUNTERS_MAGIC;
+    *counter_area = 1;
+    write_counter_snapshot();
+    return;
+  }
+  area = header[0][0] != COUNTERS_MAGIC ||
+    (header[1][0] == COUNTERS_MAGIC &&
+     (int32_t)(header[1][1] - header[0][1]) > 0);
+  *counter_area = area;
+  COFFEE_READ(erase_counters, sizeof(*erase_counters),
+              COUNTER_SECTOR(area) * COFFEE_SECTOR_SIZE);
+
+  for(*counter_log = 0; *counter_log < COUNTER_LOG_ENTRIES;) {
+    n = COUNTER_LOG_ENTRIES - *counter_log;
+    if(n > sizeof(entries) / sizeof(entries[0])) {
+      n = sizeof(entries) / sizeof(entries[0]);
+    }
+    COFFEE_READ(entries, n * sizeof(entries[0]),
+                COUNTER_SECTOR(area) * COFFEE_SECTOR_SIZE + COUNTER_LOG_START +
+                *counter_log * sizeof(entries[0]));
+    for(i = 0; i < n; i++) {
+      if(entries[i] == 0) {
+        return;
+      }
+      if(entries[i] <= COFFEE_SECTOR_COUNT + COUNTER_SECTORS) {
+        erase_counters->count[entries[i] - 1]++;
+      }
+      (*counter_log)++;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+count_erase(uint16_t sector)
+{
+  uint16_t entry;
+
+  load_erase_counters();
+  erase_counters->count[sector]++;
+
+  if(*counter_log >= COUNTER_LOG_ENTRIES) {
+    write_counter_snapshot();
+    return;
+  }
+
+  entry = sector + 1;
+  COFFEE_WRITE(&entry, sizeof(entry),
+               COUNTER_SECTOR(*counter_area) * COFFEE_SECTOR_SIZE +
+               COUNTER_LOG_START + *counter_log * sizeof(entry));
+  (*counter_log)++;
+}
+#endif /* COFFEE_ERASE_COUNTERS */
+/*---------------------------------------------------------------------------*/
+static void
+erase_sector(uint16_t sector)
+{
+  COFFEE_ERASE(sector);
+#if COFFEE_ERASE_COUNTERS
+  count_erase(sector);
+#endif
+}
+/*---------------------------------------------------------------------------*/
+#if COFFEE_RAM_INDEX
+static uint8_t
+index_hash(const char *name)
+{
+  uint8_t hash;
+  int i;
+
+  /* Only the part of the name that is stored in the header counts. */
+  hash = 0;
+  for(i = 0; i < COFFEE_NAME_LENGTH - 1 && name[i] != '\0'; i++) {
+    hash = ((hash << 3) | (hash >> 5)) ^ (uint8_t)name[i];
+  }
+  return hash;
+}
+/*---------------------------------------------------------------------------*/
+static void
+index_add_file(coffee_page_t page, const char *name)
+{
+  if(coffee_index->file_count >= COFFEE_INDEX_FILES) {
+    coffee_index->flags |= INDEX_OVERFLOW;
+    return;
+  }
+  coffee_index->file_page[coffee_index->file_count] = page;
+  coffee_index->file_hash[coffee_index->file_count] = index_hash(name);
+  coffee_index->file_count++;
+}
+/*---------------------------------------------------------------------------*/
+static void
+index_remove_file(coffee_page_t page)
+{
+  uint16_t i, last;
+
+  for(i = 0; i < coffee_index->file_count; i++) {
+    if(coffee_index->file_page[i] == page) {
+      last = --coffee_index->file_count;
+      coffee_index->file_page[i] = coffee_index->file_page[last];
+      coffee_index->file_hash[i] = coffee_index->file_hash[last];
+      break;
+    }
+  }
+
+  /* Unindexed files may fit in the table now. */
+  if(coffee_index->flags & INDEX_OVERFLOW) {
+    coffee_index->flags |= INDEX_REBUILD;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+index_allocate(coffee_page_t page, coffee_page_t count, int active)
+{
+  unsigned sector;
+  coffee_page_t sector_start, pages;
+
+  if(count > COFFEE_PAGE_COUNT - page) {
+    count = COFFEE_PAGE_COUNT - page;
+  }
+
+  for(sector_start = INVALID_PAGE; count > 0;
+      page += pages, count -= pages) {
+    sector = page / COFFEE_PAGES_PER_SECTOR;
+    pages = (sector + 1) * COFFEE_PAGES_PER_SECTOR - page;
+    if(pages > count) {
+      pages = count;
+    }
+
+    if(sector_start != INVALID_PAGE) {
+      /* The extent continues from the previous sector. */
+      coffee_index->spill[sector] = pages;
+    }
+    sector_start = sector * COFFEE_PAGES_PER_SECTOR;
+    coffee_index->used[sector] = page + pages - sector_start;
+    if(active) {
+      coffee_index->active[sector] += pages;
+    } else {
+      coffee_index->obsolete[sector] += pages;
+    }
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+index_obsolete(coffee_page_t page, coffee_page_t count)
+{
+  unsigned sector;
+  coffee_page_t pages;
+
+  for(; count > 0; page += pages, count -= pages) {
+    sector = page / COFFEE_PAGES_PER_SECTOR;
+    pages = (sector + 1) * COFFEE_PAGES_PER_SECTOR - page;
+    if(pages > count) {
+      pages = count;
+    }
+    coffee_index->active[sector] -= pages;
+    coffee_index->obsolete[sector] += pages;
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+index_build(void)
+{
+  struct file_header hdr;
+  coffee_page_t page;
+
+  PRINTF("Coffee: Building the RAM index\n");
+
+  memset(coffee_index, 0, sizeof(*coffee_index));
+  for(page = 0; page < COFFEE_PAGE_COUNT; page = next_file(page, &hdr)) {
+    read_header(&hdr, page);
+    if(HDR_FREE(hdr)) {
+      continue;
+    } else if(HDR_ISOLATED(hdr)) {
+      index_allocate(page, 1, 0);
+    } else {
+      index_allocate(page, hdr.max_pages, HDR_ACTIVE(hdr));
+      if(HDR_ACTIVE(hdr) && !HDR_LOG(hdr)) {
+        index_add_file(page, hdr.name);
+      }
+    }
+  }
+  coffee_index->flags |= INDEX_VALID;
+}
+/*---------------------------------------------------------------------------*/
+static void
+index_check(void)
+{
+  /* The index is built lazily, as the first operation that needs it
+     may come long after the boot. */
+  if(!(coffee_index->flags & INDEX_VALID) ||
+     (coffee_index->flags & INDEX_REBUILD)) {
+    index_build();
+  }
+}
+/*---------------------------------------------------------------------------*/
+static coffee_page_t
+index_find_file(const char *name, struct file_header *hdr)
+{
+  uint16_t i;
+  uint8_t hash;
+
+  index_check();
+
+  hash = index_hash(name);
+  for(i = 0; i < coffee_index->file_count; i++) {
+    if(coffee_index->file_hash[i] == hash) {
+      read_header(hdr, coffee_index->file_page[i]);
+      if(HDR_ACTIVE(*hdr) && !HDR_LOG(*hdr) && strcmp(name, hdr->name) == 0) {
+        return coffee_index->file_page[i];
+      }
+    }
+  }
+  return INVALID_PAGE;
+}
+#endif /* COFFEE_RAM_INDEX */
+/*---------------------------------------------------------------------------*/
 static coffee_page_t
 get_sector_status(uint16_t sector, struct sector_status *stats)
 {
@@ -255,6 +777,23 @@ get_sector_status(uint16_t sector, struct sector_status *stats)
   memset(stats, 0, sizeof(*stats));
   active = obsolete = free = 0;
 
+#if COFFEE_RAM_INDEX
+  stats->active = coffee_index->active[sector];
+  stats->obsolete = coffee_index->obsolete[sector];
+  stats->free = COFFEE_PAGES_PER_SECTOR - coffee_index->used[sector];
+
+  /*
+   * The spill into the next sector can only come from an obsolete
+   * extent if this sector has no active pages, and the caller does not
+   * need the isolation count otherwise.
+   */
+  if(sector + 1 < COFFEE_SECTOR_COUNT &&
+     coffee_index->spill[sector + 1] < COFFEE_PAGES_PER_SECTOR) {
+    return coffee_index->spill[sector + 1];
+  }
+  return 0;
+#endif /* COFFEE_RAM_INDEX */
+
   /*
    * get_sector_status() is an iterative function using local static 
    * state. It therefore requires that the caller starts iterating from 
@@ -283,10 +822,12 @@ get_sector_status(uint16_t sector, struct sector_status *stats)
   } else {
     if(skip_pages >= COFFEE_PAGES_PER_SECTOR) {
       stats->obsolete = COFFEE_PAGES_PER_SECTOR;
+      stats->spill = COFFEE_PAGES_PER_SECTOR;
       skip_pages -= COFFEE_PAGES_PER_SECTOR;
       return skip_pages >= COFFEE_PAGES_PER_SECTOR ? 0 : skip_pages;
     }
     obsolete = skip_pages;
+    stats->spill = skip_pages;
   }
 
   /* Determine the amount of pages of each type that have not been 
@@ -357,6 +898,9 @@ isolate_pages(coffee_page_t start, coffee_page_t skip_pages)
   for(page = 0; page < skip_pages; page++) {
     write_header(&hdr, start + page);
   }
+#if COFFEE_RAM_INDEX
+  coffee_index->spill[start / COFFEE_PAGES_PER_SECTOR] = 0;
+#endif
   PRINTF("Coffee: Isolated %u pages starting in sector %d\n",
          (unsigned)skip_pages, (int)start / COFFEE_PAGES_PER_SECTOR);
 
@@ -368,9 +912,21 @@ collect_garbage(int mode)
   uint16_t sector;
   struct sector_status stats;
   coffee_page_t first_page, isolation_count;
+#if COFFEE_RAM_INDEX
+  uint16_t erased;
+#endif
+#if COFFEE_STATS
+  clock_time_t start, pause;
+
+  start = clock_time();
+#endif
 
   PRINTF("Coffee: Running the file system garbage collector in %s mode\n",
 	 mode == GC_RELUCTANT ? "reluctant" : "greedy");
+#if COFFEE_RAM_INDEX
+  index_check();
+  erased = COFFEE_SECTOR_COUNT;
+#endif
   /*
    * The garbage collector erases as many sectors as possible. A sector is
    * erasable if there are only free or obsolete pages in it.
@@ -387,23 +943,50 @@ collect_garbage(int mode)
 
     if((mode == GC_RELUCTANT && stats.free == 0) ||
        (mode == GC_GREEDY && stats.obsolete > 0)) {
+      /*
+       * The pages of an obsolete extent that starts in a previous sector
+       * remain allocated until the header of the extent is erased, so
+       * the allocation must not start before them.
+       */
       first_page = sector * COFFEE_PAGES_PER_SECTOR;
-      if(first_page < *next_free) {
-        *next_free = first_page;
+      if(first_page + stats.spill < *next_free) {
+        *next_free = first_page + stats.spill;
       }
 
       if(isolation_count > 0) {
         isolate_pages(first_page + COFFEE_PAGES_PER_SECTOR, isolation_count);
       }
 
-      COFFEE_ERASE(sector);
+      erase_sector(sector);
       PRINTF("Coffee: Erased sector %d!\n", sector);
+#if COFFEE_RAM_INDEX
+      /*
+       * Pages of an obsolete extent that starts in a previous sector
+       * remain allocated until the header of the extent is erased.
+       */
+      if(sector > 0 && erased == sector - 1 &&
+         coffee_index->used[sector - 1] < COFFEE_PAGES_PER_SECTOR) {
+        coffee_index->spill[sector] = 0;
+      }
+      coffee_index->used[sector] = coffee_index->spill[sector];
+      coffee_index->obsolete[sector] = coffee_index->spill[sector];
+      erased = sector;
+#endif
 
       if(mode == GC_RELUCTANT && isolation_count > 0) {
         break;
       }
     }
   }
+
+#if COFFEE_STATS
+  pause = clock_time() - start;
+  coffee_stats.gc_runs++;
+  coffee_stats.gc_time += pause;
+  if(pause > coffee_stats.gc_max_time) {
+    coffee_stats.gc_max_time = pause;
+  }
+#endif
 }
 /*---------------------------------------------------------------------------*/
 static coffee_page_t
@@ -465,6 +1048,13 @@ load_file(coffee_page_t start, struct file_header *hdr)
   }
   /* We don't know the amount of records yet. */
   file->record_count = -1;
+#if COFFEE_RING_FILES
+  if(HDR_RING(*hdr)) {
+    file->flags |= COFFEE_FILE_RING;
+  }
+  file->ring_tail = 0;
+  file->ring_seq = 0;
+#endif
 
   return file;
 }
@@ -475,6 +1065,23 @@ find_file(const char *name)
   int i;
   struct file_header hdr;
   coffee_page_t page;
+
+#if COFFEE_RAM_INDEX
+  page = index_find_file(name, &hdr);
+  if(page != INVALID_PAGE) {
+    for(i = 0; i < COFFEE_MAX_OPEN_FILES; i++) {
+      if(!FILE_FREE(&coffee_files[i]) && coffee_files[i].page == page) {
+        return &coffee_files[i];
+      }
+    }
+    return load_file(page, &hdr);
+  }
+
+  /* Only the files that did not fit in the index must be searched. */
+  if(!(coffee_index->flags & INDEX_OVERFLOW)) {
+    return NULL;
+  }
+#endif /* COFFEE_RAM_INDEX */
   
   /* First check if the file metadata is cached. */
   for(i = 0; i < COFFEE_MAX_OPEN_FILES; i++) {
@@ -538,6 +1145,36 @@ find_contiguous_pages(coffee_page_t amount)
 {
   coffee_page_t page, start;
   struct file_header hdr;
+#if COFFEE_RAM_INDEX
+  unsigned sector;
+  coffee_page_t used;
+
+  index_check();
+
+  /* A run of free pages starts after the used pages of a sector, and
+     continues through the following sectors that are entirely free. */
+  start = INVALID_PAGE;
+  for(sector = *next_free / COFFEE_PAGES_PER_SECTOR;
+      sector < COFFEE_SECTOR_COUNT;
+      sector++) {
+    used = coffee_index->used[sector];
+    if(start == INVALID_PAGE || used > 0) {
+      start = INVALID_PAGE;
+      if(used < COFFEE_PAGES_PER_SECTOR) {
+        start = sector * COFFEE_PAGES_PER_SECTOR + used;
+      }
+    }
+
+    page = (sector + 1) * COFFEE_PAGES_PER_SECTOR;
+    if(start != INVALID_PAGE && start + amount <= page) {
+      if(start == *next_free) {
+        *next_free = start + amount;
+      }
+      return start;
+    }
+  }
+  return INVALID_PAGE;
+#endif /* COFFEE_RAM_INDEX */
 
   start = INVALID_PAGE;
   for(page = *next_free; page < COFFEE_PAGE_COUNT;) {
@@ -569,6 +1206,163 @@ find_contiguous_pages(coffee_page_t amount)
   return INVALID_PAGE;
 }
 /*---------------------------------------------------------------------------*/
+#if COFFEE_RING_FILES
+static coffee_page_t
+find_ring_pages(coffee_page_t *pages)
+{
+  coffee_page_t start, sectors;
+#if COFFEE_RAM_INDEX
+  unsigned sector, i;
+#else
+  coffee_page_t page;
+  struct file_header hdr;
+#endif
+
+  /*
+   * The data sectors of a ring file are erased one at a time, so the
+   * file must own them entirely. The header is placed in the first free
+   * page before them, and the rest of that sector is left unused.
+   */
+  sectors = *pages / COFFEE_PAGES_PER_SECTOR;
+  start = INVALID_PAGE;
+
+#if COFFEE_RAM_INDEX
+  index_check();
+
+  for(sector = *next_free / COFFEE_PAGES_PER_SECTOR;
+      sector + sectors < COFFEE_SECTOR_COUNT;
+      sector++) {
+    if(coffee_index->used[sector] == COFFEE_PAGES_PER_SECTOR) {
+      continue;
+    }
+    for(i = 1; i <= sectors && coffee_index->used[sector + i] == 0; i++);
+    if(i > sectors) {
+      start = sector * COFFEE_PAGES_PER_SECTOR + coffee_index->used[sector];
+      break;
+    }
+  }
+#else
+  for(page = *next_free; page < COFFEE_PAGE_COUNT;) {
+    read_header(&hdr, page);
+    if(!HDR_FREE(hdr)) {
+      start = INVALID_PAGE;
+      page = next_file(page, &hdr);
+      continue;
+    }
+
+    if(start == INVALID_PAGE) {
+      start = page;
+    }
+    page = next_file(page, &hdr);
+    if(page - RING_FIRST_SECTOR(start) * COFFEE_PAGES_PER_SECTOR >=
+       sectors * COFFEE_PAGES_PER_SECTOR) {
+      break;
+    }
+    if(page >= COFFEE_PAGE_COUNT) {
+      start = INVALID_PAGE;
+    }
+  }
+#endif /* COFFEE_RAM_INDEX */
+
+  if(start == INVALID_PAGE) {
+    return INVALID_PAGE;
+  }
+
+  *pages = (RING_FIRST_SECTOR(start) + sectors) * COFFEE_PAGES_PER_SECTOR -
+           start;
+  if(start == *next_free) {
+    *next_free = start + *pages;
+  }
+  return start;
+}
+#endif /* COFFEE_RING_FILES */
+/*---------------------------------------------------------------------------*/
+#if COFFEE_ERASE_COUNTERS
+static coffee_page_t
+find_least_worn_sectors(coffee_page_t amount)
+{
+  uint16_t sector, sectors, run, first, best, i;
+  uint32_t wear, best_wear;
+#if !COFFEE_RAM_INDEX
+  struct file_header hdr;
+  coffee_page_t page;
+#endif
+
+  load_erase_counters();
+  sectors = (amount + COFFEE_PAGES_PER_SECTOR - 1) / COFFEE_PAGES_PER_SECTOR;
+  best = COFFEE_SECTOR_COUNT;
+  best_wear = 0;
+  run = 0;
+
+  /* Look at every run of entirely free sectors that is long enough. */
+#if COFFEE_RAM_INDEX
+  index_check();
+  for(sector = 0; sector < COFFEE_SECTOR_COUNT; sector++) {
+    run = coffee_index->used[sector] == 0 ? run + 1 : 0;
+#else
+  for(page = 0; page < COFFEE_PAGE_COUNT; page = next_file(page, &hdr)) {
+    read_header(&hdr, page);
+    sector = page / COFFEE_PAGES_PER_SECTOR;
+    run = HDR_FREE(hdr) && page % COFFEE_PAGES_PER_SECTOR == 0 ? run + 1 : 0;
+#endif
+    if(run < sectors) {
+      continue;
+    }
+
+    /* The wear of a run is that of its most worn sector. */
+    first = sector + 1 - sectors;
+    for(wear = 0, i = first; i <= sector; i++) {
+      if(erase_counters->count[i] > wear) {
+        wear = erase_counters->count[i];
+      }
+    }
+    if(best == COFFEE_SECTOR_COUNT || wear < best_wear) {
+      best = first;
+      best_wear = wear;
+    }
+  }
+
+  if(best == COFFEE_SECTOR_COUNT) {
+    return INVALID_PAGE;
+  }
+  return best * COFFEE_PAGES_PER_SECTOR;
+}
+#endif /* COFFEE_ERASE_COUNTERS */
+/*---------------------------------------------------------------------------*/
+static coffee_page_t
+find_free_pages(coffee_page_t *pages, unsigned flags)
+{
+  coffee_page_t page;
+#if COFFEE_ERASE_COUNTERS
+  coffee_page_t first_free;
+#endif
+
+#if COFFEE_RING_FILES
+  if(flags & HDR_FLAG_RING) {
+    return find_ring_pages(pages);
+  }
+#endif
+
+#if COFFEE_ERASE_COUNTERS
+  first_free = *next_free;
+#endif
+  page = find_contiguous_pages(*pages);
+#if COFFEE_ERASE_COUNTERS
+  /*
+   * Files that would start in an erased sector get the least worn
+   * sectors instead. Partially used sectors are always filled first.
+   */
+  if(page != INVALID_PAGE && page % COFFEE_PAGES_PER_SECTOR == 0) {
+    page = find_least_worn_sectors(*pages);
+    *next_free = first_free;
+    if(page == *next_free) {
+      *next_free = page + *pages;
+    }
+  }
+#endif
+  return page;
+}
+/*---------------------------------------------------------------------------*/
 static int
 remove_by_page(coffee_page_t page, int remove_log, int close_fds,
                int gc_allowed)
@@ -589,9 +1383,26 @@ remove_by_page(coffee_page_t page, int remove_log, int close_fds,
 
   hdr.flags |= HDR_FLAG_OBSOLETE;
   write_header(&hdr, page);
+#if COFFEE_RAM_INDEX
+  if(coffee_index->flags & INDEX_VALID) {
+    index_obsolete(page, hdr.max_pages);
+    if(!HDR_LOG(hdr)) {
+      index_remove_file(page);
+    }
+  }
+#endif
 
   *gc_wait = 0;
 
+#if COFFEE_LOG_COALESCE_TIME
+  /* A buffered log record of a removed file is discarded. */
+  if(log_buffer.fd >= 0 && coffee_fd_set[log_buffer.fd].file->page == page) {
+    ctimer_stop(&log_buffer.timer);
+    coffee_fd_set[log_buffer.fd].flags = COFFEE_FD_FREE;
+    log_buffer.fd = -1;
+  }
+#endif
+
   /* Close all file descriptors that reference the removed file. */
   if(close_fds) {
     for(i = 0; i < COFFEE_FD_SET_SIZE; i++) {
@@ -637,13 +1448,13 @@ reserve(const char *name, coffee_page_t pages,
     return NULL;
   }
 
-  page = find_contiguous_pages(pages);
+  page = find_free_pages(&pages, flags);
   if(page == INVALID_PAGE) {
     if(*gc_wait) {
       return NULL;
     }
     collect_garbage(GC_GREEDY);
-    page = find_contiguous_pages(pages);
+    page = find_free_pages(&pages, flags);
     if(page == INVALID_PAGE) {
       *gc_wait = 1;
       return NULL;
@@ -655,6 +1466,12 @@ reserve(const char *name, coffee_page_t pages,
   hdr.max_pages = pages;
   hdr.flags = HDR_FLAG_ALLOCATED | flags;
   write_header(&hdr, page);
+#if COFFEE_RAM_INDEX
+  index_allocate(page, pages, 1);
+  if(!(flags & HDR_FLAG_LOG)) {
+    index_add_file(page, hdr.name);
+  }
+#endif
 
   PRINTF("Coffee: Reserved %u pages starting from %u for file %s\n",
       pages, page, name);
@@ -741,8 +1558,8 @@ get_record_index(coffee_page_t log_page, uint16_t search_records,
 /*---------------------------------------------------------------------------*/
 #if COFFEE_MICRO_LOGS
 static int
-read_log_page(struct file_header *hdr, int16_t record_count,
-              struct log_param *lp)
+read_log_page(struct file *file, struct file_header *hdr,
+              int16_t record_count, struct log_param *lp)
 {
   uint16_t region;
   int16_t match_index;
@@ -754,8 +1571,15 @@ read_log_page(struct file_header *hdr, int16_t record_count,
   adjust_log_config(hdr, &log_record_size, &log_records);
   region = modify_log_buffer(log_record_size, &lp->offset, &lp->size);
 
-  search_records = record_count < 0 ? log_records : record_count;
-  match_index = get_record_index(hdr->log_page, search_records, region);
+#if COFFEE_LOG_MAP_SIZE
+  if(FILE_LOG_MAPPED(file) && region < COFFEE_LOG_MAP_SIZE) {
+    match_index = (int16_t)file->log_map[region] - 1;
+  } else
+#endif
+  {
+    search_records = record_count < 0 ? log_records : record_count;
+    match_index = get_record_index(hdr->log_page, search_records, region);
+  }
   if(match_index < 0) {
     return -1;
   }
@@ -763,7 +1587,7 @@ read_log_page(struct file_header *hdr, int16_t record_count,
   base = absolute_offset(hdr->log_page, log_records * sizeof(region));
   base += (cfs_offset_t)match_index * log_record_size;
   base += lp->offset;
-  COFFEE_READ(lp->buf, lp->size, base);
+  COFFEE_READ((char *)lp->buf, lp->size, base);
 
   return lp->size;
 }
@@ -792,6 +1616,12 @@ create_log(struct file *file, struct file_header *hdr)
   write_header(hdr, file->page);
 
   file->flags |= COFFEE_FILE_MODIFIED;
+#if COFFEE_LOG_MAP_SIZE
+  memset(file->log_map, 0, sizeof(file->log_map));
+  if(LOG_MAPPABLE(log_records)) {
+    file->flags |= COFFEE_FILE_LOG_MAPPED;
+  }
+#endif
   return log_file->page;
 }
 #endif /* COFFEE_MICRO_LOGS */
@@ -806,6 +1636,17 @@ merge_log(coffee_page_t file_page, int extend)
   struct file *new_file;
   int i;
 
+#if COFFEE_LOG_COALESCE_TIME
+  /*
+   * Writing the buffered log record may merge the file and reuse its
+   * pages, so the caller has to retry with the current file page.
+   */
+  if(log_buffer.fd >= 0 &&
+     coffee_fd_set[log_buffer.fd].file->page == file_page) {
+    return flush_log_buffer();
+  }
+#endif
+
   read_header(&hdr, file_page);
 
   fd = cfs_open(hdr.name, CFS_READ);
@@ -863,6 +1704,9 @@ merge_log(coffee_page_t file_page, int extend)
 
   cfs_close(fd);
 
+#if COFFEE_STATS
+  coffee_stats.merges++;
+#endif
   return 0;
 }
 /*---------------------------------------------------------------------------*/
@@ -873,10 +1717,18 @@ find_next_record(struct file *file, coffee_page_t log_page,
 {
   int log_record, preferred_batch_size;
 
-  if(file->record_count >= 0) {
+  if(file->record_count >= 0
+#if COFFEE_LOG_MAP_SIZE
+     && (FILE_LOG_MAPPED(file) || !LOG_MAPPABLE(log_records))
+#endif
+     ) {
     return file->record_count;
   }
 
+#if COFFEE_LOG_MAP_SIZE
+  memset(file->log_map, 0, sizeof(file->log_map));
+#endif
+
   preferred_batch_size = log_records > COFFEE_LOG_TABLE_LIMIT ?
 			 COFFEE_LOG_TABLE_LIMIT : log_records;
   {
@@ -894,20 +1746,34 @@ find_next_record(struct file *file, coffee_page_t log_page,
 		  absolute_offset(log_page, processed * sizeof(indices[0])));
       for(log_record = 0; log_record < batch_size; log_record++) {
 	if(indices[log_record] == 0) {
-	  log_record += processed;
 	  break;
 	}
+#if COFFEE_LOG_MAP_SIZE
+	if(indices[log_record] - 1 < COFFEE_LOG_MAP_SIZE) {
+	  file->log_map[indices[log_record] - 1] = processed + log_record + 1;
+	}
+#endif
+      }
+      log_record += processed;
+      if(log_record < processed + batch_size) {
+	break;
       }
     }
   }
 
+  file->record_count = log_record;
+#if COFFEE_LOG_MAP_SIZE
+  if(LOG_MAPPABLE(log_records)) {
+    file->flags |= COFFEE_FILE_LOG_MAPPED;
+  }
+#endif
   return log_record;
 }
 #endif /* COFFEE_MICRO_LOGS */
 /*---------------------------------------------------------------------------*/
 #if COFFEE_MICRO_LOGS
 static int
-write_log_page(struct file *file, struct log_param *lp)
+write_log_record(struct file *file, struct log_param *lp)
 {
   struct file_header hdr;
   uint16_t region;
@@ -953,7 +1819,7 @@ write_log_page(struct file *file, struct log_param *lp)
     lp_out.size = log_record_size;
 
     if((lp->offset > 0 || lp->size != log_record_size) &&
-	read_log_page(&hdr, log_record, &lp_out) < 0) {
+	read_log_page(file, &hdr, log_record, &lp_out) < 0) {
       COFFEE_READ(copy_buf, sizeof(copy_buf),
 	  absolute_offset(file->page, offset));
     }
@@ -973,12 +1839,341 @@ write_log_page(struct file *file, struct log_param *lp)
     COFFEE_WRITE(copy_buf, sizeof(copy_buf),
 		 offset + log_record * log_record_size);
     file->record_count = log_record + 1;
+#if COFFEE_LOG_MAP_SIZE
+    if(FILE_LOG_MAPPED(file) && region - 1 < COFFEE_LOG_MAP_SIZE) {
+      file->log_map[region - 1] = log_record + 1;
+    }
+#endif
+  }
+
+#if COFFEE_LOG_COMPACTION
+  if(!process_is_running(&coffee_compaction_process)) {
+    process_start(&coffee_compaction_process, NULL);
   }
+#endif
 
   return lp->size;
 }
 #endif /* COFFEE_MICRO_LOGS */
 /*---------------------------------------------------------------------------*/
+#if COFFEE_LOG_COALESCE_TIME
+static void
+flush_log_buffer_timeout(void *ptr)
+{
+  flush_log_buffer();
+}
+/*---------------------------------------------------------------------------*/
+static int
+flush_log_buffer(void)
+{
+  struct file_header hdr;
+  struct log_param lp;
+  uint16_t log_record_size, log_records;
+  int fd, r;
+
+  if(log_buffer.fd < 0) {
+    return 0;
+  }
+
+  /* Release the buffer first, as writing the record may merge the file. */
+  fd = log_buffer.fd;
+  log_buffer.fd = -1;
+  ctimer_stop(&log_buffer.timer);
+
+  do {
+    read_header(&hdr, coffee_fd_set[fd].file->page);
+    adjust_log_config(&hdr, &log_record_size, &log_records);
+    lp.offset = (cfs_offset_t)log_buffer.region * log_record_size;
+    lp.buf = log_buffer.buf;
+    lp.size = log_record_size;
+    r = write_log_record(coffee_fd_set[fd].file, &lp);
+  } while(r == 0);
+
+  if(r < 0) {
+    /* Keep the record, which reads still see, and try again later. */
+    PRINTF("Coffee: Failed to write a buffered log record of %s\n",
+           hdr.name);
+    log_buffer.fd = fd;
+    ctimer_set(&log_buffer.timer, COFFEE_LOG_COALESCE_TIME,
+               flush_log_buffer_timeout, NULL);
+    return -1;
+  }
+
+  cfs_close(fd);
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+read_log_buffer(struct file *file, cfs_offset_t offset,
+                char *buf, unsigned size)
+{
+  struct file_header hdr;
+  uint16_t log_record_size, log_records;
+  cfs_offset_t start, end;
+
+  read_header(&hdr, file->page);
+  adjust_log_config(&hdr, &log_record_size, &log_records);
+
+  start = (cfs_offset_t)log_buffer.region * log_record_size;
+  end = start + log_record_size;
+  if(start < offset) {
+    start = offset;
+  }
+  if(end > offset + size) {
+    end = offset + size;
+  }
+  if(start < end) {
+    memcpy(buf + (start - offset),
+           log_buffer.buf + (start % log_record_size), end - start);
+  }
+}
+#endif /* COFFEE_LOG_COALESCE_TIME */
+/*---------------------------------------------------------------------------*/
+#if COFFEE_MICRO_LOGS
+static int
+write_log_page(struct file *file, struct log_param *lp)
+{
+#if COFFEE_LOG_COALESCE_TIME
+  struct file_header hdr;
+  struct log_param lp_out;
+  uint16_t region, size;
+  uint16_t log_record_size, log_records;
+  cfs_offset_t offset;
+  int fd;
+
+  read_header(&hdr, file->page);
+  adjust_log_config(&hdr, &log_record_size, &log_records);
+  offset = lp->offset;
+  size = lp->size;
+  region = modify_log_buffer(log_record_size, &offset, &size);
+
+  if(FILE_BUFFERED(file)) {
+    if(log_buffer.region == region) {
+      memcpy(&log_buffer.buf[offset], lp->buf, size);
+      return size;
+    }
+    /* The file may be merged when the buffered record is written,
+       so the caller has to look up the file again. */
+    return flush_log_buffer() < 0 ? -1 : 0;
+  }
+
+  fd = -1;
+  if(flush_log_buffer() == 0) {
+    fd = get_available_fd();
+  }
+  if(fd >= 0) {
+    /* Start a new buffered record from the current region contents. */
+    lp_out.offset = offset = (cfs_offset_t)region * log_record_size;
+    lp_out.buf = log_buffer.buf;
+    lp_out.size = log_record_size;
+    if(!HDR_MODIFIED(hdr) ||
+       read_log_page(file, &hdr, find_next_record(file, hdr.log_page,
+                                                  log_records),
+                     &lp_out) < 0) {
+      COFFEE_READ(log_buffer.buf, log_record_size,
+		  absolute_offset(file->page, offset));
+    }
+    offset = lp->offset % log_record_size;
+    memcpy(&log_buffer.buf[offset], lp->buf, size);
+
+    coffee_fd_set[fd].file = file;
+    coffee_fd_set[fd].flags = CFS_READ | CFS_WRITE;
+    coffee_fd_set[fd].offset = 0;
+#if COFFEE_IO_SEMANTICS
+    coffee_fd_set[fd].io_flags = 0;
+#endif
+    file->references++;
+    log_buffer.fd = fd;
+    log_buffer.region = region;
+    ctimer_set(&log_buffer.timer, COFFEE_LOG_COALESCE_TIME,
+               flush_log_buffer_timeout, NULL);
+    return size;
+  }
+#endif /* COFFEE_LOG_COALESCE_TIME */
+
+  return write_log_record(file, lp);
+}
+#endif /* COFFEE_MICRO_LOGS */
+/*---------------------------------------------------------------------------*/
+#if COFFEE_RING_FILES
+static int
+read_ring_stamp(uint16_t sector, uint16_t *seq)
+{
+  struct ring_stamp stamp;
+
+  COFFEE_READ(&stamp, sizeof(stamp), sector * COFFEE_SECTOR_SIZE);
+  *seq = stamp.seq;
+  return RING_STAMP_VALID(stamp);
+}
+/*---------------------------------------------------------------------------*/
+static cfs_offset_t
+ring_scan(coffee_page_t page, coffee_page_t max_pages,
+          uint16_t *tail, uint16_t *seq, uint16_t *used)
+{
+  unsigned char buf[COFFEE_PAGE_SIZE];
+  uint16_t first, count, head, prev, head_seq, prev_seq;
+  coffee_page_t sector_page;
+  int i;
+
+  first = RING_FIRST_SECTOR(page);
+  count = RING_SECTORS(page, max_pages);
+  *tail = *seq = *used = 0;
+
+  /*
+   * The sectors hold consecutive sequence numbers in ring order. The
+   * head is the valid sector that is not followed by its successor.
+   */
+  for(head = 0; head < count; head++) {
+    if(read_ring_stamp(first + head, &head_seq) &&
+       !(read_ring_stamp(first + (head + 1) % count, &prev_seq) &&
+         prev_seq == (uint16_t)(head_seq + 1))) {
+      break;
+    }
+  }
+  if(head == count) {
+    /* Nothing has been written yet. */
+    return 0;
+  }
+
+  *tail = head;
+  *seq = head_seq;
+  for(*used = 1; *used < count; (*used)++) {
+    prev = (*tail + count - 1) % count;
+    if(!read_ring_stamp(first + prev, &prev_seq) ||
+       (uint16_t)(prev_seq + 1) != *seq) {
+      break;
+    }
+    *tail = prev;
+    *seq = prev_seq;
+  }
+
+  /* Find the end of the head sector in the same way as file_end(). */
+  for(sector_page = COFFEE_PAGES_PER_SECTOR - 1; sector_page >= 0;
+      sector_page--) {
+    COFFEE_READ(buf, sizeof(buf), (first + head) * COFFEE_SECTOR_SIZE +
+                sector_page * COFFEE_PAGE_SIZE);
+    for(i = COFFEE_PAGE_SIZE - 1; i >= 0; i--) {
+      if(buf[i] != 0) {
+        if(sector_page == 0 && i < sizeof(struct ring_stamp)) {
+          return (*used - 1) * RING_DATA_SIZE;
+        }
+        return (*used - 1) * RING_DATA_SIZE + 1 + i +
+               sector_page * COFFEE_PAGE_SIZE - sizeof(struct ring_stamp);
+      }
+    }
+  }
+
+  return (*used - 1) * RING_DATA_SIZE;
+}
+/*---------------------------------------------------------------------------*/
+static void
+ring_load(struct file *file)
+{
+  uint16_t count, used;
+
+  count = RING_SECTORS(file->page, file->max_pages);
+  file->end = ring_scan(file->page, file->max_pages,
+                        &file->ring_tail, &file->ring_seq, &used);
+
+  /*
+   * The sector after the head may have been partially erased when the
+   * power was lost during a wrap-around. Erase it again before it is
+   * written.
+   */
+  if(used + 1 == count) {
+    erase_sector(RING_FIRST_SECTOR(file->page) +
+                 (file->ring_tail + used) % count);
+  }
+}
+/*---------------------------------------------------------------------------*/
+static int
+ring_write(struct file_desc *fdp, const char *buf, unsigned size)
+{
+  struct file *file;
+  struct ring_stamp stamp;
+  uint16_t first, count, n;
+  cfs_offset_t offset, sector_start;
+  unsigned bytes_left, chunk;
+  int i;
+
+  file = fdp->file;
+  first = RING_FIRST_SECTOR(file->page);
+  count = RING_SECTORS(file->page, file->max_pages);
+
+  for(bytes_left = size; bytes_left > 0; bytes_left -= chunk) {
+    n = file->end / RING_DATA_SIZE;
+    offset = file->end % RING_DATA_SIZE;
+
+    if(offset == 0 && n == count) {
+      /* The file is full; discard the oldest sector. */
+      erase_sector(first + file->ring_tail);
+      file->ring_tail = (file->ring_tail + 1) % count;
+      file->ring_seq++;
+      file->end -= RING_DATA_SIZE;
+      n--;
+
+      for(i = 0; i < COFFEE_FD_SET_SIZE; i++) {
+        if(coffee_fd_set[i].flags != COFFEE_FD_FREE &&
+           coffee_fd_set[i].file == file) {
+          coffee_fd_set[i].offset = coffee_fd_set[i].offset > RING_DATA_SIZE ?
+            coffee_fd_set[i].offset - RING_DATA_SIZE : 0;
+        }
+      }
+      PRINTF("Coffee: Wrapped around the ring file at page %u\n",
+             (unsigned)file->page);
+    }
+
+    sector_start = (first + (file->ring_tail + n) % count) *
+                   COFFEE_SECTOR_SIZE;
+    if(offset == 0) {
+      stamp.seq = file->ring_seq + n;
+      stamp.check = ~stamp.seq;
+      COFFEE_WRITE(&stamp, sizeof(stamp), sector_start);
+    }
+
+    chunk = RING_DATA_SIZE - offset;
+    if(chunk > bytes_left) {
+      chunk = bytes_left;
+    }
+    COFFEE_WRITE(buf, chunk, sector_start + sizeof(stamp) + offset);
+    buf += chunk;
+    file->end += chunk;
+  }
+
+  fdp->offset = file->end;
+  return size;
+}
+/*---------------------------------------------------------------------------*/
+static int
+ring_read(struct file_desc *fdp, char *buf, unsigned size)
+{
+  struct file *file;
+  uint16_t first, count, n;
+  cfs_offset_t offset;
+  unsigned bytes_left, chunk;
+
+  file = fdp->file;
+  first = RING_FIRST_SECTOR(file->page);
+  count = RING_SECTORS(file->page, file->max_pages);
+
+  for(bytes_left = size; bytes_left > 0; bytes_left -= chunk) {
+    n = fdp->offset / RING_DATA_SIZE;
+    offset = fdp->offset % RING_DATA_SIZE;
+
+    chunk = RING_DATA_SIZE - offset;
+    if(chunk > bytes_left) {
+      chunk = bytes_left;
+    }
+    COFFEE_READ(buf, chunk, (first + (file->ring_tail + n) % count) *
+                COFFEE_SECTOR_SIZE + sizeof(struct ring_stamp) + offset);
+    buf += chunk;
+    fdp->offset += chunk;
+  }
+
+  return size;
+}
+#endif /* COFFEE_RING_FILES */
+/*---------------------------------------------------------------------------*/
 static int
 get_available_fd(void)
 {
@@ -1018,6 +2213,11 @@ cfs_open(const char *name, int flags)
     }
     fdp->file->end = 0;
   } else if(fdp->file->end == UNKNOWN_OFFSET) {
+#if COFFEE_RING_FILES
+    if(FILE_RING(fdp->file)) {
+      ring_load(fdp->file);
+    } else
+#endif
     fdp->file->end = file_end(fdp->file->page);
   }
 
@@ -1063,6 +2263,13 @@ cfs_seek(int fd, cfs_offset_t offset, int whence)
     return -1;
   }
 
+#if COFFEE_RING_FILES
+  /* Ring files cannot be extended by seeking. */
+  if(FILE_RING(fdp->file) && new_offset > fdp->file->end) {
+    return -1;
+  }
+#endif
+
   if(fdp->file->end < new_offset) {
     fdp->file->end = new_offset;
   }
@@ -1099,6 +2306,9 @@ cfs_read(int fd, void *buf, unsigned size)
   struct log_param lp;
   unsigned bytes_left;
   int r;
+#if COFFEE_LOG_MAP_SIZE
+  uint16_t log_record_size, log_records;
+#endif
 #endif
 
   if(!(FD_VALID(fd) && FD_READABLE(fd))) {
@@ -1106,20 +2316,42 @@ cfs_read(int fd, void *buf, unsigned size)
   }
 
   fdp = &coffee_fd_set[fd];
+#if COFFEE_LOG_COALESCE_TIME
+  if(FILE_BUFFERED(fdp->file)) {
+    flush_log_buffer();
+  }
+#endif
   file = fdp->file;
   if(fdp->offset + size > file->end) {
     size = file->end - fdp->offset;
   }
 
+#if COFFEE_RING_FILES
+  if(FILE_RING(file)) {
+    return ring_read(fdp, buf, size);
+  }
+#endif
+
   /* If the file is allocated, read directly in the file. */
   if(!FILE_MODIFIED(file)) {
     COFFEE_READ(buf, size, absolute_offset(file->page, fdp->offset));
+#if COFFEE_LOG_COALESCE_TIME
+    if(FILE_BUFFERED(file)) {
+      read_log_buffer(file, fdp->offset, buf, size);
+    }
+#endif
     fdp->offset += size;
     return size;
   }
 
 #if COFFEE_MICRO_LOGS
   read_header(&hdr, file->page);
+#if COFFEE_LOG_MAP_SIZE
+  if(!FILE_LOG_MAPPED(file)) {
+    adjust_log_config(&hdr, &log_record_size, &log_records);
+    find_next_record(file, hdr.log_page, log_records);
+  }
+#endif
 
   /*
    * Fill the buffer by copying from the log in first hand, or the
@@ -1131,7 +2363,7 @@ cfs_read(int fd, void *buf, unsigned size)
     lp.offset = fdp->offset;
     lp.buf = buf;
     lp.size = bytes_left;
-    r = read_log_page(&hdr, file->record_count, &lp);
+    r = read_log_page(file, &hdr, file->record_count, &lp);
 
     /* Read from the original file if we cannot find the data in the log. */
     if(r < 0) {
@@ -1141,6 +2373,13 @@ cfs_read(int fd, void *buf, unsigned size)
     fdp->offset += r;
     buf = (char *)buf + r;
   }
+
+#if COFFEE_LOG_COALESCE_TIME
+  /* The buffered record could not be written out. */
+  if(FILE_BUFFERED(file)) {
+    read_log_buffer(file, fdp->offset - size, (char *)buf - size, size);
+  }
+#endif
 #endif /* COFFEE_MICRO_LOGS */
 
   return size;
@@ -1155,6 +2394,7 @@ cfs_write(int fd, const void *buf, unsigned size)
   int i;
   struct log_param lp;
   cfs_offset_t bytes_left;
+  int extended;
   const char dummy[1] = { 0xff };
 #endif
 
@@ -1165,6 +2405,13 @@ cfs_write(int fd, const void *buf, unsigned size)
   fdp = &coffee_fd_set[fd];
   file = fdp->file;
 
+#if COFFEE_RING_FILES
+  /* Ring files are append-only and never extended. */
+  if(FILE_RING(file)) {
+    return ring_write(fdp, buf, size);
+  }
+#endif
+
   /* Attempt to extend the file if we try to write past the end. */
 #if COFFEE_IO_SEMANTICS
   if(!(fdp->io_flags & CFS_COFFEE_IO_FIRM_SIZE)) {
@@ -1183,11 +2430,13 @@ cfs_write(int fd, const void *buf, unsigned size)
 
 #if COFFEE_MICRO_LOGS
 #if COFFEE_IO_SEMANTICS
-  if(!(fdp->io_flags & CFS_COFFEE_IO_FLASH_AWARE) &&
-     (FILE_MODIFIED(file) || fdp->offset < file->end)) {
+  if(FILE_BUFFERED(file) ||
+     (!(fdp->io_flags & CFS_COFFEE_IO_FLASH_AWARE) &&
+     (FILE_MODIFIED(file) || fdp->offset < file->end))) {
 #else
-  if(FILE_MODIFIED(file) || fdp->offset < file->end) {
+  if(FILE_BUFFERED(file) || FILE_MODIFIED(file) || fdp->offset < file->end) {
 #endif
+    extended = 0;
     for(bytes_left = size; bytes_left > 0;) {
       lp.offset = fdp->offset;
       lp.buf = buf;
@@ -1212,13 +2461,18 @@ cfs_write(int fd, const void *buf, unsigned size)
            occur while writing log records. */
         if(fdp->offset > file->end) {
           file->end = fdp->offset;
+          extended = 1;
         }
       }
     }
 
-    if(fdp->offset > file->end) {
-      /* Update the original file's end with a dummy write. */
-      COFFEE_WRITE(dummy, 1, absolute_offset(file->page, fdp->offset));
+    if(extended) {
+      /*
+       * Update the original file's end with a dummy write to its last
+       * byte, so that the end is found again after a reboot. Reads of
+       * that byte use the log record that was just written.
+       */
+      COFFEE_WRITE(dummy, 1, absolute_offset(file->page, fdp->offset - 1));
     }
   } else {
 #endif /* COFFEE_MICRO_LOGS */
@@ -1257,6 +2511,9 @@ cfs_readdir(struct cfs_dir *dir, struct cfs_dirent *record)
 {
   struct file_header hdr;
   coffee_page_t page;
+#if COFFEE_RING_FILES
+  uint16_t tail, seq, used;
+#endif
 
   memcpy(&page, dir->dummy_space, sizeof(coffee_page_t));
 
@@ -1266,6 +2523,11 @@ cfs_readdir(struct cfs_dir *dir, struct cfs_dirent *record)
       coffee_page_t next_page;
       memcpy(record->name, hdr.name, sizeof(record->name));
       record->name[sizeof(record->name) - 1] = '\0';
+#if COFFEE_RING_FILES
+      if(HDR_RING(hdr)) {
+        record->size = ring_scan(page, hdr.max_pages, &tail, &seq, &used);
+      } else
+#endif
       record->size = file_end(page);
 
       next_page = next_file(page, &hdr);
@@ -1291,6 +2553,24 @@ cfs_coffee_reserve(const char *name, cfs_offset_t size)
 }
 /*---------------------------------------------------------------------------*/
 int
+cfs_coffee_reserve_ring(const char *name, cfs_offset_t size)
+{
+#if COFFEE_RING_FILES
+  coffee_page_t sectors;
+
+  /* One sector is being refilled after the oldest data is discarded. */
+  sectors = (size + RING_DATA_SIZE - 1) / RING_DATA_SIZE + 1;
+  if(sectors < 2) {
+    sectors = 2;
+  }
+  return reserve(name, sectors * COFFEE_PAGES_PER_SECTOR, 0,
+                 HDR_FLAG_RING) == NULL ? -1 : 0;
+#else
+  return -1;
+#endif
+}
+/*---------------------------------------------------------------------------*/
+int
 cfs_coffee_configure_log(const char *filename, unsigned log_size,
 			 unsigned log_record_size)
 {
@@ -1307,11 +2587,18 @@ cfs_coffee_configure_log(const char *filename, unsigned log_size,
     return -1;
   }
 
-  read_header(&hdr, file->page);
-  if(HDR_MODIFIED(hdr)) {
+#if COFFEE_LOG_COALESCE_TIME
+  if(FILE_BUFFERED(file)) {
     /* Too late to customize the log. */
     return -1;
   }
+#endif
+
+  read_header(&hdr, file->page);
+  if(HDR_MODIFIED(hdr) || HDR_RING(hdr)) {
+    /* Too late to customize the log, or the file does not have one. */
+    return -1;
+  }
 
   hdr.log_records = log_size / log_record_size;
   hdr.log_record_size = log_record_size;
@@ -1320,6 +2607,14 @@ cfs_coffee_configure_log(const char *filename, unsigned log_size,
   return 0;
 }
 /*---------------------------------------------------------------------------*/
+void
+cfs_coffee_flush(void)
+{
+#if COFFEE_LOG_COALESCE_TIME
+  flush_log_buffer();
+#endif
+}
+/*---------------------------------------------------------------------------*/
 #if COFFEE_IO_SEMANTICS
 int
 cfs_coffee_set_io_semantics(int fd, unsigned flags)
@@ -1341,21 +2636,113 @@ cfs_coffee_format(void)
 
   PRINTF("Coffee: Formatting %u sectors", COFFEE_SECTOR_COUNT);
 
+#if COFFEE_LOG_COALESCE_TIME
+  ctimer_stop(&log_buffer.timer);
+  log_buffer.fd = -1;
+#endif
+
   *next_free = 0;
 
   for(i = 0; i < COFFEE_SECTOR_COUNT; i++) {
-    COFFEE_ERASE(i);
+    erase_sector(i);
     PRINTF(".");
   }
 
   /* Formatting invalidates the file information. */
   memset(&protected_mem, 0, sizeof(protected_mem));
+#if COFFEE_RAM_INDEX
+  /* An empty index describes the erased storage. */
+  coffee_index->flags = INDEX_VALID;
+#endif
 
   PRINTF(" done!\n");
 
   return 0;
 }
 /*---------------------------------------------------------------------------*/
+void
+cfs_coffee_stats(struct cfs_coffee_stats *stats)
+{
+#if COFFEE_ERASE_COUNTERS
+  uint16_t i;
+#endif
+
+#if COFFEE_STATS
+  memcpy(stats, &coffee_stats, sizeof(*stats));
+#else
+  memset(stats, 0, sizeof(*stats));
+#endif
+
+#if COFFEE_ERASE_COUNTERS
+  load_erase_counters();
+  stats->min_sector_erases = stats->max_sector_erases =
+    erase_counters->count[0];
+  for(i = 1; i < COFFEE_SECTOR_COUNT; i++) {
+    if(erase_counters->count[i] < stats->min_sector_erases) {
+      stats->min_sector_erases = erase_counters->count[i];
+    }
+    if(erase_counters->count[i] > stats->max_sector_erases) {
+      stats->max_sector_erases = erase_counters->count[i];
+    }
+  }
+#endif
+}
+/*---------------------------------------------------------------------------*/
+#if COFFEE_LOG_COMPACTION
+static struct file *
+find_compaction_candidate(void)
+{
+  struct file_header hdr;
+  struct file *file;
+  uint16_t log_record_size, log_records;
+  int i;
+
+  for(i = 0; i < COFFEE_MAX_OPEN_FILES; i++) {
+    file = &coffee_files[i];
+    if(FILE_FREE(file) || !FILE_MODIFIED(file) || file->record_count < 0) {
+      continue;
+    }
+    read_header(&hdr, file->page);
+    adjust_log_config(&hdr, &log_record_size, &log_records);
+    if((uint32_t)file->record_count * 100 >=
+       (uint32_t)log_records * COFFEE_LOG_COMPACTION_THRESHOLD) {
+      return file;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(coffee_compaction_process, ev, data)
+{
+  static struct etimer et;
+  struct file *file;
+
+  PROCESS_BEGIN();
+
+  etimer_set(&et, COFFEE_LOG_COMPACTION_INTERVAL);
+  for(;;) {
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&et));
+    etimer_reset(&et);
+
+    /*
+     * A merge cannot be interrupted, because the old and the new file
+     * extents are both active until it completes. Other processes get
+     * to run between the merges of different files instead.
+     */
+    while((file = find_compaction_candidate()) != NULL) {
+      PRINTF("Coffee: Compacting the log of the file at page %u\n",
+             (unsigned)file->page);
+      if(merge_log(file->page, 0) < 0) {
+        break;
+      }
+      PROCESS_PAUSE();
+    }
+  }
+
+  PROCESS_END();
+}
+#endif /* COFFEE_LOG_COMPACTION */
+/*---------------------------------------------------------------------------*/
 void *
 cfs_coffee_get_protected_mem(unsigned *size)
 {
@@ -63,6 +63,22 @@
  */
 #define CFS_COFFEE_IO_FIRM_SIZE		0x2
 
+/**
+ * Statistics about the storage operations of Coffee, as reported by
+ * cfs_coffee_stats(). The garbage collection times are in clock ticks.
+ */
+struct cfs_coffee_stats {
+  unsigned long reads;		/* Flash read operations. */
+  unsigned long writes;		/* Flash write operations. */
+  unsigned long erases;		/* Sector erasures. */
+  unsigned long merges;		/* Files merged with their micro logs. */
+  unsigned long gc_runs;	/* Garbage collector runs. */
+  unsigned long gc_time;	/* Total time spent collecting garbage. */
+  unsigned long gc_max_time;	/* Longest garbage collection pause. */
+  unsigned long min_sector_erases; /* Erase count of the least worn sector. */
+  unsigned long max_sector_erases; /* Erase count of the most worn sector. */
+};
+
 /**
  * \file
  *	Header for the Coffee file system.
@@ -86,6 +102,20 @@
  */
 int cfs_coffee_reserve(const char *name, cfs_offset_t size);
 
+/**
+ * \brief Reserve space for a ring file.
+ * \param name The filename.
+ * \param size The amount of data that the file should keep.
+ * \return 0 on success, -1 on failure.
+ *
+ * A ring file has a fixed size and is written to by appending data.
+ * When the file is full, the oldest sector of data is discarded to
+ * make room for new data, and reads start from the oldest data that
+ * remains. Ring files occupy whole flash sectors. They are available
+ * if Coffee is configured with COFFEE_RING_FILES.
+ */
+int cfs_coffee_reserve_ring(const char *name, cfs_offset_t size);
+
 /**
  * \brief Configure the on-demand log file.
  * \param file The filename.
@@ -101,6 +131,15 @@ int cfs_coffee_reserve(const char *name, cfs_offset_t size);
 int cfs_coffee_configure_log(const char *file, unsigned log_size,
                              unsigned log_entry_size);
 
+/**
+ * \brief Write out buffered file modifications.
+ *
+ * When Coffee is configured to coalesce micro log writes, modifications
+ * of a file may be held in RAM for a short time. This function writes
+ * them to the storage immediately, for instance before a reboot.
+ */
+void cfs_coffee_flush(void);
+
 /**
  * \brief Set the I/O semantics for accessing a file.
  *
@@ -126,6 +165,18 @@ int cfs_coffee_set_io_semantics(int fd, unsigned flags);
  */
 int cfs_coffee_format(void);
 
+/**
+ * \brief Get statistics about the storage operations of Coffee.
+ * \param stats A pointer to the structure that receives the statistics.
+ *
+ * The operation counters are available if Coffee is configured with
+ * COFFEE_STATS and count from the start of the system. The sector
+ * erase counts are available if Coffee is configured with
+ * COFFEE_ERASE_COUNTERS, and are kept in the storage. Statistics that
+ * are not available are reported as zero.
+ */
+void cfs_coffee_stats(struct cfs_coffee_stats *stats);
+
 /**
  * \brief Points out a memory region that may not be altered during
  * checkpointing operations that use the file system.
@@ -0,0 +1,88 @@
+/**
+ * \file
+ *         Delay clock and RDC timestamps for MAC delay sampling.
+ */
+
+#include "contiki.h"
+#include "net/delay.h"
+
+struct delay_rdc_times delay_rdc;
+
+static uint32_t last_now;
+static clock_time_t last_clock;
+
+/*---------------------------------------------------------------------------*/
+uint32_t
+delay_clock_now(void)
+{
+  rtimer_clock_t now;
+  clock_time_t c, dc;
+  uint32_t wrap, estimate, t;
+
+  now = RTIMER_NOW();
+  if(sizeof(rtimer_clock_t) >= sizeof(uint32_t)) {
+    return (uint32_t)now;
+  }
+
+  /* Estimate the elapsed time with the coarse clock, which is enough to
+     tell how many times the rtimer has wrapped since the last call, and
+     take the low bits from the rtimer. This holds as long as the clock
+     is read at least once per clock_time() period. */
+  wrap = (uint32_t)(rtimer_clock_t)~0 + 1;
+  c = clock_time();
+  dc = c - last_clock;
+  estimate = last_now + (uint32_t)(dc / CLOCK_SECOND) * DELAY_CLOCK_SECOND +
+    ((uint32_t)(dc % CLOCK_SECOND) * DELAY_CLOCK_SECOND) / CLOCK_SECOND;
+
+  t = (estimate & ~(wrap - 1)) | now;
+  if((int32_t)(t - estimate) > (int32_t)(wrap / 2)) {
+    t -= wrap;
+  } else if((int32_t)(estimate - t) > (int32_t)(wrap / 2)) {
+    t += wrap;
+  }
+  if((int32_t)(t - last_now) < 0) {
+    t = last_now;
+  }
+
+  last_now = t;
+  last_clock = c;
+  return t;
+}
+/*---------------------------------------------------------------------------*/
+uint32_t
+delay_clock_to_ms(uint32_t ticks)
+{
+  return (ticks / DELAY_CLOCK_SECOND) * 1000 +
+    ((ticks % DELAY_CLOCK_SECOND) * 1000) / DELAY_CLOCK_SECOND;
+}
+/*---------------------------------------------------------------------------*/
+void
+delay_rdc_start(void)
+{
+  delay_rdc.start = delay_clock_now();
+  delay_rdc.tx = delay_rdc.start;
+  delay_rdc.seqno = packetbuf_attr(PACKETBUF_ATTR_MAC_SEQNO);
+  delay_rdc.acked = 0;
+}
+/*---------------------------------------------------------------------------*/
+/* Extend an rtimer reading taken less than one rtimer period after
+   delay_rdc_start(), whose low bits are those of the rtimer. */
+static uint32_t
+extend_rdc_time(rtimer_clock_t t)
+{
+  return delay_rdc.start + (rtimer_clock_t)(t - (rtimer_clock_t)delay_rdc.start);
+}
+/*---------------------------------------------------------------------------*/
+void
+delay_rdc_tx(rtimer_clock_t t)
+{
+  delay_rdc.tx = extend_rdc_time(t);
+}
+/*---------------------------------------------------------------------------*/
+void
+delay_rdc_ack(rtimer_clock_t t)
+{
+  delay_rdc.ack = extend_rdc_time(t);
+  delay_rdc.acked = 1;
+}
+/*---------------------------------------------------------------------------*/
@@ -1,28 +1,57 @@
-
-
 #ifndef DELAY_H
 #define DELAY_H
 
 #include <stdio.h>
 #include "net/packetbuf.h"
 #include "net/queuebuf.h"
-
-//void time_memb_init();
-//void neighbor_info_send_mac (rimeaddr_t *dest) ;
+#include "sys/rtimer.h"
 
 #define MAX_DELAY 3000
 typedef uint32_t delay_t;
 
-/* Structure used to record times for delay computing */
-struct time_queue {
-	struct time_queue *next;
-	rimeaddr_t dest;
-	uint32_t before_mac;
+/*
+ * Delay clock: RTIMER_NOW() extended to 32 bits. Wraps of a 16-bit
+ * rtimer are tracked with the help of clock_time(), so the clock stays
+ * monotonic even if it is not read for longer than an rtimer period.
+ */
+#define DELAY_CLOCK_SECOND RTIMER_SECOND
+
+uint32_t delay_clock_now(void);
+uint32_t delay_clock_to_ms(uint32_t ticks);
+
+/*
+ * Components of the MAC delay of one frame, in delay clock ticks:
+ * queueing from the network layer hand-off to the start of the RDC
+ * transmission (including MAC retransmissions), channel access from
+ * there to the start of the acknowledged transmission (CCA and
+ * strobing), and the round trip from that transmission to the ACK.
+ */
+struct delay_sample {
+  uint32_t queueing;
+  uint32_t channel_access;
+  uint32_t ack_rtt;
 };
 
-#define MAX_QUEUED_PACKETS QUEUEBUF_NUM
+/* Timestamps of the last unicast frame handled by the RDC layer. */
+struct delay_rdc_times {
+  uint32_t start;
+  uint32_t tx;
+  uint32_t ack;
+  uint8_t seqno;
+  uint8_t acked;
+};
 
-uint32_t before_trans;
-uint32_t after_ack;
+extern struct delay_rdc_times delay_rdc;
+
+/*
+ * Called by the RDC driver for the frame in packetbuf. The start of the
+ * acknowledged transmission and the reception of its ACK are given as
+ * RTIMER_NOW() readings, so that the driver only reads the rtimer while
+ * strobing, and are extended to the delay clock when the driver reports
+ * them after the transmission.
+ */
+void delay_rdc_start(void);
+void delay_rdc_tx(rtimer_clock_t t);
+void delay_rdc_ack(rtimer_clock_t t);
 
 #endif /* DELAY_H */
@@ -55,9 +55,7 @@
 #include "sys/rtimer.h"
 #if CONTIKI_DELAY
 #include "net/delay.h"
-extern unsigned long before_trans;
-extern unsigned long after_ack;
-#endif
+#endif /* CONTIKI_DELAY */
 
 #include <string.h>
 
@@ -123,6 +121,69 @@ struct hdr {
 #define SYNC_CYCLE_STARTS                    1
 #endif
 
+/* With an adaptive check rate, a node checks the channel up to
+   2^MAX_CYCLE_SHIFT times more often than NETSTACK_RDC_CHANNEL_CHECK_RATE
+   when it has a lot of unicast traffic to receive or forward. The
+   current cycle time, CYCLE_TIME >> cycle_shift, is advertised in the
+   ContikiMAC header and kept by the neighbors in the phase module, so
+   that they strobe for the cycle time of the receiver. All nodes of a
+   network must use the same setting. The rate is changed at most every
+   CHECK_RATE_INTERVAL, when more than CHECK_RATE_UP_THRESHOLD or less
+   than CHECK_RATE_DOWN_THRESHOLD unicast packets were sent or received
+   during the interval. */
+#ifdef CONTIKIMAC_CONF_WITH_ADAPTIVE_CHECK_RATE
+#define WITH_ADAPTIVE_CHECK_RATE     CONTIKIMAC_CONF_WITH_ADAPTIVE_CHECK_RATE
+#else
+#define WITH_ADAPTIVE_CHECK_RATE     0
+#endif
+
+/* The phases of neighbors are needed to follow their check rates, and
+   the cycle starts must not be synchronized to whole seconds. */
+#if !WITH_PHASE_OPTIMIZATION || !WITH_CONTIKIMAC_HEADER || SYNC_CYCLE_STARTS
+#undef WITH_ADAPTIVE_CHECK_RATE
+#define WITH_ADAPTIVE_CHECK_RATE     0
+#endif
+
+#if WITH_ADAPTIVE_CHECK_RATE
+#ifdef CONTIKIMAC_CONF_MAX_CYCLE_SHIFT
+#define MAX_CYCLE_SHIFT              CONTIKIMAC_CONF_MAX_CYCLE_SHIFT
+#else
+#define MAX_CYCLE_SHIFT              2
+#endif
+
+#ifdef CONTIKIMAC_CONF_CHECK_RATE_INTERVAL
+#define CHECK_RATE_INTERVAL          CONTIKIMAC_CONF_CHECK_RATE_INTERVAL
+#else
+#define CHECK_RATE_INTERVAL          (16 * CLOCK_SECOND)
+#endif
+
+#ifdef CONTIKIMAC_CONF_CHECK_RATE_UP_THRESHOLD
+#define CHECK_RATE_UP_THRESHOLD      CONTIKIMAC_CONF_CHECK_RATE_UP_THRESHOLD
+#else
+#define CHECK_RATE_UP_THRESHOLD      16
+#endif
+
+#ifdef CONTIKIMAC_CONF_CHECK_RATE_DOWN_THRESHOLD
+#define CHECK_RATE_DOWN_THRESHOLD    CONTIKIMAC_CONF_CHECK_RATE_DOWN_THRESHOLD
+#else
+#define CHECK_RATE_DOWN_THRESHOLD    4
+#endif
+
+/* The cycle shift is carried in the low bits of the header id. */
+#define CYCLE_SHIFT_MASK             0x07
+#if MAX_CYCLE_SHIFT > CYCLE_SHIFT_MASK
+#error "CONTIKIMAC_CONF_MAX_CYCLE_SHIFT is too large"
+#endif
+
+static volatile uint8_t cycle_shift, target_cycle_shift;
+static volatile rtimer_clock_t cycle_time = CYCLE_TIME;
+static uint16_t unicast_traffic;
+static struct ctimer check_rate_timer;
+#define CURRENT_CYCLE_TIME           cycle_time
+#else /* WITH_ADAPTIVE_CHECK_RATE */
+#define CURRENT_CYCLE_TIME           CYCLE_TIME
+#endif /* WITH_ADAPTIVE_CHECK_RATE */
+
 /* Are we currently receiving a burst? */
 static int we_are_receiving_burst = 0;
 
@@ -217,6 +278,12 @@ static int we_are_receiving_burst = 0;
    to a neighbor for which we have a phase lock. */
 #define MAX_PHASE_STROBE_TIME              RTIMER_ARCH_SECOND / 60
 
+/* MIN_PHASE_STROBE_TIME is the shortest such time, for a neighbor that
+   always wakes up when expected. The time is widened by
+   PHASE_ERROR_FACTOR times the average wake-up error of the neighbor. */
+#define MIN_PHASE_STROBE_TIME              (2 * (GUARD_TIME))
+#define PHASE_ERROR_FACTOR                 4
+
 
 /* SHORTEST_PACKET_SIZE is the shortest packet that ContikiMAC
    allows. Packets have to be a certain size to be able to be detected
@@ -407,6 +474,24 @@ powercycle(struct rtimer *t, void *ptr)
       cycle_start = sync_cycle_start + (sync_cycle_phase*RTIMER_ARCH_SECOND)/NETSTACK_RDC_CHANNEL_CHECK_RATE;
 #endif
     }
+#elif WITH_ADAPTIVE_CHECK_RATE
+    {
+      /* The position of cycle_start within a cycle of the base check
+         rate, in units of the shortest cycle. A node slows down only
+         at the start of a base cycle, so that the phase its neighbors
+         have recorded stays valid. */
+      static uint8_t cycle_index;
+
+      cycle_start += cycle_time;
+      cycle_index = (cycle_index + (1 << (MAX_CYCLE_SHIFT - cycle_shift))) &
+        ((1 << MAX_CYCLE_SHIFT) - 1);
+      if(target_cycle_shift > cycle_shift ||
+         (target_cycle_shift < cycle_shift &&
+          (cycle_index & ((1 << (MAX_CYCLE_SHIFT - target_cycle_shift)) - 1)) == 0)) {
+        cycle_shift = target_cycle_shift;
+        cycle_time = CYCLE_TIME >> cycle_shift;
+      }
+    }
 #else
     cycle_start += CYCLE_TIME;
 #endif
@@ -492,7 +577,7 @@ powercycle(struct rtimer *t, void *ptr)
       }
     }
 
-    if(RTIMER_CLOCK_LT(RTIMER_NOW() - cycle_start, CYCLE_TIME - CHECK_TIME * 4)) {
+    if(RTIMER_CLOCK_LT(RTIMER_NOW() - cycle_start, CURRENT_CYCLE_TIME - CHECK_TIME * 4)) {
       /* Schedule the next powercycle interrupt, or sleep the mcu
 	 until then.  Sleeping will not exit from this interrupt, so
 	 ensure an occasional wake cycle or foreground processing will
@@ -500,14 +585,14 @@ powercycle(struct rtimer *t, void *ptr)
 #if RDC_CONF_MCU_SLEEP
       static uint8_t sleepcycle;
       if((sleepcycle++ < 16) && !we_are_sending && !radio_is_on) {
-        rtimer_arch_sleep(CYCLE_TIME - (RTIMER_NOW() - cycle_start));
+        rtimer_arch_sleep(CURRENT_CYCLE_TIME - (RTIMER_NOW() - cycle_start));
       } else {
         sleepcycle = 0;
-        schedule_powercycle_fixed(t, CYCLE_TIME + cycle_start);
+        schedule_powercycle_fixed(t, CURRENT_CYCLE_TIME + cycle_start);
         PT_YIELD(&pt);
       }
 #else
-      schedule_powercycle_fixed(t, CYCLE_TIME + cycle_start);
+      schedule_powercycle_fixed(t, CURRENT_CYCLE_TIME + cycle_start);
       PT_YIELD(&pt);
 #endif
     }
@@ -550,11 +635,19 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr,
   uint8_t is_broadcast = 0;
   uint8_t is_reliable = 0;
   uint8_t is_known_receiver = 0;
+  rtimer_clock_t phase_strobe_time = MAX_PHASE_STROBE_TIME;
+  rtimer_clock_t strobe_time = STROBE_TIME;
+#if WITH_PHASE_OPTIMIZATION
+  rtimer_clock_t receiver_cycle_time = CYCLE_TIME;
+#endif /* WITH_PHASE_OPTIMIZATION */
   uint8_t collisions;
   int transmit_len;
   int ret;
   uint8_t contikimac_was_on;
   uint8_t seqno;
+#if CONTIKI_DELAY
+  rtimer_clock_t ack_time = 0;
+#endif /* CONTIKI_DELAY */
 #if WITH_CONTIKIMAC_HEADER
   struct hdr *chdr;
 #endif /* WITH_CONTIKIMAC_HEADER */
@@ -611,7 +704,11 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr,
     return MAC_TX_ERR_FATAL;
   }
   chdr = packetbuf_hdrptr();
+#if WITH_ADAPTIVE_CHECK_RATE
+  chdr->id = CONTIKIMAC_ID | cycle_shift;
+#else /* WITH_ADAPTIVE_CHECK_RATE */
   chdr->id = CONTIKIMAC_ID;
+#endif /* WITH_ADAPTIVE_CHECK_RATE */
   chdr->len = hdrlen;
   
   /* Create the MAC header for the data packet. */
@@ -660,16 +757,31 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr,
   /* Remove the MAC-layer header since it will be recreated next time around. */
   packetbuf_hdr_remove(hdrlen);
 
+#if WITH_ADAPTIVE_CHECK_RATE
+  if(!is_broadcast) {
+    /* Broadcasts are strobed for a full base cycle, which covers all
+       neighbors; unicasts only for the cycle of the receiver. */
+    receiver_cycle_time = CYCLE_TIME >>
+      phase_cycle_shift(packetbuf_addr(PACKETBUF_ADDR_RECEIVER));
+    strobe_time = receiver_cycle_time + 2 * CHECK_TIME;
+  }
+#endif /* WITH_ADAPTIVE_CHECK_RATE */
+
   if(!is_broadcast && !is_receiver_awake) {
 #if WITH_PHASE_OPTIMIZATION
     ret = phase_wait(packetbuf_addr(PACKETBUF_ADDR_RECEIVER),
-                     CYCLE_TIME, GUARD_TIME,
+                     receiver_cycle_time, GUARD_TIME,
                      mac_callback, mac_callback_ptr, buf_list);
     if(ret == PHASE_DEFERRED) {
       return MAC_TX_DEFERRED;
     }
     if(ret != PHASE_UNKNOWN) {
       is_known_receiver = 1;
+      phase_strobe_time = MIN_PHASE_STROBE_TIME + PHASE_ERROR_FACTOR *
+        phase_error(packetbuf_addr(PACKETBUF_ADDR_RECEIVER));
+      if(phase_strobe_time > MAX_PHASE_STROBE_TIME) {
+        phase_strobe_time = MAX_PHASE_STROBE_TIME;
+      }
     }
 #endif /* WITH_PHASE_OPTIMIZATION */ 
   }
@@ -710,6 +822,12 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr,
   contikimac_was_on = contikimac_is_on;
   contikimac_is_on = 1;
 
+#if CONTIKI_DELAY
+  if(!is_broadcast) {
+    delay_rdc_start();
+  }
+#endif /* CONTIKI_DELAY */
+
 #if !RDC_CONF_HARDWARE_CSMA
     /* Check if there are any transmissions by others. */
     /* TODO: why does this give collisions before sending with the mc1322x? */
@@ -755,12 +873,12 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr,
   seqno = packetbuf_attr(PACKETBUF_ATTR_MAC_SEQNO);
   for(strobes = 0, collisions = 0;
       got_strobe_ack == 0 && collisions == 0 &&
-      RTIMER_CLOCK_LT(RTIMER_NOW(), t0 + STROBE_TIME); strobes++) {
+      RTIMER_CLOCK_LT(RTIMER_NOW(), t0 + strobe_time); strobes++) {
 
     watchdog_periodic();
 
     if(!is_broadcast && (is_receiver_awake || is_known_receiver) &&
-       !RTIMER_CLOCK_LT(RTIMER_NOW(), t0 + MAX_PHASE_STROBE_TIME)) {
+       !RTIMER_CLOCK_LT(RTIMER_NOW(), t0 + phase_strobe_time)) {
       PRINTF("miss to %d\n", packetbuf_addr(PACKETBUF_ADDR_RECEIVER)->u8[0]);
       break;
     }
@@ -771,9 +889,6 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr,
       rtimer_clock_t wt;
       rtimer_clock_t txtime;
       int ret;
-    #if CONTIKI_DELAY
-		  before_trans = (clock_time()*1000)/CLOCK_SECOND;
-	  #endif /* CONTIKI_DELAY */
       txtime = RTIMER_NOW();
       ret = NETSTACK_RADIO.transmit(transmit_len);
 
@@ -783,6 +898,9 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr,
       if(ret == RADIO_TX_OK) {
         if(!is_broadcast) {
           got_strobe_ack = 1;
+#if CONTIKI_DELAY
+          ack_time = RTIMER_NOW();
+#endif /* CONTIKI_DELAY */
           encounter_time = txtime;
           break;
         }
@@ -808,9 +926,9 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr,
         len = NETSTACK_RADIO.read(ackbuf, ACK_LEN);
         if(len == ACK_LEN && seqno == ackbuf[ACK_LEN - 1]) {
           got_strobe_ack = 1;
-          #if CONTIKI_DELAY
-			  after_ack = (clock_time()*1000)/CLOCK_SECOND;
-		  #endif /* CONTIKI_DELAY */
+#if CONTIKI_DELAY
+          ack_time = RTIMER_NOW();
+#endif /* CONTIKI_DELAY */
           encounter_time = txtime;
           break;
         } else {
@@ -824,6 +942,13 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr,
 
   off();
 
+#if CONTIKI_DELAY
+  if(got_strobe_ack) {
+    delay_rdc_tx(encounter_time);
+    delay_rdc_ack(ack_time);
+  }
+#endif /* CONTIKI_DELAY */
+
   PRINTF("contikimac: send (strobes=%u, len=%u, %s, %s), done\n", strobes,
          packetbuf_totlen(),
          got_strobe_ack ? "ack" : "no ack",
@@ -858,6 +983,12 @@ send_packet(mac_callback_t mac_callback, void *mac_callback_ptr,
     ret = MAC_TX_OK;
   }
 
+#if WITH_ADAPTIVE_CHECK_RATE
+  if(!is_broadcast && ret == MAC_TX_OK) {
+    unicast_traffic++;
+  }
+#endif /* WITH_ADAPTIVE_CHECK_RATE */
+
 #if WITH_PHASE_OPTIMIZATION
   if(is_known_receiver && got_strobe_ack) {
     PRINTF("no miss %d wake-ups %d\n",
@@ -898,8 +1029,8 @@ qsend_list(mac_callback_t sent, void *ptr, struct rdc_buf_list *buf_list)
   }
   /* Do not send during reception of a burst */
   if(we_are_receiving_burst) {
-    /* Prepare the packetbuf for callback */
-    queuebuf_to_packetbuf(curr->buf);
+    /* Prepare the packetbuf attributes for callback */
+    queuebuf_attr_to_packetbuf(curr->buf);
     /* Return COLLISION so the MAC may try again later */
     mac_call_sent_callback(sent, ptr, MAC_TX_COLLISION, 1);
     return;
@@ -963,7 +1094,11 @@ input_packet(void)
 #if WITH_CONTIKIMAC_HEADER
     struct hdr *chdr;
     chdr = packetbuf_dataptr();
+#if WITH_ADAPTIVE_CHECK_RATE
+    if((chdr->id & ~CYCLE_SHIFT_MASK) != CONTIKIMAC_ID) {
+#else /* WITH_ADAPTIVE_CHECK_RATE */
     if(chdr->id != CONTIKIMAC_ID) {
+#endif /* WITH_ADAPTIVE_CHECK_RATE */
       PRINTF("contikimac: failed to parse hdr (%u)\n", packetbuf_totlen());
       return;
     }
@@ -1028,6 +1163,15 @@ input_packet(void)
       compower_clear(&current_packet);
 #endif /* CONTIKIMAC_CONF_COMPOWER */
 
+#if WITH_ADAPTIVE_CHECK_RATE
+      phase_set_cycle_shift(packetbuf_addr(PACKETBUF_ADDR_SENDER),
+                            chdr->id & CYCLE_SHIFT_MASK);
+      if(!rimeaddr_cmp(packetbuf_addr(PACKETBUF_ADDR_RECEIVER),
+                       &rimeaddr_null)) {
+        unicast_traffic++;
+      }
+#endif /* WITH_ADAPTIVE_CHECK_RATE */
+
       PRINTDEBUG("contikimac: data (%u)\n", packetbuf_datalen());
       NETSTACK_MAC.input();
       return;
@@ -1039,6 +1183,25 @@ input_packet(void)
   }
 }
 /*---------------------------------------------------------------------------*/
+#if WITH_ADAPTIVE_CHECK_RATE
+static void
+update_check_rate(void *ptr)
+{
+  /* The new rate is applied by powercycle() at the start of a cycle. */
+  if(unicast_traffic > CHECK_RATE_UP_THRESHOLD &&
+     target_cycle_shift < MAX_CYCLE_SHIFT) {
+    target_cycle_shift++;
+  } else if(unicast_traffic < CHECK_RATE_DOWN_THRESHOLD &&
+            target_cycle_shift > 0) {
+    target_cycle_shift--;
+  }
+  PRINTF("contikimac: %u unicasts, cycle shift %u\n",
+         unicast_traffic, target_cycle_shift);
+  unicast_traffic = 0;
+  ctimer_set(&check_rate_timer, CHECK_RATE_INTERVAL, update_check_rate, NULL);
+}
+#endif /* WITH_ADAPTIVE_CHECK_RATE */
+/*---------------------------------------------------------------------------*/
 static void
 init(void)
 {
@@ -1051,9 +1214,13 @@ init(void)
   contikimac_is_on = 1;
 
 #if WITH_PHASE_OPTIMIZATION
-  phase_init();
+  phase_init(CYCLE_TIME);
 #endif /* WITH_PHASE_OPTIMIZATION */
 
+#if WITH_ADAPTIVE_CHECK_RATE
+  ctimer_set(&check_rate_timer, CHECK_RATE_INTERVAL, update_check_rate, NULL);
+#endif /* WITH_ADAPTIVE_CHECK_RATE */
+
 }
 /*---------------------------------------------------------------------------*/
 static int
@@ -1085,7 +1252,7 @@ turn_off(int keep_radio_on)
 static unsigned short
 duty_cycle(void)
 {
-  return (1ul * CLOCK_SECOND * CYCLE_TIME) / RTIMER_ARCH_SECOND;
+  return (1ul * CLOCK_SECOND * CURRENT_CYCLE_TIME) / RTIMER_ARCH_SECOND;
 }
 /*---------------------------------------------------------------------------*/
 const struct rdc_driver contikimac_driver = {
@@ -83,36 +83,105 @@ struct qbuf_metadata {
   uint8_t max_transmissions;
 };
 
+/* The maximum number of co-existing neighbor queues */
+#ifdef CSMA_CONF_MAX_NEIGHBOR_QUEUES
+#define CSMA_MAX_NEIGHBOR_QUEUES CSMA_CONF_MAX_NEIGHBOR_QUEUES
+#else
+#define CSMA_MAX_NEIGHBOR_QUEUES 2
+#endif /* CSMA_CONF_MAX_NEIGHBOR_QUEUES */
+
+/* The maximum number of packets handed to the RDC layer in one burst,
+   0 for all the packets queued for the neighbor */
+#ifdef CSMA_CONF_MAX_BURST
+#define CSMA_MAX_BURST CSMA_CONF_MAX_BURST
+#else
+#define CSMA_MAX_BURST 0
+#endif /* CSMA_CONF_MAX_BURST */
+
+/* When set, a neighbor that still has packets queued after a burst
+   lets the neighbors that have been waiting for their turn send
+   first */
+#ifdef CSMA_CONF_ROUND_ROBIN
+#define CSMA_ROUND_ROBIN CSMA_CONF_ROUND_ROBIN
+#else
+#define CSMA_ROUND_ROBIN 0
+#endif /* CSMA_CONF_ROUND_ROBIN */
+
+/* When set, the neighbor queues are found through a hash table of
+   CSMA_NEIGHBOR_HASH_SIZE buckets, a power of two, instead of a scan
+   of all of them */
+#ifdef CSMA_CONF_NEIGHBOR_HASH
+#define CSMA_NEIGHBOR_HASH CSMA_CONF_NEIGHBOR_HASH
+#else
+#define CSMA_NEIGHBOR_HASH 0
+#endif /* CSMA_CONF_NEIGHBOR_HASH */
+
+#ifdef CSMA_CONF_NEIGHBOR_HASH_SIZE
+#define CSMA_NEIGHBOR_HASH_SIZE CSMA_CONF_NEIGHBOR_HASH_SIZE
+#else
+#define CSMA_NEIGHBOR_HASH_SIZE 8
+#endif /* CSMA_CONF_NEIGHBOR_HASH_SIZE */
+
 /* Every neighbor has its own packet queue */
 struct neighbor_queue {
   struct neighbor_queue *next;
+#if CSMA_NEIGHBOR_HASH
+  struct neighbor_queue *hash_next;
+#endif /* CSMA_NEIGHBOR_HASH */
   rimeaddr_t addr;
   struct ctimer transmit_timer;
   uint8_t transmissions;
   uint8_t collisions, deferrals;
+#if CSMA_ROUND_ROBIN
+  /* Set while the neighbor waits for its turn to send its next burst */
+  uint8_t waiting;
+#endif /* CSMA_ROUND_ROBIN */
+  /* The packets handed to the RDC layer in the current burst, and the
+     ones queued after them */
+  LIST_STRUCT(burst_list);
   LIST_STRUCT(queued_packet_list);
 };
 
-/* The maximum number of co-existing neighbor queues */
-#ifdef CSMA_CONF_MAX_NEIGHBOR_QUEUES
-#define CSMA_MAX_NEIGHBOR_QUEUES CSMA_CONF_MAX_NEIGHBOR_QUEUES
-#else
-#define CSMA_MAX_NEIGHBOR_QUEUES 2
-#endif /* CSMA_CONF_MAX_NEIGHBOR_QUEUES */
-
 #define MAX_QUEUED_PACKETS QUEUEBUF_NUM
 MEMB(neighbor_memb, struct neighbor_queue, CSMA_MAX_NEIGHBOR_QUEUES);
 MEMB(packet_memb, struct rdc_buf_list, MAX_QUEUED_PACKETS);
 MEMB(metadata_memb, struct qbuf_metadata, MAX_QUEUED_PACKETS);
 LIST(neighbor_list);
+#if CSMA_NEIGHBOR_HASH
+static struct neighbor_queue *neighbor_hash[CSMA_NEIGHBOR_HASH_SIZE];
+#endif /* CSMA_NEIGHBOR_HASH */
 
 static void packet_sent(void *ptr, int status, int num_transmissions);
 static void transmit_packet_list(void *ptr);
 
+/*---------------------------------------------------------------------------*/
+#if CSMA_NEIGHBOR_HASH
+static struct neighbor_queue **
+hash_head(const rimeaddr_t *addr)
+{
+  uint16_t h;
+  int i;
+
+  h = 0;
+  for(i = 0; i < RIMEADDR_SIZE; i++) {
+    h = (h << 5) + h + addr->u8[i];
+  }
+  return &neighbor_hash[h & (CSMA_NEIGHBOR_HASH_SIZE - 1)];
+}
+#endif /* CSMA_NEIGHBOR_HASH */
 /*---------------------------------------------------------------------------*/
 static struct neighbor_queue *
 neighbor_queue_from_addr(const rimeaddr_t *addr)
 {
+#if CSMA_NEIGHBOR_HASH
+  struct neighbor_queue *n = *hash_head(addr);
+  while(n != NULL) {
+    if(rimeaddr_cmp(&n->addr, addr)) {
+      return n;
+    }
+    n = n->hash_next;
+  }
+#else /* CSMA_NEIGHBOR_HASH */
   struct neighbor_queue *n = list_head(neighbor_list);
   while(n != NULL) {
     if(rimeaddr_cmp(&n->addr, addr)) {
@@ -120,6 +189,7 @@ neighbor_queue_from_addr(const rimeaddr_t *addr)
     }
     n = list_item_next(n);
   }
+#endif /* CSMA_NEIGHBOR_HASH */
   return NULL;
 }
 /*---------------------------------------------------------------------------*/
@@ -140,46 +210,117 @@ default_timebase(void)
   return time;
 }
 /*---------------------------------------------------------------------------*/
+#if CSMA_ROUND_ROBIN
+/* Let the neighbor that has been waiting the longest send its next
+   burst. The neighbors that wait are kept at the end of the list, in
+   the order they started to wait. */
+static void
+next_turn(void)
+{
+  struct neighbor_queue *n;
+
+  for(n = list_head(neighbor_list); n != NULL; n = list_item_next(n)) {
+    if(n->waiting) {
+      n->waiting = 0;
+      ctimer_set(&n->transmit_timer, 0, transmit_packet_list, n);
+      return;
+    }
+  }
+}
+#endif /* CSMA_ROUND_ROBIN */
+/*---------------------------------------------------------------------------*/
 static void
 transmit_packet_list(void *ptr)
 {
   struct neighbor_queue *n = ptr;
   if(n) {
-    struct rdc_buf_list *q = list_head(n->queued_packet_list);
+    struct rdc_buf_list *q;
+    int len;
+
+    if(list_head(n->burst_list) == NULL) {
+      /* Start a new burst with the packets at the head of the queue */
+      for(len = 0; CSMA_MAX_BURST == 0 || len < CSMA_MAX_BURST; len++) {
+        q = list_pop(n->queued_packet_list);
+        if(q == NULL) {
+          break;
+        }
+        list_add(n->burst_list, q);
+      }
+    }
+    q = list_head(n->burst_list);
     if(q != NULL) {
-      PRINTF("csma: preparing number %d %p, queue len %d\n", n->transmissions, q,
+      PRINTF("csma: preparing number %d %p, burst len %d, queue len %d\n",
+          n->transmissions, q, list_length(n->burst_list),
           list_length(n->queued_packet_list));
-      /* Send packets in the neighbor's list */
+      /* Send the packets of the burst in one go */
       NETSTACK_RDC.send_list(packet_sent, n, q);
     }
   }
 }
 /*---------------------------------------------------------------------------*/
 static void
-free_packet(struct neighbor_queue *n, struct rdc_buf_list *p)
+free_neighbor(struct neighbor_queue *n)
+{
+  ctimer_stop(&n->transmit_timer);
+  list_remove(neighbor_list, n);
+#if CSMA_NEIGHBOR_HASH
+  {
+    struct neighbor_queue **p;
+
+    for(p = hash_head(&n->addr); *p != NULL; p = &(*p)->hash_next) {
+      if(*p == n) {
+        *p = n->hash_next;
+        break;
+      }
+    }
+  }
+#endif /* CSMA_NEIGHBOR_HASH */
+  memb_free(&neighbor_memb, n);
+}
+/*---------------------------------------------------------------------------*/
+static void
+free_packet(struct neighbor_queue *n, struct rdc_buf_list *p, int status)
 {
   if(p != NULL) {
     /* Remove packet from list and deallocate */
-    list_remove(n->queued_packet_list, p);
+    list_remove(n->burst_list, p);
 
     queuebuf_free(p->buf);
     memb_free(&metadata_memb, p->ptr);
     memb_free(&packet_memb, p);
-    PRINTF("csma: free_queued_packet, queue length %d\n",
-        list_length(n->queued_packet_list));
-    if(list_head(n->queued_packet_list) != NULL) {
+    PRINTF("csma: free_queued_packet, burst length %d, queue length %d\n",
+        list_length(n->burst_list), list_length(n->queued_packet_list));
+    if(list_head(n->burst_list) != NULL ||
+       list_head(n->queued_packet_list) != NULL) {
       /* There is a next packet. We reset current tx information */
       n->transmissions = 0;
       n->collisions = 0;
       n->deferrals = 0;
-      /* Set a timer for next transmissions */
-      ctimer_set(&n->transmit_timer, default_timebase(),
+#if CSMA_ROUND_ROBIN
+      if(list_head(n->burst_list) == NULL) {
+        /* The burst is over: wait for our next turn behind the
+           neighbors that are already waiting */
+        ctimer_stop(&n->transmit_timer);
+        n->waiting = 1;
+        list_remove(neighbor_list, n);
+        list_add(neighbor_list, n);
+        next_turn();
+        return;
+      }
+#endif /* CSMA_ROUND_ROBIN */
+      /* Set a timer for next transmissions. After a success, the next
+         packets are sent right away: if the RDC layer is still in the
+         burst, it continues it and the timer is set again or stopped
+         before it fires. */
+      ctimer_set(&n->transmit_timer,
+                 status == MAC_TX_OK ? 0 : default_timebase(),
                  transmit_packet_list, n);
     } else {
       /* This was the last packet in the queue, we free the neighbor */
-      ctimer_stop(&n->transmit_timer);
-      list_remove(neighbor_list, n);
-      memb_free(&neighbor_memb, n);
+      free_neighbor(n);
+#if CSMA_ROUND_ROBIN
+      next_turn();
+#endif /* CSMA_ROUND_ROBIN */
     }
   }
 }
@@ -213,7 +354,7 @@ packet_sent(void *ptr, int status, int num_transmissions)
     break;
   }
 
-  for(q = list_head(n->queued_packet_list);
+  for(q = list_head(n->burst_list);
       q != NULL; q = list_item_next(q)) {
     if(queuebuf_attr(q->buf, PACKETBUF_ATTR_MAC_SEQNO) ==
        packetbuf_attr(PACKETBUF_ATTR_MAC_SEQNO)) {
@@ -270,10 +411,14 @@ packet_sent(void *ptr, int status, int num_transmissions)
           /* This is needed to correctly attribute energy that we spent
              transmitting this packet. */
           queuebuf_update_attr_from_packetbuf(q->buf);
+#if CSMA_ROUND_ROBIN
+          /* Let a waiting neighbor send while we back off */
+          next_turn();
+#endif /* CSMA_ROUND_ROBIN */
         } else {
           PRINTF("csma: drop with status %d after %d transmissions, %d collisions\n",
                  status, n->transmissions, n->collisions);
-          free_packet(n, q);
+          free_packet(n, q, status);
           mac_call_sent_callback(sent, cptr, status, num_tx);
         }
       } else {
@@ -282,7 +427,7 @@ packet_sent(void *ptr, int status, int num_transmissions)
         } else {
           PRINTF("csma: rexmit failed %d: %d\n", n->transmissions, status);
         }
-        free_packet(n, q);
+        free_packet(n, q, status);
         mac_call_sent_callback(sent, cptr, status, num_tx);
       }
     }
@@ -315,10 +460,18 @@ send_packet(mac_callback_t sent, void *ptr)
       n->transmissions = 0;
       n->collisions = 0;
       n->deferrals = 0;
-      /* Init packet list for this neighbor */
+#if CSMA_ROUND_ROBIN
+      n->waiting = 0;
+#endif /* CSMA_ROUND_ROBIN */
+      /* Init packet lists for this neighbor */
+      LIST_STRUCT_INIT(n, burst_list);
       LIST_STRUCT_INIT(n, queued_packet_list);
       /* Add neighbor to the list */
       list_add(neighbor_list, n);
+#if CSMA_NEIGHBOR_HASH
+      n->hash_next = *hash_head(addr);
+      *hash_head(addr) = n;
+#endif /* CSMA_NEIGHBOR_HASH */
     }
   }
 
@@ -350,7 +503,8 @@ send_packet(mac_callback_t sent, void *ptr)
 	  }
 
 	  /* If q is the first packet in the neighbor's queue, send asap */
-	  if(list_head(n->queued_packet_list) == q) {
+	  if(list_head(n->burst_list) == NULL &&
+	     list_length(n->queued_packet_list) == 1) {
 	    ctimer_set(&n->transmit_timer, 0, transmit_packet_list, n);
 	  }
 	  return;
@@ -362,9 +516,9 @@ send_packet(mac_callback_t sent, void *ptr)
       PRINTF("csma: could not allocate queuebuf, dropping packet\n");
     }
     /* The packet allocation failed. Remove and free neighbor entry if empty. */
-    if(list_length(n->queued_packet_list) == 0) {
-      list_remove(neighbor_list, n);
-      memb_free(&neighbor_memb, n);
+    if(list_head(n->burst_list) == NULL &&
+       list_head(n->queued_packet_list) == NULL) {
+      free_neighbor(n);
     }
     PRINTF("csma: could not allocate packet, dropping packet\n");
   } else {
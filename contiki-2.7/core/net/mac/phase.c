@@ -44,17 +44,66 @@
 #include "net/queuebuf.h"
 #include "net/nbr-table.h"
 
-#if PHASE_CONF_DRIFT_CORRECT
+#ifdef PHASE_CONF_DRIFT_CORRECT
 #define PHASE_DRIFT_CORRECT PHASE_CONF_DRIFT_CORRECT
 #else
-#define PHASE_DRIFT_CORRECT 0
+#define PHASE_DRIFT_CORRECT 1
 #endif
 
+/* PHASE_MAX_AGE is the time after the last acknowledged transmission
+   after which a phase is considered too inaccurate to be used. Zero
+   disables aging. */
+#ifdef PHASE_CONF_MAX_AGE
+#define PHASE_MAX_AGE PHASE_CONF_MAX_AGE
+#else
+#define PHASE_MAX_AGE (5 * 60 * CLOCK_SECOND)
+#endif
+
+/* PHASE_PERSIST saves the drift and the wake-up error of each
+   neighbor to the file system, so that they are known right after a
+   reboot. */
+#ifdef PHASE_CONF_PERSIST
+#define PHASE_PERSIST PHASE_CONF_PERSIST
+#else
+#define PHASE_PERSIST 0
+#endif
+
+#ifdef PHASE_CONF_PERSIST_INTERVAL
+#define PHASE_PERSIST_INTERVAL PHASE_CONF_PERSIST_INTERVAL
+#else
+#define PHASE_PERSIST_INTERVAL (10 * 60 * CLOCK_SECOND)
+#endif
+
+#if PHASE_PERSIST
+#include "cfs/cfs.h"
+#define PHASE_FILE "phase"
+#endif /* PHASE_PERSIST */
+
+/* The drift is kept in rtimer ticks per DRIFT_PERIOD seconds. It is
+   re-estimated from the phase seen at an acknowledged transmission and
+   the one seen at an earlier reference transmission, at least
+   DRIFT_MIN_INTERVAL seconds before, when the error is small enough not
+   to be a phase change of the neighbor. The reference then moves to
+   the new transmission. It is kept apart from the phase itself, which
+   is updated by every acknowledged transmission. */
+#define DRIFT_PERIOD          1024
+#define DRIFT_MIN_INTERVAL    8
+
+/* The wake-up error is an exponentially weighted moving average with
+   a weight of 1/2^ERROR_SHIFT for new samples. */
+#define ERROR_SHIFT           2
+
 struct phase {
   rtimer_clock_t time;
+  clock_time_t updated;
 #if PHASE_DRIFT_CORRECT
-  rtimer_clock_t drift;
+  int32_t drift;
+  rtimer_clock_t drift_time;
+  clock_time_t drift_updated;
 #endif
+  rtimer_clock_t error;
+  uint8_t locked;
+  uint8_t cycle_shift;
   uint8_t noacks;
   struct timer noacks_timer;
 };
@@ -77,6 +126,23 @@ struct phase_queueitem {
 MEMB(queued_packets_memb, struct phase_queueitem, PHASE_QUEUESIZE);
 NBR_TABLE(struct phase, nbr_phase);
 
+struct phase_stats phase_stats;
+
+/* The base cycle time of the duty cycling protocol. */
+static rtimer_clock_t phase_cycle_time;
+
+#if PHASE_PERSIST
+struct phase_record {
+  rimeaddr_t addr;
+#if PHASE_DRIFT_CORRECT
+  int32_t drift;
+#endif
+  rtimer_clock_t error;
+};
+
+static struct ctimer persist_timer;
+#endif /* PHASE_PERSIST */
+
 #define DEBUG 0
 #if DEBUG
 #include <stdio.h>
@@ -87,6 +153,108 @@ NBR_TABLE(struct phase, nbr_phase);
 #define PRINTDEBUG(...)
 #endif
 /*---------------------------------------------------------------------------*/
+/* The phase of neighbor e at the time of the last update, moved by the
+   drift accumulated since then. */
+static rtimer_clock_t
+expected_phase(struct phase *e)
+{
+#if PHASE_DRIFT_CORRECT
+  int32_t elapsed;
+
+  elapsed = (clock_time_t)(clock_time() - e->updated) / CLOCK_SECOND;
+  return e->time + (rtimer_clock_t)(e->drift * elapsed / DRIFT_PERIOD);
+#else /* PHASE_DRIFT_CORRECT */
+  return e->time;
+#endif /* PHASE_DRIFT_CORRECT */
+}
+/*---------------------------------------------------------------------------*/
+/* The signed distance from the expected phase to the phase seen at
+   time, folded into half a cycle on either side. */
+static int32_t
+phase_offset(rtimer_clock_t time, rtimer_clock_t expected,
+             rtimer_clock_t cycle_time)
+{
+  int32_t offset;
+
+  offset = (rtimer_clock_t)(time - expected) % cycle_time;
+  if(offset > (int32_t)(cycle_time / 2)) {
+    offset -= (int32_t)cycle_time;
+  }
+  return offset;
+}
+/*---------------------------------------------------------------------------*/
+/* The cycle time of neighbor e, which may check the channel more often
+   than the base rate. */
+static rtimer_clock_t
+neighbor_cycle_time(struct phase *e)
+{
+  return phase_cycle_time >> e->cycle_shift;
+}
+/*---------------------------------------------------------------------------*/
+static int
+phase_expired(struct phase *e)
+{
+#if PHASE_MAX_AGE
+  return (clock_time_t)(clock_time() - e->updated) >= PHASE_MAX_AGE;
+#else
+  return 0;
+#endif
+}
+/*---------------------------------------------------------------------------*/
+#if PHASE_DRIFT_CORRECT
+static void
+drift_reference(struct phase *e, rtimer_clock_t time)
+{
+  e->drift_time = time;
+  e->drift_updated = clock_time();
+}
+#endif /* PHASE_DRIFT_CORRECT */
+/*---------------------------------------------------------------------------*/
+static void
+phase_lock(struct phase *e, rtimer_clock_t time)
+{
+  e->time = time;
+  e->updated = clock_time();
+  e->locked = 1;
+  e->noacks = 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+phase_sample(struct phase *e, rtimer_clock_t time)
+{
+  int32_t offset;
+  rtimer_clock_t error;
+
+  offset = phase_offset(time, expected_phase(e), neighbor_cycle_time(e));
+  error = offset < 0 ? -offset : offset;
+
+#if PHASE_DRIFT_CORRECT
+  {
+    int32_t elapsed, drift_offset;
+
+    /* The offset from the reference is what is left after the current
+       drift estimate, so it corrects the estimate rather than
+       replacing it. */
+    elapsed = (clock_time_t)(clock_time() - e->drift_updated) / CLOCK_SECOND;
+    if(elapsed >= DRIFT_MIN_INTERVAL) {
+      drift_offset = phase_offset(time, e->drift_time +
+                                  (rtimer_clock_t)(e->drift * elapsed /
+                                                   DRIFT_PERIOD),
+                                  neighbor_cycle_time(e));
+      if((drift_offset < 0 ? -drift_offset : drift_offset) <
+         (int32_t)(neighbor_cycle_time(e) / 4)) {
+        e->drift += drift_offset * DRIFT_PERIOD / elapsed / 2;
+      }
+      drift_reference(e, time);
+    }
+  }
+#endif /* PHASE_DRIFT_CORRECT */
+
+  e->error = e->error - (e->error >> ERROR_SHIFT) + (error >> ERROR_SHIFT);
+  phase_stats.error = phase_stats.error - (phase_stats.error >> ERROR_SHIFT) +
+    (error >> ERROR_SHIFT);
+}
+/*---------------------------------------------------------------------------*/
 void
 phase_update(const rimeaddr_t *neighbor, rtimer_clock_t time,
              int mac_status)
@@ -97,43 +265,127 @@ phase_update(const rimeaddr_t *neighbor, rtimer_clock_t time,
   e = nbr_table_get_from_lladdr(nbr_phase, neighbor);
   if(e != NULL) {
     if(mac_status == MAC_TX_OK) {
+      if(e->locked && !phase_expired(e)) {
+        phase_sample(e, time);
+        phase_stats.hits++;
+      }
 #if PHASE_DRIFT_CORRECT
-      e->drift = time-e->time;
-#endif
-      e->time = time;
+      else {
+        drift_reference(e, time);
+      }
+#endif /* PHASE_DRIFT_CORRECT */
+      phase_lock(e, time);
     }
     /* If the neighbor didn't reply to us, it may have switched
        phase (rebooted). We try a number of transmissions to it
        before we drop it from the phase list. */
-    if(mac_status == MAC_TX_NOACK) {
+    if(mac_status == MAC_TX_NOACK && e->cycle_shift > 0) {
+      /* The neighbor may have slowed down without us hearing about
+         it. Its phase is only known modulo its shorter cycle, so it
+         is relearnt with a strobe over the full cycle. */
+      e->cycle_shift = 0;
+      e->locked = 0;
+    }
+    if(mac_status == MAC_TX_NOACK && e->locked) {
       PRINTF("phase noacks %d to %d.%d\n", e->noacks, neighbor->u8[0], neighbor->u8[1]);
+      phase_stats.misses++;
+      /* The strobes did not cover the wake-up of the neighbor, so the
+         window is widened for the next transmission. */
+      if(e->error < neighbor_cycle_time(e) / 4) {
+        e->error = e->error * 2 + 1;
+      }
       e->noacks++;
       if(e->noacks == 1) {
         timer_set(&e->noacks_timer, MAX_NOACKS_TIME);
       }
       if(e->noacks >= MAX_NOACKS || timer_expired(&e->noacks_timer)) {
         PRINTF("drop %d\n", neighbor->u8[0]);
+        phase_stats.drops++;
         nbr_table_remove(nbr_phase, e);
         return;
       }
-    } else if(mac_status == MAC_TX_OK) {
-      e->noacks = 0;
     }
   } else {
     /* No matching phase was found, so we allocate a new one. */
-    if(mac_status == MAC_TX_OK && e == NULL) {
+    if(mac_status == MAC_TX_OK) {
       e = nbr_table_add_lladdr(nbr_phase, neighbor);
       if(e) {
-        e->time = time;
 #if PHASE_DRIFT_CORRECT
-      e->drift = 0;
+        e->drift = 0;
+        drift_reference(e, time);
 #endif
-      e->noacks = 0;
+        e->error = phase_cycle_time / 4;
+        e->cycle_shift = 0;
+        phase_lock(e, time);
       }
     }
   }
 }
 /*---------------------------------------------------------------------------*/
+void
+phase_remove(const rimeaddr_t *neighbor)
+{
+  struct phase *e;
+
+  e = nbr_table_get_from_lladdr(nbr_phase, neighbor);
+  if(e != NULL) {
+    nbr_table_remove(nbr_phase, e);
+  }
+}
+/*---------------------------------------------------------------------------*/
+rtimer_clock_t
+phase_error(const rimeaddr_t *neighbor)
+{
+  struct phase *e;
+
+  e = nbr_table_get_from_lladdr(nbr_phase, neighbor);
+  if(e == NULL) {
+    return phase_cycle_time / 2;
+  }
+  if(!e->locked) {
+    return neighbor_cycle_time(e) / 2;
+  }
+  return e->error;
+}
+/*---------------------------------------------------------------------------*/
+void
+phase_set_cycle_shift(const rimeaddr_t *neighbor, uint8_t cycle_shift)
+{
+  struct phase *e;
+
+  e = nbr_table_get_from_lladdr(nbr_phase, neighbor);
+  if(e == NULL) {
+    if(cycle_shift == 0) {
+      /* Unknown neighbors are assumed to use the base cycle. */
+      return;
+    }
+    e = nbr_table_add_lladdr(nbr_phase, neighbor);
+    if(e == NULL) {
+      return;
+    }
+#if PHASE_DRIFT_CORRECT
+    e->drift = 0;
+#endif
+    e->error = (phase_cycle_time >> cycle_shift) / 4;
+    e->locked = 0;
+    e->noacks = 0;
+  } else if(cycle_shift < e->cycle_shift) {
+    /* A phase recorded with a shorter cycle does not tell which of the
+       wake-ups remain with a longer one. */
+    e->locked = 0;
+  }
+  e->cycle_shift = cycle_shift;
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+phase_cycle_shift(const rimeaddr_t *neighbor)
+{
+  struct phase *e;
+
+  e = nbr_table_get_from_lladdr(nbr_phase, neighbor);
+  return e != NULL ? e->cycle_shift : 0;
+}
+/*---------------------------------------------------------------------------*/
 static void
 send_packet(void *ptr)
 {
@@ -157,13 +409,21 @@ phase_wait(const rimeaddr_t *neighbor, rtimer_clock_t cycle_time,
            struct rdc_buf_list *buf_list)
 {
   struct phase *e;
-  //  const rimeaddr_t *neighbor = packetbuf_addr(PACKETBUF_ADDR_RECEIVER);
+
   /* We go through the list of phases to find if we have recorded a
      phase for this particular neighbor. If so, we can compute the
      time for the next expected phase and setup a ctimer to switch on
      the radio just before the phase. */
   e = nbr_table_get_from_lladdr(nbr_phase, neighbor);
-  if(e != NULL) {
+  if(e != NULL && e->locked && phase_expired(e)) {
+    /* The drift accumulated since the last update may exceed the
+       strobe window: the phase is relearnt with a full strobe, but
+       the drift estimate is kept. */
+    PRINTF("phase expired %d\n", neighbor->u8[0]);
+    phase_stats.expired++;
+    e->locked = 0;
+  }
+  if(e != NULL && e->locked) {
     rtimer_clock_t wait, now, expected, sync;
     clock_time_t ctimewait;
     
@@ -174,27 +434,9 @@ phase_wait(const rimeaddr_t *neighbor, rtimer_clock_t cycle_time,
        on the radio within the CYCLE_TIME period, we compute the
        waiting time with modulo CYCLE_TIME. */
     
-    /*      printf("neighbor phase 0x%02x (cycle 0x%02x)\n", e->time & (cycle_time - 1),
-            cycle_time);*/
-
-    /*      if(e->noacks > 0) {
-            printf("additional wait %d\n", additional_wait);
-            }*/
-    
     now = RTIMER_NOW();
 
-    sync = (e == NULL) ? now : e->time;
-
-#if PHASE_DRIFT_CORRECT
-    {
-      int32_t s;
-      if(e->drift > cycle_time) {
-        s = e->drift % cycle_time / (e->drift / cycle_time);  /* drift per cycle */
-        s = s * (now - sync) / cycle_time;                    /* estimated drift to now */
-        sync += s;                                            /* add it in */
-      }
-    }
-#endif
+    sync = expected_phase(e);
 
     /* Check if cycle_time is a power of two */
     if(!(cycle_time & (cycle_time - 1))) {
@@ -237,10 +479,75 @@ phase_wait(const rimeaddr_t *neighbor, rtimer_clock_t cycle_time,
   return PHASE_UNKNOWN;
 }
 /*---------------------------------------------------------------------------*/
+#if PHASE_PERSIST
+/* Phases are relative to the rtimer, which restarts on reboot, so only
+   the drift and the wake-up error of each neighbor are saved. They are
+   restored as unlocked entries that the first acknowledged
+   transmission locks again. */
+static void
+phase_save(void *ptr)
+{
+  struct phase *e;
+  struct phase_record r;
+  int fd;
+
+  cfs_remove(PHASE_FILE);
+  fd = cfs_open(PHASE_FILE, CFS_WRITE);
+  if(fd >= 0) {
+    for(e = nbr_table_head(nbr_phase); e != NULL;
+        e = nbr_table_next(nbr_phase, e)) {
+      rimeaddr_copy(&r.addr, nbr_table_get_lladdr(nbr_phase, e));
+#if PHASE_DRIFT_CORRECT
+      r.drift = e->drift;
+#endif
+      r.error = e->error;
+      if(cfs_write(fd, &r, sizeof(r)) != sizeof(r)) {
+        PRINTF("phase: cfs write error\n");
+        break;
+      }
+    }
+    cfs_close(fd);
+  }
+  ctimer_set(&persist_timer, PHASE_PERSIST_INTERVAL, phase_save, NULL);
+}
+/*---------------------------------------------------------------------------*/
+static void
+phase_restore(void)
+{
+  struct phase *e;
+  struct phase_record r;
+  int fd;
+
+  fd = cfs_open(PHASE_FILE, CFS_READ);
+  if(fd < 0) {
+    return;
+  }
+  while(cfs_read(fd, &r, sizeof(r)) == sizeof(r)) {
+    e = nbr_table_add_lladdr(nbr_phase, &r.addr);
+    if(e == NULL) {
+      break;
+    }
+#if PHASE_DRIFT_CORRECT
+    e->drift = r.drift;
+#endif
+    e->error = r.error;
+    e->locked = 0;
+    e->cycle_shift = 0;
+    e->noacks = 0;
+  }
+  cfs_close(fd);
+}
+#endif /* PHASE_PERSIST */
+/*---------------------------------------------------------------------------*/
 void
-phase_init(void)
+phase_init(rtimer_clock_t cycle_time)
 {
+  phase_cycle_time = cycle_time;
   memb_init(&queued_packets_memb);
   nbr_table_register(nbr_phase, NULL);
+#if PHASE_PERSIST
+  phase_restore();
+  ctimer_set(&persist_timer, PHASE_PERSIST_INTERVAL, phase_save, NULL);
+#endif /* PHASE_PERSIST */
 }
 /*---------------------------------------------------------------------------*/
@@ -53,8 +53,21 @@ typedef enum {
   PHASE_DEFERRED,
 } phase_status_t;
 
+struct phase_stats {
+  /* Acknowledged transmissions to a locked phase, transmissions to a
+     locked phase that were not acknowledged, phases dropped after
+     too many misses and phases that became too old to be used. */
+  uint32_t hits, misses, drops, expired;
+  /* Average distance between the expected and the actual wake-up of
+     the neighbors, in rtimer ticks. */
+  rtimer_clock_t error;
+};
 
-void phase_init(void);
+extern struct phase_stats phase_stats;
+
+/* Start keeping the phases of the neighbors of a duty cycling protocol
+   with the given base cycle time, in rtimer ticks. */
+void phase_init(rtimer_clock_t cycle_time);
 phase_status_t phase_wait(const rimeaddr_t *neighbor,
                           rtimer_clock_t cycle_time, rtimer_clock_t wait_before,
                           mac_callback_t mac_callback, void *mac_callback_ptr,
@@ -63,4 +76,14 @@ void phase_update(const rimeaddr_t *neighbor,
                   rtimer_clock_t time, int mac_status);
 void phase_remove(const rimeaddr_t *neighbor);
 
+/* The average distance between the expected and the actual wake-up of
+   a neighbor, or half a cycle if its phase is not known. */
+rtimer_clock_t phase_error(const rimeaddr_t *neighbor);
+
+/* Neighbors may check the channel more often than the base rate of the
+   duty cycling protocol: their cycle time is the base one shifted right
+   by cycle_shift. Unknown neighbors have a cycle shift of 0. */
+void phase_set_cycle_shift(const rimeaddr_t *neighbor, uint8_t cycle_shift);
+uint8_t phase_cycle_shift(const rimeaddr_t *neighbor);
+
 #endif /* PHASE_H */
@@ -450,6 +450,20 @@ queuebuf_to_packetbuf(struct queuebuf *b)
   }
 }
 /*---------------------------------------------------------------------------*/
+/* Restore the attributes of a queued packet in packetbuf, leaving its
+   data where it is. Enough for the MAC callbacks, which only look at
+   the attributes of the packet they are called for. */
+void
+queuebuf_attr_to_packetbuf(struct queuebuf *b)
+{
+  if(memb_inmemb(&bufmem, b)) {
+    struct queuebuf_data *buframptr = queuebuf_load_to_ram(b);
+    packetbuf_attr_copyfrom(buframptr->attrs, buframptr->addrs);
+  } else {
+    queuebuf_to_packetbuf(b);
+  }
+}
+/*---------------------------------------------------------------------------*/
 void *
 queuebuf_dataptr(struct queuebuf *b)
 {
@@ -98,6 +98,7 @@ struct queuebuf *queuebuf_new_from_packetbuf(void);
 void queuebuf_update_attr_from_packetbuf(struct queuebuf *b);
 
 void queuebuf_to_packetbuf(struct queuebuf *b);
+void queuebuf_attr_to_packetbuf(struct queuebuf *b);
 void queuebuf_free(struct queuebuf *b);
 
 void *queuebuf_dataptr(struct queuebuf *b);
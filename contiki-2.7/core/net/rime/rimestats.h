@@ -53,6 +53,11 @@ struct rimestats {
     sendingdrop; /* Packet dropped when we were sending a packet */
 
   unsigned long lltx, llrx;
+
+  /* Reasons for dropping 6lowpan fragments: */
+  unsigned long reassdrop, /* Fragment of a packet not being reassembled */
+    reasstimedout, /* Packet whose reassembly timed out */
+    reassevicted; /* Packet evicted to reassemble a newer one */
 };
 
 #if RIMESTATS_CONF_ENABLED
@@ -1,140 +1,253 @@
-#include <stdint.h>
+/**
+ * \file
+ *         Table-driven fixed-point Mamdani fuzzy inference engine.
+ *
+ *         Membership grades are computed once per input and only the
+ *         terms with a non-zero grade are kept. The rule base is then
+ *         walked over the cartesian product of those active terms, so
+ *         an evaluation touches at most 2^inputs rules for the usual
+ *         overlapping-trapezoid partitions instead of the whole table.
+ */
+
+#include <string.h>
 #include "FIS.h"
 
+/*---------------------------------------------------------------------------*/
+/* Left shoulder, trapezoid and right shoulder membership functions. */
+#define MF_FIRST(c, d)       { FIS_OPEN_LEFT, FIS_OPEN_LEFT, (c), (d) }
+#define MF(a, b, c, d)       { (a), (b), (c), (d) }
+#define MF_LAST(a, b)        { (a), (b), FIS_OPEN_RIGHT, FIS_OPEN_RIGHT }
+/*---------------------------------------------------------------------------*/
+/* QoS system: ETX x delay x hop count -> QoS */
+enum { ETX_SHORT, ETX_AVG, ETX_LONG };
+enum { DLY_SMALL, DLY_AVG, DLY_HIGH };
+enum { HC_NEAR, HC_AVG, HC_FAR };
+enum { QOS_VERY_SLOW, QOS_SLOW, QOS_AVG, QOS_FAST, QOS_VERY_FAST };
 
-uint16_t min(uint16_t a, uint16_t b){
-    if(a>b) return b;
-    return a;
-}
-uint16_t max(uint16_t a, uint16_t b){
-    if(a>b) return a;
-    return b;
-}
+static const struct fis_mf etx_mf[] = {
+  MF_FIRST(FIS_ETX_B1, FIS_ETX_B2),
+  MF(FIS_ETX_B1, FIS_ETX_B2, FIS_ETX_B3, FIS_ETX_B4),
+  MF_LAST(FIS_ETX_B3, FIS_ETX_B4)
+};
 
-uint16_t up(uint16_t x1, uint16_t x2, uint16_t x){
-    return 100 * (x - x1)/(x2 - x1);
-}
-uint16_t down(uint16_t x1, uint16_t x2, uint16_t x){
-    return 100 * (x - x2)/(x1 - x2);
-}
+static const struct fis_mf delay_mf[] = {
+  MF_FIRST(FIS_DLY_B1, FIS_DLY_B2),
+  MF(FIS_DLY_B1, FIS_DLY_B2, FIS_DLY_B3, FIS_DLY_B4),
+  MF_LAST(FIS_DLY_B3, FIS_DLY_B4)
+};
 
-uint16_t first_t_norm(uint16_t a, uint16_t b, uint16_t x){
-    if (x < a) return 100;
-    if (x >= a && x <= b) return down(a, b, x);
-    return 0;
-}
+static const struct fis_mf hc_mf[] = {
+  MF_FIRST(FIS_HC_B1, FIS_HC_B2),
+  MF(FIS_HC_B1, FIS_HC_B2, FIS_HC_B3, FIS_HC_B4),
+  MF_LAST(FIS_HC_B3, FIS_HC_B4)
+};
+
+static const struct fis_var qos_in[] = {
+  { etx_mf, 3 },
+  { delay_mf, 3 },
+  { hc_mf, 3 }
+};
+
+/* rules[etx][delay][hc] */
+static const uint8_t qos_rules[] = {
+  /* ETX short */
+  QOS_VERY_FAST, QOS_FAST, QOS_FAST,
+  QOS_FAST, QOS_FAST, QOS_FAST,
+  QOS_AVG, QOS_AVG, QOS_AVG,
+  /* ETX average */
+  QOS_FAST, QOS_FAST, QOS_FAST,
+  QOS_AVG, QOS_AVG, QOS_AVG,
+  QOS_SLOW, QOS_SLOW, QOS_SLOW,
+  /* ETX long */
+  QOS_AVG, QOS_AVG, QOS_AVG,
+  QOS_SLOW, QOS_SLOW, QOS_SLOW,
+  QOS_SLOW, QOS_SLOW, QOS_VERY_SLOW
+};
+
+static const uint8_t qos_out[] = { 10, 30, 50, 70, 90 };
+
+static const struct fis qos_fis = {
+  qos_in, qos_rules, qos_out, 3, sizeof(qos_out)
+};
+/*---------------------------------------------------------------------------*/
+/* Quality system: QoS x energy -> quality */
+enum { ENERGY_LOW, ENERGY_MEDIUM, ENERGY_FULL };
+enum { Q_AWFUL, Q_BAD, Q_DEGRADED, Q_AVG, Q_ACCEPTABLE, Q_GOOD, Q_EXCELLENT };
+
+/* The QoS input is in Q8.8, as returned by qos_fine(). */
+#define QOS_IN(q)            ((uint16_t)(q) << FIS_OUT_FRAC_BITS)
+
+static const struct fis_mf qos_mf[] = {
+  MF_FIRST(QOS_IN(QoS_B1), QOS_IN(QoS_B2)),
+  MF(QOS_IN(QoS_B1), QOS_IN(QoS_B2), QOS_IN(QoS_B3), QOS_IN(QoS_B4)),
+  MF(QOS_IN(QoS_B3), QOS_IN(QoS_B4), QOS_IN(QoS_B5), QOS_IN(QoS_B6)),
+  MF(QOS_IN(QoS_B5), QOS_IN(QoS_B6), QOS_IN(QoS_B7), QOS_IN(QoS_B8)),
+  MF_LAST(QOS_IN(QoS_B7), QOS_IN(QoS_B8))
+};
+
+static const struct fis_mf energy_mf[] = {
+  MF_FIRST(FIS_ENERGY_B1, FIS_ENERGY_B2),
+  MF(FIS_ENERGY_B1, FIS_ENERGY_B2, FIS_ENERGY_B3, FIS_ENERGY_B4),
+  MF_LAST(FIS_ENERGY_B3, FIS_ENERGY_B4)
+};
+
+static const struct fis_var quality_in[] = {
+  { qos_mf, 5 },
+  { energy_mf, 3 }
+};
 
-uint16_t t_norm(uint16_t a, uint16_t b, uint16_t c, uint16_t d, uint16_t x){
-    if (x >= a && x < b) return up(a, b, x);
-    if (x >= b && x <= c) return 100;
-    if (x > c && x <= d) return down(c, d, x);
+/* rules[qos][energy] */
+static const uint8_t quality_rules[] = {
+  Q_AWFUL, Q_BAD, Q_AVG,                  /* QoS very slow */
+  Q_BAD, Q_DEGRADED, Q_AVG,               /* QoS slow */
+  Q_DEGRADED, Q_AVG, Q_ACCEPTABLE,        /* QoS average */
+  Q_AVG, Q_ACCEPTABLE, Q_GOOD,            /* QoS fast */
+  Q_AVG, Q_GOOD, Q_EXCELLENT              /* QoS very fast */
+};
+
+static const uint8_t quality_out[] = { 9, 21, 35, 49, 63, 77, 91 };
+
+static const struct fis quality_fis = {
+  quality_in, quality_rules, quality_out, 2, sizeof(quality_out)
+};
+/*---------------------------------------------------------------------------*/
+static fis_grade_t
+membership(const struct fis_mf *mf, uint16_t x)
+{
+  if(x < mf->a || x > mf->d) {
     return 0;
+  }
+  if(x < mf->b) {
+    return ((uint32_t)FIS_GRADE_MAX * (x - mf->a)) / (mf->b - mf->a);
+  }
+  if(x <= mf->c) {
+    return FIS_GRADE_MAX;
+  }
+  return ((uint32_t)FIS_GRADE_MAX * (mf->d - x)) / (mf->d - mf->c);
 }
+/*---------------------------------------------------------------------------*/
+uint16_t
+fis_eval_fine(const struct fis *fis, const uint16_t *x)
+{
+  uint8_t term[FIS_MAX_INPUTS][FIS_MAX_TERMS];
+  fis_grade_t grade[FIS_MAX_INPUTS][FIS_MAX_TERMS];
+  uint8_t active[FIS_MAX_INPUTS];
+  uint8_t pos[FIS_MAX_INPUTS];
+  fis_grade_t strength[FIS_MAX_TERMS];
+  fis_grade_t g, s;
+  uint16_t index;
+  uint32_t num, den;
+  uint8_t t, out;
+  int i;
+
+  /* Fuzzification: keep only the terms with a non-zero grade. */
+  for(i = 0; i < fis->inputs; i++) {
+    active[i] = 0;
+    pos[i] = 0;
+    for(t = 0; t < fis->in[i].terms; t++) {
+      g = membership(&fis->in[i].mf[t], x[i]);
+      if(g > 0) {
+        term[i][active[i]] = t;
+        grade[i][active[i]] = g;
+        active[i]++;
+      }
+    }
+    if(active[i] == 0) {
+      return 0;
+    }
+  }
+
+  /* Inference: min for AND, max for aggregation, over the active rules. */
+  memset(strength, 0, fis->outputs * sizeof(strength[0]));
+  for(;;) {
+    index = 0;
+    s = FIS_GRADE_MAX;
+    for(i = 0; i < fis->inputs; i++) {
+      index = index * fis->in[i].terms + term[i][pos[i]];
+      if(grade[i][pos[i]] < s) {
+        s = grade[i][pos[i]];
+      }
+    }
+    out = fis->rules[index];
+    if(out != FIS_NO_RULE && s > strength[out]) {
+      strength[out] = s;
+    }
 
-uint16_t last_t_norm(uint16_t c, uint16_t d, uint16_t x){
-    if (x > c && x < d) return up(c, d, x);
-    if (x >= d) return 100;
+    for(i = fis->inputs - 1; i >= 0; i--) {
+      if(++pos[i] < active[i]) {
+        break;
+      }
+      pos[i] = 0;
+    }
+    if(i < 0) {
+      break;
+    }
+  }
+
+  /*
+   * Defuzzification: weighted average of the output singletons, with a
+   * single division at the end. num is below FIS_MAX_TERMS *
+   * FIS_GRADE_MAX * 255, so it has room for the fractional bits of the
+   * result except in Q0.16, where the three low bits of den are given
+   * up instead (they weigh less than 2^-12 of any non-empty sum).
+   */
+  num = 0;
+  den = 0;
+  for(t = 0; t < fis->outputs; t++) {
+    num += (uint32_t)strength[t] * fis->out[t];
+    den += strength[t];
+  }
+#if FIS_FIXED_POINT == FIS_Q0_16
+  num <<= FIS_OUT_FRAC_BITS - 3;
+  den = (den + 4) >> 3;
+#else
+  num <<= FIS_OUT_FRAC_BITS;
+#endif
+  if(den == 0) {
     return 0;
+  }
+  num /= den;
+  return num > 0xffff ? 0xffff : num;
 }
+/*---------------------------------------------------------------------------*/
+uint8_t
+fis_eval(const struct fis *fis, const uint16_t *x)
+{
+  return fis_eval_fine(fis, x) >> FIS_OUT_FRAC_BITS;
+}
+/*---------------------------------------------------------------------------*/
+uint16_t
+qos_fine(uint16_t etx, uint16_t delay, uint16_t hc)
+{
+  uint16_t x[3];
 
-
-//QoS = FIS(ETX, Delay, HopCount)
-uint8_t qos(uint16_t etx, uint16_t delay, uint16_t hc){
-    uint16_t setx = etx_short(etx);
-    uint16_t aetx = etx_avg(etx);
-    uint16_t letx = etx_long(etx);
-
-    uint16_t sdly = dly_small(delay);
-    uint16_t adly = dly_avg(delay);
-    uint16_t ldly = dly_high(delay);
-
-    uint16_t nhc = hc_near(hc);
-    uint16_t ahc = hc_avg(hc);
-    uint16_t fhc = hc_far(hc);
-    
-    // if etx is short and delay is small and hop count is near then QoS is very fast
-    uint16_t vfqos = min(setx, min(sdly, nhc));
-    // if (etx is short and delay is average and hc is near) or ...
-    uint16_t fqos = max(
-        max(
-            max(min(setx, min(adly, nhc)),min(setx, min(sdly, ahc))),
-            max(min(setx, min(adly, ahc)),min(setx, min(sdly, fhc)))
-        ),
-        max(
-            max(min(setx, min(adly, fhc)),min(aetx, min(sdly, nhc))),
-            max(min(aetx, min(sdly, ahc)),min(aetx, min(sdly, fhc)))
-        )
-    );
-    uint16_t aqos = max(
-        max(
-            max(
-                max(min(setx, min(ldly, nhc)),min(setx, min(ldly, ahc))),
-                max(min(setx, min(ldly, fhc)),min(aetx, min(adly, nhc)))
-            ),
-            max(
-                max(min(aetx, min(adly, ahc)),min(aetx, min(adly, fhc))),
-                max(min(letx, min(sdly, nhc)),min(letx, min(sdly, ahc)))
-            )
-        ),
-        min(letx, min(sdly, fhc))
-    );
-    uint16_t sqos = max(
-        max(
-            max(min(aetx, min(ldly, nhc)),min(aetx, min(ldly, ahc))),
-            max(min(aetx, min(ldly, fhc)),min(letx, min(adly, nhc)))
-        ),
-        max(
-            max(min(letx, min(ldly, nhc)),min(letx, min(adly, ahc))),
-            max(min(letx, min(ldly, ahc)),min(letx, min(adly, fhc)))
-        )
-    );
-    uint16_t vsqos = min(letx, min(ldly, fhc));
-    return (vfqos*90 + fqos*70 + aqos*50 + sqos*30 + vsqos*10)/(vfqos + fqos + aqos + sqos + vsqos);
+  x[0] = etx;
+  x[1] = delay;
+  x[2] = hc;
+  return fis_eval_fine(&qos_fis, x);
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+qos(uint16_t etx, uint16_t delay, uint16_t hc)
+{
+  return qos_fine(etx, delay, hc) >> FIS_OUT_FRAC_BITS;
 }
+/*---------------------------------------------------------------------------*/
+uint16_t
+quality_fine(uint16_t q, uint16_t e)
+{
+  uint16_t x[2];
 
-//Quality = FIS(QoS, Energy)
-uint8_t quality(uint16_t q, uint16_t e){
-    uint16_t vsqos = qos_very_slow(q);
-    uint16_t sqos = qos_slow(q);
-    uint16_t aqos = qos_avg(q);
-    uint16_t fqos = qos_fast(q);
-    uint16_t vfqos = qos_very_fast(q);
-
-    uint16_t leng = energy_low(e);
-    uint16_t meng = energy_medium(e);
-    uint16_t feng = energy_full(e);
-
-    uint16_t awf = min(vsqos, leng);
-    uint16_t bad = max(min(vsqos, meng), min(sqos, leng));
-    uint16_t deg = max(min(sqos, meng), min(aqos, leng));
-    uint16_t avg = max(
-        max(
-            max(min(vsqos, feng), min(sqos, feng)),
-            max(min(aqos, meng), min(fqos, leng))
-            ),
-        min(vfqos, leng)
-    );
-    uint16_t accep = max(min(aqos, feng), min(fqos, meng));
-    uint16_t good = max(min(fqos, feng), min(vfqos, meng));
-    uint16_t exc = min(vfqos, feng);
-
-    return (awf*9 + bad*21 + deg*35 + avg*49 + accep*63 + good*77 + exc*91)/(awf + bad + deg + avg + accep + good + exc);
+  x[0] = q;
+  x[1] = e;
+  return fis_eval_fine(&quality_fis, x);
 }
-/*
- //code to test the FIS
-#include<stdio.h>
-int main(){
-    uint16_t q;
-    uint16_t qual;
-    unsigned short etx[] = {0, 2, 10, 15, 3, 15, 4};
-    unsigned short delay[] = {0, 1000, 700, 500, 700, 2500, 122};
-    unsigned short hc[] = {0, 2, 1, 2, 1, 3, 75};
-    unsigned short energy[] = {255, 200, 225, 200, 250, 75, 254};
-    for(int i = 0; i<7; i++){
-        q = qos(etx[i], delay[i], hc[i]);
-        qual = quality(q, energy[i]);
-        printf("etx\tdelay\thc\tenergy\tQoS\tQuality\n");
-        printf("%i\t%i\t%i\t%i\t%i\t%i\n\n", etx[i], delay[i], hc[i], energy[i], q, qual);
-    }
+/*---------------------------------------------------------------------------*/
+uint8_t
+quality(uint16_t q, uint16_t e)
+{
+  /* The grades do not depend on the scale of the QoS axis, so this is
+     the integer quality of an integer QoS. */
+  return quality_fine(q > 0xff ? 0xffff : QOS_IN(q), e) >> FIS_OUT_FRAC_BITS;
 }
-*/
+/*---------------------------------------------------------------------------*/
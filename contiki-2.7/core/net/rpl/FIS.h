@@ -1,34 +1,140 @@
+/**
+ * \file
+ *         Fixed-point Mamdani fuzzy inference engine used by the
+ *         fuzzy RPL objective function (rpl-Fuzzyof.c).
+ *
+ *         A fuzzy system is described declaratively: every input has a
+ *         table of trapezoid membership functions and the rule base is
+ *         a dense table of consequent terms, indexed by the antecedent
+ *         term of each input. All tables are const and live in ROM.
+ */
 
 #ifndef FIS_H
 #define FIS_H
+
 #include <stdint.h>
 
+/*
+ * Fixed-point format of the membership grades and rule strengths.
+ * FIS_PERCENT is the original integer scale (1.0 == 100), FIS_Q8_8
+ * uses 8 fractional bits (1.0 == 0x100) and FIS_Q0_16 uses 16
+ * fractional bits (1.0 == 0xffff). The finer formats avoid most of the
+ * rounding of the grades before the defuzzification and cost the same
+ * number of operations.
+ */
+#define FIS_PERCENT      0
+#define FIS_Q8_8         1
+#define FIS_Q0_16        2
+
+#ifdef FIS_CONF_FIXED_POINT
+#define FIS_FIXED_POINT  FIS_CONF_FIXED_POINT
+#else
+#define FIS_FIXED_POINT  FIS_Q8_8
+#endif /* FIS_CONF_FIXED_POINT */
+
+/* Maximum membership grade. */
+#if FIS_FIXED_POINT == FIS_Q0_16
+#define FIS_GRADE_MAX    0xffff
+#elif FIS_FIXED_POINT == FIS_Q8_8
+#define FIS_GRADE_MAX    0x100
+#else
+#define FIS_GRADE_MAX    100
+#endif
+
+typedef uint16_t fis_grade_t;
+
+/*
+ * Number of fractional bits of the fine outputs: fis_eval_fine(),
+ * qos_fine() and quality_fine() return Q8.8 values whose integer part
+ * is the output of fis_eval(), qos() and quality(). quality_fine()
+ * also takes its QoS input in Q8.8, so that the output of qos_fine()
+ * is passed on without being truncated.
+ */
+#define FIS_OUT_FRAC_BITS 8
+
+/* Maximum number of inputs of a fuzzy system. */
+#define FIS_MAX_INPUTS   3
+
+/* Maximum number of terms of a linguistic variable. */
+#define FIS_MAX_TERMS    8
+
+/* Consequent marking an empty cell of a sparse rule table. */
+#define FIS_NO_RULE      0xff
+
+/* Breakpoints used for an open (shoulder) side of a trapezoid. */
+#define FIS_OPEN_LEFT    0
+#define FIS_OPEN_RIGHT   0xffff
+
+/*
+ * Trapezoid membership function. The grade rises from 0 at a to
+ * FIS_GRADE_MAX at b, stays there until c and falls back to 0 at d.
+ * Left and right shoulders are expressed with a == b == FIS_OPEN_LEFT
+ * and c == d == FIS_OPEN_RIGHT respectively.
+ */
+struct fis_mf {
+  uint16_t a, b, c, d;
+};
+
+/* A linguistic variable: the membership functions of all its terms. */
+struct fis_var {
+  const struct fis_mf *mf;
+  uint8_t terms;
+};
+
+/*
+ * A fuzzy system. rules[] holds one consequent term per combination
+ * of input terms, in row-major order of the inputs (the last input
+ * varies fastest). out[] holds the singleton value of each
+ * consequent term, used by the weighted-average defuzzification.
+ */
+struct fis {
+  const struct fis_var *in;
+  const uint8_t *rules;
+  const uint8_t *out;
+  uint8_t inputs;
+  uint8_t outputs;
+};
+
+/* Evaluate a fuzzy system for the input vector x. */
+uint8_t fis_eval(const struct fis *fis, const uint16_t *x);
+uint16_t fis_eval_fine(const struct fis *fis, const uint16_t *x);
+
+/* QoS = FIS(ETX, delay, hop count) */
 uint8_t qos(uint16_t etx, uint16_t delay, uint16_t hc);
-uint8_t quality(uint16_t q, uint16_t e);
+uint16_t qos_fine(uint16_t etx, uint16_t delay, uint16_t hc);
 
-//etx
-#define etx_short(etx) first_t_norm(3, 6, etx)
-#define etx_avg(etx) t_norm(3, 6, 9, 12, etx)
-#define etx_long(etx) last_t_norm(9, 12, etx)
+/* Quality = FIS(QoS, energy), with the QoS in Q8.8 for quality_fine() */
+uint8_t quality(uint16_t q, uint16_t e);
+uint16_t quality_fine(uint16_t q, uint16_t e);
 
-//delay
-#define dly_small(dly) first_t_norm(600, 1200, dly)
-#define dly_avg(dly) t_norm(600, 1200, 1800, 2400, dly)
-#define dly_high(dly) last_t_norm(1800, 2400, dly)
+/* ETX terms: short, average, long */
+#define FIS_ETX_B1    3
+#define FIS_ETX_B2    6
+#define FIS_ETX_B3    9
+#define FIS_ETX_B4    12
 
-// hc
-#define hc_near(hc) first_t_norm(1, 2, hc)
-#define hc_avg(hc) t_norm(1, 2, 3, 4, hc)
-#define hc_far(hc) last_t_norm(3, 4, hc)
+/* Delay terms: small, average, high */
+#define FIS_DLY_B1    600
+#define FIS_DLY_B2    1200
+#define FIS_DLY_B3    1800
+#define FIS_DLY_B4    2400
 
-//energy
-#define energy_low(eng) first_t_norm(51, 102, (eng))
-#define energy_medium(eng) t_norm(51, 102, 153, 205, (eng))
-#define energy_full(eng) last_t_norm(153, 205, (eng))
+/* Hop count terms: near, average, far */
+#define FIS_HC_B1     1
+#define FIS_HC_B2     2
+#define FIS_HC_B3     3
+#define FIS_HC_B4     4
 
+/* Energy terms: low, medium, full */
+#define FIS_ENERGY_B1 51
+#define FIS_ENERGY_B2 102
+#define FIS_ENERGY_B3 153
+#define FIS_ENERGY_B4 205
 
-/*QoS = FUZZY_COMBINATION(ETX,DELAY)*/
+/* Scale of the QoS and quality outputs, and of the QoS input. */
+#define FIS_OUT_MAX   100
 
+/* QoS terms: very slow, slow, average, fast, very fast */
 #define QoS_B1 15
 #define QoS_B2 25
 #define QoS_B3 35
@@ -38,10 +144,4 @@ uint8_t quality(uint16_t q, uint16_t e);
 #define QoS_B7 75
 #define QoS_B8 85
 
-#define qos_very_slow(x) first_t_norm(QoS_B1, QoS_B2,x)
-#define qos_slow(x) t_norm(QoS_B1, QoS_B2, QoS_B3, QoS_B4, x)
-#define qos_avg(x) t_norm(QoS_B3, QoS_B4, QoS_B5, QoS_B6, x)
-#define qos_fast(x) t_norm(QoS_B5, QoS_B6, QoS_B7, QoS_B8, x)
-#define qos_very_fast(x) last_t_norm(QoS_B7, QoS_B8, x)
-
-#endif
+#endif /* FIS_H */
@@ -1,26 +1,77 @@
+/**
+ * \file
+ *         Incremental battery charge estimator based on energest.
+ */
+
 #include "contiki.h"
+#include "sys/ctimer.h"
 #include "battery.h"
 #define DEBUG DEBUG_NONE
 #include "net/uip-debug.h"
 
-extern uint8_t battery_charge_value;
-void battery_charge_set()
+uint8_t battery_charge_value = MAX_ENERGY;
+
+/* Power states accounted for, and their current. */
+static const uint8_t states[] = {
+  ENERGEST_TYPE_CPU, ENERGEST_TYPE_LPM,
+  ENERGEST_TYPE_TRANSMIT, ENERGEST_TYPE_LISTEN
+};
+static const uint16_t currents[] = {
+  current_cpu, current_cpu_idle, current_tx, current_rx
+};
+
+#define STATES (sizeof(states) / sizeof(states[0]))
+
+/* Energest time of each state at the previous update. */
+static unsigned long last_time[STATES];
+
+/* Charge consumed since boot, in current units x rtimer ticks. */
+static uint64_t consumed;
+
+static struct ctimer update_timer;
+
+/*---------------------------------------------------------------------------*/
+static void
+update(void *ptr)
 {
-  uint32_t energy_consumption;
-  uint32_t battery_charge;
-  energest_flush();
+  battery_charge_set();
+  ctimer_reset(&update_timer);
+}
+/*---------------------------------------------------------------------------*/
+void
+battery_charge_set(void)
+{
+  unsigned long now;
+  uint32_t energy;
+  uint8_t i;
 
+  energest_flush();
 
-  uint32_t cpu = energest_type_time(ENERGEST_TYPE_CPU);
-  uint32_t cpu_idle = energest_type_time(ENERGEST_TYPE_LPM);
-  uint32_t tx = energest_type_time(ENERGEST_TYPE_TRANSMIT);
-  uint32_t rx = energest_type_time(ENERGEST_TYPE_LISTEN);
+  /* Only the time elapsed since the previous update is added, so that
+     the wrap of the energest counters cancels out in the difference. */
+  for(i = 0; i < STATES; i++) {
+    now = energest_type_time(states[i]);
+    consumed += (uint64_t)(now - last_time[i]) *
+      currents[i] * CURRENT_FACTOR;
+    last_time[i] = now;
+  }
 
-  uint32_t energy = ((tx * current_tx + rx * current_rx + \
-   cpu * current_cpu + cpu_idle * current_cpu_idle) * 3L) /32768;  
-  
-  energy_consumption=max_energy-energy/CURRENT_UNIT; 
-  battery_charge= (energy_consumption*255/max_energy)<<24;
-  battery_charge_value=255- (uint8_t)battery_charge;
-  
+  /* In mA x s x V, like max_energy. */
+  energy = (consumed * VOLTAGE) / RTIMER_SECOND / CURRENT_UNIT;
+  if(energy >= max_energy) {
+    battery_charge_value = 0;
+  } else {
+    battery_charge_value = ((uint64_t)(max_energy - energy) * MAX_ENERGY) /
+      max_energy;
+  }
+  PRINTF("BAT: consumed %lu of %lu, charge %u\n", (unsigned long)energy,
+         (unsigned long)max_energy, battery_charge_value);
+}
+/*---------------------------------------------------------------------------*/
+void
+battery_init(void)
+{
+  /* The energest counters start at boot, as does last_time[]. */
+  ctimer_set(&update_timer, BATTERY_UPDATE_INTERVAL, update, NULL);
 }
+/*---------------------------------------------------------------------------*/
@@ -1,27 +1,90 @@
+/**
+ * \file
+ *         Battery charge estimator used by the fuzzy RPL objective
+ *         function.
+ *
+ *         The charge drawn from the battery is accumulated from the
+ *         energest time spent in each power state since the previous
+ *         update, weighted by the current of that state. Updates run
+ *         from a periodic ctimer, so reading the charge is constant
+ *         time and the estimate is not affected by the wrap of the
+ *         32-bit energest counters.
+ */
+
 #ifndef BATTERY_H
 #define BATTERY_H
 
+#include "contiki-conf.h"
+
 /* number of mA per mesured current */
+#ifdef BATTERY_CONF_CURRENT_UNIT
+#define CURRENT_UNIT BATTERY_CONF_CURRENT_UNIT
+#else
 #define CURRENT_UNIT 10000
-/* current values mA * CURENT_UNIT */
+#endif
+
+/* current values mA * CURENT_UNIT, defaults for the sky mote */
+#ifdef BATTERY_CONF_CURRENT_CPU
+#define current_cpu BATTERY_CONF_CURRENT_CPU
+#else
 #define current_cpu 5000
+#endif
+#ifdef BATTERY_CONF_CURRENT_TX
+#define current_tx BATTERY_CONF_CURRENT_TX
+#else
 #define current_tx  17400
+#endif
+#ifdef BATTERY_CONF_CURRENT_RX
+#define current_rx BATTERY_CONF_CURRENT_RX
+#else
 #define current_rx 18800
+#endif
+#ifdef BATTERY_CONF_CURRENT_CPU_IDLE
+#define current_cpu_idle BATTERY_CONF_CURRENT_CPU_IDLE
+#else
 #define current_cpu_idle 5
+#endif
 
 /* ratio 10000 milliseconds / minutes */
 #define TIME_UNIT 6
 
 /* Current mutliplicator to accelarate current consumption */
+#ifdef BATTERY_CONF_CURRENT_FACTOR
+#define CURRENT_FACTOR BATTERY_CONF_CURRENT_FACTOR
+#else
 #define CURRENT_FACTOR 1
+#endif
+
+/* Battery voltage */
+#define VOLTAGE 3
 
 #define MAX_ENERGY 255
-//capacity in ma 
+/* Battery capacity in mAh */
+#ifdef BATTERY_CONF_CAPACITY
+#define capacity BATTERY_CONF_CAPACITY
+#else
 #define capacity 4000
-// max_energy 
-#define max_energy capacity*3
+#endif
+/* Energy of a full battery in mA x s x V, the unit of the consumed
+   energy. */
+#define max_energy ((uint32_t)capacity * 3600 * VOLTAGE)
+
+/* Interval between two updates of the charge estimate */
+#ifdef BATTERY_CONF_UPDATE_INTERVAL
+#define BATTERY_UPDATE_INTERVAL BATTERY_CONF_UPDATE_INTERVAL
+#else
+#define BATTERY_UPDATE_INTERVAL (60 * CLOCK_SECOND)
+#endif
+
+extern uint8_t battery_charge_value;
+
+/* Start the periodic updates of the charge estimate. */
+void battery_init(void);
+
+/* Account for the energy consumed since the previous update. */
+void battery_charge_set(void);
 
-uint8_t battery_charge_value;
-void battery_charge_set();
+/* Remaining charge, from 0 (empty) to MAX_ENERGY (full). */
+#define battery_charge() battery_charge_value
 
 #endif
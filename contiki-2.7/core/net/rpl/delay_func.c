@@ -0,0 +1,136 @@
+/**
+ * \file
+ *         Per-neighbor MAC delay sampling.
+ */
+
+#include "contiki.h"
+#include "net/mac/mac.h"
+#include "net/nbr-table.h"
+#include "net/packetbuf.h"
+#include "net/rpl/delay_func.h"
+
+#define DEBUG DEBUG_NONE
+#include "net/uip-debug.h"
+
+/* Send times of the frames in flight towards a neighbor. A zero tag
+   marks a free slot. */
+struct neighbor_delay {
+  uint32_t before_mac[NEIGHBOR_INFO_QUEUE_LEN];
+  uint8_t tag[NEIGHBOR_INFO_QUEUE_LEN];
+};
+
+NBR_TABLE(struct neighbor_delay, neighbor_delays);
+
+static uint8_t last_tag;
+static struct delay_sample last_sample;
+static uint8_t last_sample_valid;
+
+/*---------------------------------------------------------------------------*/
+void
+neighbor_info_init(void)
+{
+  nbr_table_register(neighbor_delays, NULL);
+}
+/*---------------------------------------------------------------------------*/
+void
+neighbor_info_send_mac(const rimeaddr_t *dest)
+{
+  struct neighbor_delay *n;
+  uint8_t i, slot;
+
+  packetbuf_set_attr(PACKETBUF_ATTR_DELAY_TAG, 0);
+  if(rimeaddr_cmp(dest, &rimeaddr_null)) {
+    return;
+  }
+
+  n = nbr_table_get_from_lladdr(neighbor_delays, dest);
+  if(n == NULL) {
+    n = nbr_table_add_lladdr(neighbor_delays, dest);
+    if(n == NULL) {
+      PRINTF("delay: could not allocate neighbor\n");
+      return;
+    }
+  }
+
+  /* Take a free slot, or recycle the oldest one if the MAC layer never
+     reported on it. */
+  slot = 0;
+  for(i = 0; i < NEIGHBOR_INFO_QUEUE_LEN; i++) {
+    if(n->tag[i] == 0) {
+      slot = i;
+      break;
+    }
+    if((int32_t)(n->before_mac[i] - n->before_mac[slot]) < 0) {
+      slot = i;
+    }
+  }
+
+  if(++last_tag == 0) {
+    last_tag = 1;
+  }
+  n->tag[slot] = last_tag;
+  n->before_mac[slot] = delay_clock_now();
+  packetbuf_set_attr(PACKETBUF_ATTR_DELAY_TAG, last_tag);
+}
+/*---------------------------------------------------------------------------*/
+void
+neighbor_info_sent_mac(const rimeaddr_t *dest, int status)
+{
+  struct neighbor_delay *n;
+  uint8_t tag, i, pending;
+
+  last_sample_valid = 0;
+
+  tag = packetbuf_attr(PACKETBUF_ATTR_DELAY_TAG);
+  n = nbr_table_get_from_lladdr(neighbor_delays, dest);
+  if(n == NULL || tag == 0) {
+    return;
+  }
+
+  pending = 0;
+  for(i = 0; i < NEIGHBOR_INFO_QUEUE_LEN; i++) {
+    if(n->tag[i] == tag) {
+      n->tag[i] = 0;
+      /* The RDC timestamps are only valid if they belong to this frame. */
+      if(status == MAC_TX_OK && delay_rdc.acked &&
+         delay_rdc.seqno == packetbuf_attr(PACKETBUF_ATTR_MAC_SEQNO)) {
+        last_sample.queueing = delay_rdc.start - n->before_mac[i];
+        last_sample.channel_access = delay_rdc.tx - delay_rdc.start;
+        last_sample.ack_rtt = delay_rdc.ack - delay_rdc.tx;
+        last_sample_valid = 1;
+        PRINTF("delay: to %d.%d queueing %lu access %lu rtt %lu ticks\n",
+               dest->u8[RIMEADDR_SIZE - 2], dest->u8[RIMEADDR_SIZE - 1],
+               (unsigned long)last_sample.queueing,
+               (unsigned long)last_sample.channel_access,
+               (unsigned long)last_sample.ack_rtt);
+      }
+    } else if(n->tag[i] != 0) {
+      pending++;
+    }
+  }
+
+  if(pending == 0) {
+    nbr_table_remove(neighbor_delays, n);
+  }
+}
+/*---------------------------------------------------------------------------*/
+const struct delay_sample *
+neighbor_info_delay_sample(void)
+{
+  return last_sample_valid ? &last_sample : NULL;
+}
+/*---------------------------------------------------------------------------*/
+int
+neighbor_info_packet_delay(delay_t *delay)
+{
+  if(!last_sample_valid) {
+    return 0;
+  }
+  /* Time until the frame was received: the one-way part of the ACK
+     round trip is taken as half of it. */
+  *delay = delay_clock_to_ms(last_sample.queueing +
+                             last_sample.channel_access +
+                             last_sample.ack_rtt / 2);
+  return 1;
+}
+/*---------------------------------------------------------------------------*/
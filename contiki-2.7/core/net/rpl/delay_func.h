@@ -1,13 +1,50 @@
+/**
+ * \file
+ *         Per-neighbor MAC delay sampling for the latency-aware
+ *         objective functions.
+ *
+ *         Every unicast frame handed to the MAC layer is stamped with its
+ *         send time in a small per-neighbor queue kept in an nbr_table,
+ *         and tagged with PACKETBUF_ATTR_DELAY_TAG. When the MAC reports
+ *         the outcome of the frame, the tag in packetbuf identifies the
+ *         matching send time, so delay samples are always attributed to
+ *         the link they were measured on.
+ */
+
 #ifndef RPL_DELAY_FUNC_H
 #define RPL_DELAY_FUNC_H
 
-
-
-void time_memb_init();
-void neighbor_info_send_mac(rimeaddr_t *dest) ;
-
-
-
-
+#include "net/delay.h"
+#include "net/rime/rimeaddr.h"
+
+/* Maximum number of frames in flight towards one neighbor. */
+#ifdef NEIGHBOR_INFO_CONF_QUEUE_LEN
+#define NEIGHBOR_INFO_QUEUE_LEN NEIGHBOR_INFO_CONF_QUEUE_LEN
+#else
+#define NEIGHBOR_INFO_QUEUE_LEN 4
+#endif /* NEIGHBOR_INFO_CONF_QUEUE_LEN */
+
+void neighbor_info_init(void);
+
+/* Record the send time of the frame in packetbuf, destined to dest. */
+void neighbor_info_send_mac(const rimeaddr_t *dest);
+
+/*
+ * Match the MAC callback of the frame in packetbuf, sent to dest, with
+ * its send time. Must be called once for every MAC callback.
+ */
+void neighbor_info_sent_mac(const rimeaddr_t *dest, int status);
+
+/*
+ * Get the delay components of the frame whose MAC callback is being
+ * processed, or NULL if no sample is available for it.
+ */
+const struct delay_sample *neighbor_info_delay_sample(void);
+
+/*
+ * Get the delay of the frame whose MAC callback is being processed, in
+ * milliseconds. Returns 0 if no sample is available for it.
+ */
+int neighbor_info_packet_delay(delay_t *delay);
 
 #endif /* RPL_DELAY_FUNC_H */
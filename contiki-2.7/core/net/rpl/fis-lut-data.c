@@ -0,0 +1,190 @@
+/*
+ * Fuzzy QoS and Quality lookup tables.
+ *
+ * Generated by tools/fis-lut/fis-lut-gen -t 0 -d 7 -n 0 -q 2 -e 3
+ * from the breakpoints in core/net/rpl/FIS.h. Do not edit.
+ */
+
+#include "fis-lut.h"
+
+static const struct fis_lut_axis qos_axis[] = {
+  { 0, 13 },
+  { 7, 20 },
+  { 0, 5 }
+};
+
+static const uint8_t qos_table[1300] = {
+   90,  90,  70,  70,  70,  90,  90,  70,  70,  70,  90,  90,
+   70,  70,  70,  90,  90,  70,  70,  70,  90,  90,  70,  70,
+   70,  88,  88,  70,  70,  70,  84,  84,  70,  70,  70,  80,
+   80,  70,  70,  70,  75,  75,  70,  70,  70,  71,  71,  70,
+   70,  70,  70,  70,  70,  70,  70,  70,  70,  70,  70,  70,
+   70,  70,  70,  70,  70,  70,  70,  70,  70,  70,  70,  70,
+   70,  70,  70,  66,  66,  66,  66,  66,  61,  61,  61,  61,
+   61,  57,  57,  57,  57,  57,  53,  53,  53,  53,  53,  50,
+   50,  50,  50,  50,  90,  90,  70,  70,  70,  90,  90,  70,
+   70,  70,  90,  90,  70,  70,  70,  90,  90,  70,  70,  70,
+   90,  90,  70,  70,  70,  88,  88,  70,  70,  70,  84,  84,
+   70,  70,  70,  80,  80,  70,  70,  70,  75,  75,  70,  70,
+   70,  71,  71,  70,  70,  70,  70,  70,  70,  70,  70,  70,
+   70,  70,  70,  70,  70,  70,  70,  70,  70,  70,  70,  70,
+   70,  70,  70,  70,  70,  70,  70,  66,  66,  66,  66,  66,
+   61,  61,  61,  61,  61,  57,  57,  57,  57,  57,  53,  53,
+   53,  53,  53,  50,  50,  50,  50,  50,  90,  90,  70,  70,
+   70,  90,  90,  70,  70,  70,  90,  90,  70,  70,  70,  90,
+   90,  70,  70,  70,  90,  90,  70,  70,  70,  88,  88,  70,
+   70,  70,  84,  84,  70,  70,  70,  80,  80,  70,  70,  70,
+   75,  75,  70,  70,  70,  71,  71,  70,  70,  70,  70,  70,
+   70,  70,  70,  70,  70,  70,  70,  70,  70,  70,  70,  70,
+   70,  70,  70,  70,  70,  70,  70,  70,  70,  70,  70,  66,
+   66,  66,  66,  66,  61,  61,  61,  61,  61,  57,  57,  57,
+   57,  57,  53,  53,  53,  53,  53,  50,  50,  50,  50,  50,
+   90,  90,  70,  70,  70,  90,  90,  70,  70,  70,  90,  90,
+   70,  70,  70,  90,  90,  70,  70,  70,  90,  90,  70,  70,
+   70,  88,  88,  70,  70,  70,  84,  84,  70,  70,  70,  80,
+   80,  70,  70,  70,  75,  75,  70,  70,  70,  71,  71,  70,
+   70,  70,  70,  70,  70,  70,  70,  70,  70,  70,  70,  70,
+   70,  70,  70,  70,  70,  70,  70,  70,  70,  70,  70,  70,
+   70,  70,  70,  66,  66,  66,  66,  66,  61,  61,  61,  61,
+   61,  57,  57,  57,  57,  57,  53,  53,  53,  53,  53,  50,
+   50,  50,  50,  50,  83,  83,  70,  70,  70,  83,  83,  70,
+   70,  70,  83,  83,  70,  70,  70,  83,  83,  70,  70,  70,
+   83,  83,  70,  70,  70,  81,  81,  68,  68,  68,  76,  76,
+   64,  64,  64,  72,  72,  62,  62,  62,  69,  69,  63,  63,
+   63,  65,  65,  63,  63,  63,  63,  63,  63,  63,  63,  63,
+   63,  63,  63,  63,  63,  63,  63,  63,  63,  63,  63,  63,
+   63,  63,  63,  63,  63,  63,  63,  57,  57,  57,  57,  57,
+   53,  53,  53,  53,  53,  50,  50,  50,  50,  50,  46,  46,
+   46,  46,  46,  43,  43,  43,  43,  43,  76,  76,  70,  70,
+   70,  76,  76,  70,  70,  70,  76,  76,  70,  70,  70,  76,
+   76,  70,  70,  70,  76,  76,  70,  70,  70,  75,  75,  68,
+   68,  68,  70,  70,  64,  64,  64,  67,  67,  60,  60,  60,
+   64,  64,  56,  56,  56,  59,  59,  56,  56,  56,  56,  56,
+   56,  56,  56,  56,  56,  56,  56,  56,  56,  56,  56,  56,
+   56,  56,  56,  56,  56,  56,  56,  56,  56,  56,  56,  52,
+   52,  52,  52,  52,  48,  48,  48,  48,  48,  45,  45,  45,
+   45,  45,  41,  41,  41,  41,  41,  36,  36,  36,  36,  36,
+   70,  70,  70,  70,  70,  70,  70,  70,  70,  70,  70,  70,
+   70,  70,  70,  70,  70,  70,  70,  70,  70,  70,  70,  70,
+   70,  68,  68,  68,  68,  68,  64,  64,  64,  64,  64,  60,
+   60,  60,  60,  60,  55,  55,  55,  55,  55,  51,  51,  51,
+   51,  51,  50,  50,  50,  50,  50,  50,  50,  50,  50,  50,
+   50,  50,  50,  50,  50,  50,  50,  50,  50,  50,  50,  50,
+   50,  50,  50,  46,  46,  46,  46,  46,  41,  41,  41,  41,
+   41,  37,  37,  37,  37,  37,  33,  33,  33,  33,  33,  30,
+   30,  30,  30,  30,  70,  70,  70,  70,  70,  70,  70,  70,
+   70,  70,  70,  70,  70,  70,  70,  70,  70,  70,  70,  70,
+   70,  70,  70,  70,  70,  68,  68,  68,  68,  68,  64,  64,
+   64,  64,  64,  60,  60,  60,  60,  60,  55,  55,  55,  55,
+   55,  51,  51,  51,  51,  51,  50,  50,  50,  50,  50,  50,
+   50,  50,  50,  50,  50,  50,  50,  50,  50,  50,  50,  50,
+   50,  50,  50,  50,  50,  50,  50,  46,  46,  46,  46,  46,
+   41,  41,  41,  41,  41,  37,  37,  37,  37,  37,  33,  33,
+   33,  33,  33,  30,  30,  30,  30,  30,  70,  70,  70,  70,
+   70,  70,  70,  70,  70,  70,  70,  70,  70,  70,  70,  70,
+   70,  70,  70,  70,  70,  70,  70,  70,  70,  68,  68,  68,
+   68,  68,  64,  64,  64,  64,  64,  60,  60,  60,  60,  60,
+   55,  55,  55,  55,  55,  51,  51,  51,  51,  51,  50,  50,
+   50,  50,  50,  50,  50,  50,  50,  50,  50,  50,  50,  50,
+   50,  50,  50,  50,  50,  50,  50,  50,  50,  50,  50,  46,
+   46,  46,  46,  46,  41,  41,  41,  41,  41,  37,  37,  37,
+   37,  37,  33,  33,  33,  33,  33,  30,  30,  30,  30,  30,
+   70,  70,  70,  70,  70,  70,  70,  70,  70,  70,  70,  70,
+   70,  70,  70,  70,  70,  70,  70,  70,  70,  70,  70,  70,
+   70,  68,  68,  68,  68,  68,  64,  64,  64,  64,  64,  60,
+   60,  60,  60,  60,  55,  55,  55,  55,  55,  51,  51,  51,
+   51,  51,  50,  50,  50,  50,  50,  50,  50,  50,  50,  50,
+   50,  50,  50,  50,  50,  50,  50,  50,  50,  50,  50,  50,
+   50,  50,  50,  46,  46,  46,  46,  46,  41,  41,  41,  41,
+   41,  37,  37,  37,  37,  37,  33,  33,  33,  33,  33,  30,
+   30,  30,  30,  30,  63,  63,  63,  63,  63,  63,  63,  63,
+   63,  63,  63,  63,  63,  63,  63,  63,  63,  63,  63,  63,
+   63,  63,  63,  63,  63,  61,  61,  61,  61,  61,  56,  56,
+   56,  56,  56,  52,  52,  52,  52,  52,  49,  49,  49,  49,
+   49,  45,  45,  45,  45,  45,  43,  43,  43,  43,  43,  43,
+   43,  43,  43,  43,  43,  43,  43,  43,  43,  43,  43,  43,
+   43,  43,  43,  43,  43,  43,  43,  43,  43,  43,  43,  37,
+   41,  41,  41,  41,  33,  37,  37,  37,  37,  30,  33,  33,
+   33,  33,  26,  30,  30,  30,  30,  23,  56,  56,  56,  56,
+   56,  56,  56,  56,  56,  56,  56,  56,  56,  56,  56,  56,
+   56,  56,  56,  56,  56,  56,  56,  56,  56,  55,  55,  55,
+   55,  55,  50,  50,  50,  50,  50,  47,  47,  47,  47,  47,
+   44,  44,  44,  44,  44,  39,  39,  39,  39,  39,  36,  36,
+   36,  36,  36,  36,  36,  36,  36,  36,  36,  36,  36,  36,
+   36,  36,  36,  36,  36,  36,  36,  36,  36,  36,  36,  36,
+   36,  36,  36,  32,  37,  37,  37,  37,  28,  36,  36,  36,
+   36,  25,  33,  33,  33,  33,  21,  30,  30,  30,  30,  16,
+   50,  50,  50,  50,  50,  50,  50,  50,  50,  50,  50,  50,
+   50,  50,  50,  50,  50,  50,  50,  50,  50,  50,  50,  50,
+   50,  48,  48,  48,  48,  48,  44,  44,  44,  44,  44,  40,
+   40,  40,  40,  40,  35,  35,  35,  35,  35,  31,  31,  31,
+   31,  31,  30,  30,  30,  30,  30,  30,  30,  30,  30,  30,
+   30,  30,  30,  30,  30,  30,  30,  30,  30,  30,  30,  30,
+   30,  30,  30,  30,  30,  30,  30,  26,  30,  30,  30,  30,
+   21,  30,  30,  30,  30,  17,  30,  30,  30,  30,  13,  30,
+   30,  30,  30,  10
+};
+
+const struct fis_lut fis_lut_qos = { qos_axis, qos_table, 3 };
+
+static const struct fis_lut_axis quality_axis[] = {
+  { 2, 23 },
+  { 3, 27 }
+};
+
+static const uint8_t quality_table[621] = {
+    9,   9,   9,   9,   9,   9,   9,  10,  12,  13,  15,  17,
+   19,  21,  21,  21,  21,  21,  21,  21,  24,  29,  33,  37,
+   42,  46,  49,   9,   9,   9,   9,   9,   9,   9,  10,  12,
+   13,  15,  17,  19,  21,  21,  21,  21,  21,  21,  21,  24,
+   29,  33,  37,  42,  46,  49,   9,   9,   9,   9,   9,   9,
+    9,  10,  12,  13,  15,  17,  19,  21,  21,  21,  21,  21,
+   21,  21,  24,  29,  33,  37,  42,  46,  49,   9,   9,   9,
+    9,   9,   9,   9,  10,  12,  13,  15,  17,  19,  21,  21,
+   21,  21,  21,  21,  21,  24,  29,  33,  37,  42,  46,  49,
+   10,  10,  10,  10,  10,  10,  10,  12,  14,  15,  17,  19,
+   20,  22,  22,  22,  22,  22,  22,  22,  25,  29,  33,  37,
+   41,  45,  49,  15,  15,  15,  15,  15,  15,  15,  16,  19,
+   20,  22,  23,  26,  28,  28,  28,  28,  28,  28,  28,  30,
+   32,  34,  36,  38,  43,  49,  19,  19,  19,  19,  19,  19,
+   19,  21,  23,  25,  27,  29,  31,  33,  33,  33,  33,  33,
+   33,  33,  35,  37,  39,  41,  43,  45,  49,  21,  21,  21,
+   21,  21,  21,  21,  22,  24,  26,  28,  31,  33,  35,  35,
+   35,  35,  35,  35,  35,  36,  39,  41,  43,  45,  47,  49,
+   21,  21,  21,  21,  21,  21,  21,  22,  24,  26,  28,  31,
+   33,  35,  35,  35,  35,  35,  35,  35,  36,  39,  41,  43,
+   45,  47,  49,  22,  22,  22,  22,  22,  22,  22,  24,  26,
+   28,  30,  32,  34,  36,  36,  36,  36,  36,  36,  36,  39,
+   41,  43,  45,  47,  49,  50,  28,  28,  28,  28,  28,  28,
+   28,  29,  32,  34,  35,  37,  39,  42,  42,  42,  42,  42,
+   42,  42,  44,  46,  48,  49,  51,  54,  56,  33,  33,  33,
+   33,  33,  33,  33,  35,  37,  39,  41,  43,  45,  47,  47,
+   47,  47,  47,  47,  47,  49,  51,  53,  55,  57,  59,  61,
+   35,  35,  35,  35,  35,  35,  35,  36,  38,  40,  42,  45,
+   47,  49,  49,  49,  49,  49,  49,  49,  50,  53,  55,  57,
+   59,  61,  63,  35,  35,  35,  35,  35,  35,  35,  36,  38,
+   40,  42,  45,  47,  49,  49,  49,  49,  49,  49,  49,  50,
+   53,  55,  57,  59,  61,  63,  36,  36,  36,  36,  36,  36,
+   36,  38,  40,  42,  44,  46,  48,  50,  50,  50,  50,  50,
+   50,  50,  53,  55,  57,  59,  61,  63,  64,  42,  42,  42,
+   42,  42,  42,  42,  43,  46,  48,  49,  51,  53,  56,  56,
+   56,  56,  56,  56,  56,  58,  60,  62,  63,  65,  68,  70,
+   47,  47,  47,  47,  47,  47,  47,  49,  51,  53,  55,  57,
+   59,  61,  61,  61,  61,  61,  61,  61,  63,  65,  67,  69,
+   71,  73,  75,  49,  49,  49,  49,  49,  49,  49,  50,  52,
+   54,  56,  59,  61,  63,  63,  63,  63,  63,  63,  63,  64,
+   67,  69,  71,  73,  75,  77,  49,  49,  49,  49,  49,  49,
+   49,  50,  52,  54,  56,  59,  61,  63,  63,  63,  63,  63,
+   63,  63,  64,  67,  69,  71,  73,  75,  77,  49,  49,  49,
+   49,  49,  49,  49,  52,  54,  56,  58,  60,  62,  64,  64,
+   64,  64,  64,  64,  64,  67,  69,  71,  73,  75,  77,  78,
+   49,  49,  49,  49,  49,  49,  49,  54,  59,  62,  63,  65,
+   67,  70,  70,  70,  70,  70,  70,  70,  72,  74,  76,  77,
+   79,  82,  84,  49,  49,  49,  49,  49,  49,  49,  52,  56,
+   60,  64,  68,  72,  75,  75,  75,  75,  75,  75,  75,  77,
+   79,  81,  83,  85,  87,  89,  49,  49,  49,  49,  49,  49,
+   49,  51,  56,  60,  64,  69,  73,  77,  77,  77,  77,  77,
+   77,  77,  78,  81,  83,  85,  87,  89,  91
+};
+
+const struct fis_lut fis_lut_quality = { quality_axis, quality_table, 2 };
@@ -0,0 +1,82 @@
+/**
+ * \file
+ *         Multilinear interpolation over the precomputed fuzzy LUTs.
+ */
+
+#include "fis-lut.h"
+
+/*---------------------------------------------------------------------------*/
+uint8_t
+fis_lut_eval(const struct fis_lut *lut, const uint16_t *x)
+{
+  uint8_t idx[FIS_MAX_INPUTS];
+  uint16_t frac[FIS_MAX_INPUTS];
+  uint16_t max, off;
+  uint32_t w, acc;
+  uint8_t i, c, shift;
+
+  shift = 0;
+  for(i = 0; i < lut->inputs; i++) {
+    max = (uint16_t)(lut->axis[i].points - 1) << lut->axis[i].shift;
+    if(x[i] >= max) {
+      /* The fuzzy system is constant beyond the last breakpoint. */
+      idx[i] = lut->axis[i].points - 1;
+      frac[i] = 0;
+    } else {
+      idx[i] = x[i] >> lut->axis[i].shift;
+      frac[i] = x[i] & ((1 << lut->axis[i].shift) - 1);
+    }
+    shift += lut->axis[i].shift;
+  }
+
+  /* Sum the weighted corners of the enclosing hypercube. */
+  acc = 0;
+  for(c = 0; c < (1 << lut->inputs); c++) {
+    w = 1;
+    off = 0;
+    for(i = 0; i < lut->inputs; i++) {
+      off *= lut->axis[i].points;
+      if(c & (1 << i)) {
+        if(frac[i] == 0) {
+          w = 0;
+          break;
+        }
+        w *= frac[i];
+        off += idx[i] + 1;
+      } else {
+        w *= (1 << lut->axis[i].shift) - frac[i];
+        off += idx[i];
+      }
+    }
+    if(w != 0) {
+      acc += w * lut->table[off];
+    }
+  }
+
+  if(shift == 0) {
+    return acc;
+  }
+  return (acc + ((uint32_t)1 << (shift - 1))) >> shift;
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+qos_lut(uint16_t etx, uint16_t delay, uint16_t hc)
+{
+  uint16_t x[3];
+
+  x[0] = etx;
+  x[1] = delay;
+  x[2] = hc;
+  return fis_lut_eval(&fis_lut_qos, x);
+}
+/*---------------------------------------------------------------------------*/
+uint8_t
+quality_lut(uint16_t q, uint16_t e)
+{
+  uint16_t x[2];
+
+  x[0] = q;
+  x[1] = e;
+  return fis_lut_eval(&fis_lut_quality, x);
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,43 @@
+/**
+ * \file
+ *         Precomputed lookup tables for the fuzzy QoS and Quality
+ *         functions of FIS.c.
+ *
+ *         The tables are produced on the host by tools/fis-lut and
+ *         stored in flash (fis-lut-data.c). Each input axis is sampled
+ *         every 2^shift units and values between samples are obtained
+ *         by multilinear interpolation, so a lookup needs only shifts,
+ *         multiplications and additions. The tables must be
+ *         regenerated whenever the breakpoints in FIS.h are changed.
+ */
+
+#ifndef FIS_LUT_H
+#define FIS_LUT_H
+
+#include <stdint.h>
+#include "FIS.h"
+
+/* One input axis of a LUT: samples at 0, 2^shift, ..., (points-1) << shift. */
+struct fis_lut_axis {
+  uint8_t shift;
+  uint8_t points;
+};
+
+/* A LUT in row-major order of its axes (the last axis varies fastest). */
+struct fis_lut {
+  const struct fis_lut_axis *axis;
+  const uint8_t *table;
+  uint8_t inputs;
+};
+
+/* Look up the value of a LUT for the input vector x. */
+uint8_t fis_lut_eval(const struct fis_lut *lut, const uint16_t *x);
+
+extern const struct fis_lut fis_lut_qos;
+extern const struct fis_lut fis_lut_quality;
+
+/* LUT counterparts of qos() and quality(). */
+uint8_t qos_lut(uint16_t etx, uint16_t delay, uint16_t hc);
+uint8_t quality_lut(uint16_t q, uint16_t e);
+
+#endif /* FIS_LUT_H */
@@ -3,25 +3,36 @@
 #include "net/nbr-table.h"
 #include "net/delay.h"
 #include "delay_func.h"
-#include "lib/list.h"
-#include "lib/memb.h"
 #include "net/rpl/battery.h"
 #include "net/rpl/FIS.h"
+/* QoS and quality are both in Q8.8, so that the QoS is not truncated
+   on its way from one fuzzy system to the other. */
+#if RPL_FUZZY_LUT
+#include "net/rpl/fis-lut.h"
+#define FUZZY_QOS(etx, delay, hc)   \
+  ((uint16_t)qos_lut(etx, delay, hc) << FIS_OUT_FRAC_BITS)
+#define FUZZY_QUALITY(q, e)         \
+  ((uint16_t)quality_lut((q) >> FIS_OUT_FRAC_BITS, e) << FIS_OUT_FRAC_BITS)
+#else
+#define FUZZY_QOS(etx, delay, hc)   qos_fine(etx, delay, hc)
+#define FUZZY_QUALITY(q, e)         quality_fine(q, e)
+#endif /* RPL_FUZZY_LUT */
 #define DLY_SCALE	100
 #define DLY_ALPHA	90
-extern unsigned long before_trans;
-extern unsigned long after_ack;
-MEMB(time_memb, struct time_queue, MAX_QUEUED_PACKETS);
-LIST(time_list);
 
 
-#define QUALITY_MAX 100
-#define QUALITY_RANK_DIVISOR 10
+/* Qualities are kept in Q8.8 so that close parents can be told apart. */
+#define QUALITY_MAX ((uint16_t)100 << FIS_OUT_FRAC_BITS)
+#define QUALITY_RANK_DIVISOR ((uint32_t)10 << FIS_OUT_FRAC_BITS)
 #define DEFAULT_RANK_INCREMENT  RPL_MIN_HOPRANKINC
 #define HOPCOUNT_MAX 50
 #define MAX_PACKET_DELAY
 
+#ifdef RPL_FUZZYOF_CONF_DEBUG
+#define DEBUG RPL_FUZZYOF_CONF_DEBUG
+#else
 #define DEBUG DEBUG_PRINT
+#endif
 #include "net/uip-debug.h"
 
 static void reset(rpl_dag_t *);
@@ -54,8 +65,8 @@ rpl_of_t rpl_fuzzyof = {
 
 
 /*
- * The rank must differ more than 1/PARENT_SWITCH_THRESHOLD_DIV in order
- * to switch preferred parent.
+ * The quality must differ by at least PARENT_SWITCH_THRESHOLD_DIV points
+ * in order to switch preferred parent.
  */
 #define PARENT_SWITCH_THRESHOLD_DIV	2
 
@@ -64,8 +75,7 @@ typedef uint16_t rpl_path_metric_t;
 
 static uint8_t calculate_energy_metric(rpl_parent_t *p)
 {
-  battery_charge_set();
-  uint8_t ener = battery_charge_value;
+  uint8_t ener = battery_charge();
   PRINTF("BAT: %u\n", ener);
   return ener;
 }
@@ -100,10 +110,21 @@ calculate_path_metric(rpl_parent_t *p)
 return p->mc.obj.etx + (uint16_t)p->link_metric;
 }
 
-static uint8_t
+/*
+ * The quality of a parent only depends on its metric container and link
+ * metrics, so it is cached in the parent and recomputed only after
+ * RPL_PARENT_INVALIDATE_QUALITY() has been called on it.
+ */
+static uint16_t
 calculate_quality_metric(rpl_parent_t *p)
 {
-  return quality(qos((p->mc.obj.etx)/RPL_DAG_MC_ETX_DIVISOR, p->mc.obj.latency, p->mc.obj.hopcount), p->mc.obj.energy.energy_est);
+  if(p == NULL) {
+    return 0;
+  }
+  if(p->quality == RPL_PARENT_QUALITY_UNKNOWN) {
+    p->quality = FUZZY_QUALITY(FUZZY_QOS((p->mc.obj.etx)/RPL_DAG_MC_ETX_DIVISOR, p->mc.obj.latency, p->mc.obj.hopcount), p->mc.obj.energy.energy_est);
+  }
+  return p->quality;
 }
 
 static void
@@ -115,9 +136,11 @@ reset(rpl_dag_t *sag)
 static void
 neighbor_link_callback(rpl_parent_t *p, int status, int numtx){
 
-  struct time_queue *item;
   delay_t packet_delay,  new_delay;
   delay_t recorded_delay= p->delay_metric;
+#if DEBUG
+  const struct delay_sample *sample;
+#endif
 
   uint16_t recorded_etx = p->link_metric;
   uint16_t packet_etx = numtx * RPL_DAG_MC_ETX_DIVISOR;
@@ -126,19 +149,24 @@ neighbor_link_callback(rpl_parent_t *p, int status, int numtx){
   /* Do not penalize the ETX when collisions or transmission errors occur. */
   if(status == MAC_TX_OK || status == MAC_TX_NOACK) {
     if(status == MAC_TX_OK) {
-    if(list_length(time_list) > 0){
-	  item = list_pop(time_list);
-	  packet_delay = (before_trans - item->before_mac) + (after_ack - before_trans)/2;
-	  memb_free(&time_memb,item); 
-    } 
+      /* Keep the current estimate if the frame could not be matched
+         with its send time. */
+      if(!neighbor_info_packet_delay(&packet_delay)) {
+        packet_delay = recorded_delay;
+      }
+#if DEBUG
+      else {
+        sample = neighbor_info_delay_sample();
+        PRINTF("RPL: delay sample queueing %lu access %lu ack rtt %lu (ticks)\n",
+            (unsigned long)sample->queueing,
+            (unsigned long)sample->channel_access,
+            (unsigned long)sample->ack_rtt);
+      }
+#endif
     }
     else if(status == MAC_TX_NOACK) {
       packet_etx = MAX_LINK_METRIC * RPL_DAG_MC_ETX_DIVISOR;
       packet_delay= 50;
-      if(list_length(time_list) > 0){
-		item = list_pop(time_list);
-		memb_free(&time_memb,item);
-	}
     }
     
     new_etx = ((uint32_t)recorded_etx * ETX_ALPHA +
@@ -152,19 +180,16 @@ neighbor_link_callback(rpl_parent_t *p, int status, int numtx){
     if(packet_delay > MAX_DELAY) packet_delay = MAX_DELAY;
     new_delay = (recorded_delay * DLY_ALPHA + packet_delay * (DLY_SCALE - DLY_ALPHA)) / DLY_SCALE;
     p->delay_metric = new_delay;
+    if(new_etx != recorded_etx || new_delay != recorded_delay) {
+      RPL_PARENT_INVALIDATE_QUALITY(p);
+    }
 
     PRINTF("RPL: delay changed from %u to %u (packet delay = %u)\n",
         (unsigned)(recorded_delay),
         (unsigned)(new_delay),
         (unsigned)(packet_delay));        
-
-  }else{
-    if(list_length(time_list) > 0){
-		item = list_pop(time_list);
-		memb_free(&time_memb,item);  
   }
 }
-}
 
 static rpl_rank_t
 calculate_rank(rpl_parent_t *p, rpl_rank_t base_rank)
@@ -179,7 +204,7 @@ calculate_rank(rpl_parent_t *p, rpl_rank_t base_rank)
     rank_increase = DEFAULT_RANK_INCREMENT;
   } else {
     rank_increase = p->dag->instance->min_hoprankinc +
-	    		((QUALITY_MAX - calculate_quality_metric(p)) * p->dag->instance->min_hoprankinc)/QUALITY_RANK_DIVISOR;
+	    		((uint32_t)(QUALITY_MAX - calculate_quality_metric(p)) * p->dag->instance->min_hoprankinc)/QUALITY_RANK_DIVISOR;
     if(base_rank == 0) {
       base_rank = p->rank;
     }
@@ -221,7 +246,7 @@ best_parent(rpl_parent_t *p1, rpl_parent_t *p2)
 
   dag = p1->dag; /* Both parents are in the same DAG. */
 
-  min_diff = PARENT_SWITCH_THRESHOLD_DIV;
+  min_diff = PARENT_SWITCH_THRESHOLD_DIV << FIS_OUT_FRAC_BITS;
 
   p1_metric = calculate_quality_metric(p1);
   p2_metric = calculate_quality_metric(p2);
@@ -229,11 +254,9 @@ best_parent(rpl_parent_t *p1, rpl_parent_t *p2)
   /* Maintain stability of the preferred parent in case of similar ranks. */
   if(p1 == dag->preferred_parent || p2 == dag->preferred_parent) {
     if(p1_metric < p2_metric + min_diff &&
-       p1_metric > p2_metric - min_diff) {
-      PRINTF("RPL: FUZZY OF hysteresis: %u <= %u <= %u\n",
-             p2_metric - min_diff,
-             p1_metric,
-             p2_metric + min_diff);
+       p2_metric < p1_metric + min_diff) {
+      PRINTF("RPL: FUZZY OF hysteresis: %u ~ %u (Q8.8)\n",
+             p1_metric, p2_metric);
       return dag->preferred_parent;
     }
   }
@@ -246,10 +269,14 @@ static void
 update_metric_container(rpl_instance_t *instance)
 {
   rpl_path_metric_t path_metric, delay_metric, hopcount;
-  uint8_t quality, energy;
-uint8_t qos1;
+  uint8_t energy;
   rpl_dag_t *dag;
-  instance->mc.type = RPL_DAG_MC;
+#if DEBUG
+  uint16_t quality;
+  uint16_t qos1;
+#endif
+
+  instance->mc.type = RPL_DAG_MC_FUZZY;
   instance->mc.flags = RPL_DAG_MC_FLAG_P;
   instance->mc.aggr = RPL_DAG_MC_AGGR_ADDITIVE;
   instance->mc.prec = 0;
@@ -277,38 +304,20 @@ instance->mc.length = 8;
     instance->mc.obj.energy.flags = RPL_DAG_MC_ENERGY_TYPE_BATTERY << RPL_DAG_MC_ENERGY_TYPE;
   }
 
+  instance->mc.obj.etx = path_metric;
+  instance->mc.obj.latency = delay_metric;
+  instance->mc.obj.hopcount = hopcount;
+  instance->mc.obj.energy.energy_est= energy;
 
-   rpl_path_metric_t et, l, h;
-   uint8_t e;
-  et = instance->mc.obj.etx = path_metric;
-  l = instance->mc.obj.latency = delay_metric;
-  h = instance->mc.obj.hopcount = hopcount;
-  e = instance->mc.obj.energy.energy_est= energy;
+#if DEBUG
   quality= calculate_quality_metric(dag->preferred_parent);
-qos1 = qos((dag->preferred_parent->mc.obj.etx)/RPL_DAG_MC_ETX_DIVISOR, dag->preferred_parent->mc.obj.latency, dag->preferred_parent->mc.obj.hopcount);
+qos1 = 0;
+  if(dag->preferred_parent != NULL) {
+    qos1 = FUZZY_QOS((dag->preferred_parent->mc.obj.etx)/RPL_DAG_MC_ETX_DIVISOR, dag->preferred_parent->mc.obj.latency, dag->preferred_parent->mc.obj.hopcount);
+  }
 
   PRINTF(" ETX is %u , LATENCY is %u , HC is %u , ENERGY is %u, Quality is %u , qos is %u.\n",
-	et / RPL_DAG_MC_ETX_DIVISOR, l, h,
-  e, (unsigned)quality, (unsigned) qos1);
-
+	path_metric / RPL_DAG_MC_ETX_DIVISOR, delay_metric, hopcount,
+  energy, (unsigned)(quality >> FIS_OUT_FRAC_BITS), (unsigned)(qos1 >> FIS_OUT_FRAC_BITS));
+#endif
 }
-
-void neighbor_info_send_mac (rimeaddr_t *dest) {
-    struct time_queue *item;
-    if(!rimeaddr_cmp(dest,&rimeaddr_null)){
-    	item = memb_alloc(&time_memb);
-    	if(item != NULL){
-    		item->dest = *dest;
-    		item->before_mac = (clock_time()*1000)/CLOCK_SECOND;
-    		list_add(time_list,item);
-    	}
-    	else {
-    		printf("delay: could not allocate time_memb\n");
-    	}
-    }
-}
-
-void time_memb_init(){
-    memb_init(&time_memb);
-}
-
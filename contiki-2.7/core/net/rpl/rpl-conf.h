@@ -39,6 +39,9 @@
 #define RPL_CONF_H
 
 #include "contiki-conf.h"
+/* Several defaults below depend on CONTIKI_DELAY, which must be seen the
+   same way by every file, whether or not it includes contiki.h first. */
+#include "contiki-default-conf.h"
 
 /* Set to 1 to enable RPL statistics */
 #ifndef RPL_CONF_STATS
@@ -78,6 +81,59 @@
 #endif /* CONTIKI_DELAY */
 #endif /* RPL_CONF_OF */
 
+/*
+ * Maximum number of objective functions known to this node. RPL_OF is
+ * always known; others are added at runtime with rpl_register_of(), so
+ * that instances using them can be created or joined next to the
+ * instances using RPL_OF.
+ */
+#ifdef RPL_CONF_MAX_OFS
+#define RPL_MAX_OFS RPL_CONF_MAX_OFS
+#else
+#define RPL_MAX_OFS 3
+#endif /* RPL_CONF_MAX_OFS */
+
+/*
+ * When set, the fuzzy objective function evaluates QoS and Quality
+ * through the precomputed lookup tables of fis-lut-data.c instead of
+ * running the fuzzy inference engine. The tables are regenerated with
+ * tools/fis-lut whenever the breakpoints in FIS.h change. The tables
+ * are only built when RPL_FUZZY_LUT=1 is set in the Makefile of the
+ * project, which also sets this option.
+ */
+#ifdef RPL_CONF_FUZZY_LUT
+#define RPL_FUZZY_LUT RPL_CONF_FUZZY_LUT
+#else
+#define RPL_FUZZY_LUT 0
+#endif /* RPL_CONF_FUZZY_LUT */
+
+/*
+ * Non-storing mode of operation (RFC 6550, section 9.7). DAOs are sent
+ * to the DAG root, which keeps a parent graph of the whole DODAG and
+ * reaches the nodes with RFC 6554 source routing headers; routers
+ * below the root forward on the routing header and hold no downward
+ * routes. Enabling it makes RPL_MOP_NON_STORING the default MOP.
+ */
+#ifdef RPL_CONF_WITH_NON_STORING
+#define RPL_WITH_NON_STORING RPL_CONF_WITH_NON_STORING
+#else
+#define RPL_WITH_NON_STORING 0
+#endif /* RPL_CONF_WITH_NON_STORING */
+
+/*
+ * Number of child-parent links the root of a non-storing DAG can
+ * remember. Nodes below the root do not use this table, so nodes that
+ * never become a root should set it to 0 to leave the table out. A
+ * node with no table ignores the DAOs it receives as a root.
+ */
+#ifdef RPL_NS_CONF_LINK_NUM
+#define RPL_NS_LINK_NUM RPL_NS_CONF_LINK_NUM
+#elif defined(RPL_CONF_LEAF_ONLY) && RPL_CONF_LEAF_ONLY
+#define RPL_NS_LINK_NUM 0
+#else
+#define RPL_NS_LINK_NUM 32
+#endif /* RPL_NS_CONF_LINK_NUM */
+
 /* This value decides which DAG instance we should participate in by default. */
 #ifdef RPL_CONF_DEFAULT_INSTANCE
 #define RPL_DEFAULT_INSTANCE RPL_CONF_DEFAULT_INSTANCE
@@ -165,6 +221,24 @@
 #else
 #define RPL_DIO_REDUNDANCY          10
 #endif
+/*
+ * Hysteresis of the DIO Trickle timer, as a percentage. When non-zero,
+ * the timer is reset by a change of rank or metric container only when
+ * one of them has moved by more than this fraction since the last
+ * reset, and DIOs whose rank is within this fraction of the rank last
+ * heard from the sender count as consistent for DIO suppression. With
+ * 0, every parent switch resets the timer and only DIOs with an
+ * unchanged rank are consistent. The slowly drifting battery and delay
+ * metrics of the fuzzy OF make the hysteresis the default there.
+ */
+#ifdef RPL_CONF_DIO_HYSTERESIS
+#define RPL_DIO_HYSTERESIS          RPL_CONF_DIO_HYSTERESIS
+#elif CONTIKI_DELAY
+#define RPL_DIO_HYSTERESIS          10
+#else
+#define RPL_DIO_HYSTERESIS          0
+#endif /* RPL_CONF_DIO_HYSTERESIS */
+
 /*Initial delay attributed to a link when the Latency is unknown*/
 #define RPL_INIT_DELAY_METRIC        10
 /*
@@ -64,7 +64,7 @@
 #if UIP_CONF_IPV6
 /*---------------------------------------------------------------------------*/
 extern rpl_of_t RPL_OF;
-static rpl_of_t * const objective_functions[] = {&RPL_OF};
+static rpl_of_t *objective_functions[RPL_MAX_OFS] = {&RPL_OF};
 
 /*---------------------------------------------------------------------------*/
 /* RPL definitions. */
@@ -239,11 +239,22 @@ get_dag(uint8_t instance_id, uip_ipaddr_t *dag_id)
 /*---------------------------------------------------------------------------*/
 rpl_dag_t *
 rpl_set_root(uint8_t instance_id, uip_ipaddr_t *dag_id)
+{
+  return rpl_set_root_with_of(instance_id, dag_id, &RPL_OF);
+}
+/*---------------------------------------------------------------------------*/
+rpl_dag_t *
+rpl_set_root_with_of(uint8_t instance_id, uip_ipaddr_t *dag_id, rpl_of_t *of)
 {
   rpl_dag_t *dag;
   rpl_instance_t *instance;
   uint8_t version;
 
+  if(!rpl_register_of(of)) {
+    PRINTF("RPL: No room for the objective function of the DAG\n");
+    return NULL;
+  }
+
   version = RPL_LOLLIPOP_INIT;
   dag = get_dag(instance_id, dag_id);
   if(dag != NULL) {
@@ -268,7 +279,7 @@ rpl_set_root(uint8_t instance_id, uip_ipaddr_t *dag_id)
   dag->joined = 1;
   dag->grounded = RPL_GROUNDED;
   instance->mop = RPL_MOP_DEFAULT;
-  instance->of = &RPL_OF;
+  instance->of = of;
   rpl_set_preferred_parent(dag, NULL);
 
   memcpy(&dag->dag_id, dag_id, sizeof(dag->dag_id));
@@ -297,7 +308,10 @@ rpl_set_root(uint8_t instance_id, uip_ipaddr_t *dag_id)
   instance->current_dag = dag;
   instance->dtsn_out = RPL_LOLLIPOP_INIT;
   instance->of->update_metric_container(instance);
-  default_instance = instance;
+  /* The first instance set up stays the default one. */
+  if(default_instance == NULL || !default_instance->used) {
+    default_instance = instance;
+  }
 
   PRINTF("RPL: Node set to be a DAG root with DAG ID ");
   PRINT6ADDR(&dag->dag_id);
@@ -405,6 +419,15 @@ rpl_set_prefix(rpl_dag_t *dag, uip_ipaddr_t *prefix, unsigned len)
 int
 rpl_set_default_route(rpl_instance_t *instance, uip_ipaddr_t *from)
 {
+  /*
+   * Only the default instance installs a default router. Two instances
+   * with the same parent would otherwise share one entry, and other
+   * instances send through their own preferred parent anyway.
+   */
+  if(instance != default_instance) {
+    from = NULL;
+  }
+
   if(instance->def_route != NULL) {
     PRINTF("RPL: Removing default route through ");
     PRINT6ADDR(&instance->def_route->ipaddr);
@@ -486,7 +509,22 @@ rpl_alloc_dag(uint8_t instance_id, uip_ipaddr_t *dag_id)
 void
 rpl_set_default_instance(rpl_instance_t *instance)
 {
+  rpl_dag_t *dag;
+
+  if(default_instance != NULL && default_instance != instance) {
+    rpl_set_default_route(default_instance, NULL);
+  }
+
   default_instance = instance;
+
+  /* Move the default router to the preferred parent of the instance. */
+  if(instance != NULL) {
+    dag = instance->current_dag;
+    if(dag != NULL && dag->joined && dag->preferred_parent != NULL) {
+      rpl_set_default_route(instance,
+                            rpl_get_parent_ipaddr(dag->preferred_parent));
+    }
+  }
 }
 /*---------------------------------------------------------------------------*/
 void
@@ -560,6 +598,7 @@ rpl_add_parent(rpl_dag_t *dag, rpl_dio_t *dio, uip_ipaddr_t *addr)
 #if RPL_DAG_MC != RPL_DAG_MC_NONE
     memcpy(&p->mc, &dio->mc, sizeof(p->mc));
 #endif /* RPL_DAG_MC != RPL_DAG_MC_NONE */
+    RPL_PARENT_INVALIDATE_QUALITY(p);
   }
 
   return p;
@@ -680,7 +719,12 @@ rpl_select_dag(rpl_instance_t *instance, rpl_parent_t *p)
     PRINTF("RPL: Changed preferred parent, rank changed from %u to %u\n",
   	(unsigned)old_rank, best_dag->rank);
     RPL_STAT(rpl_stats.parent_switch++);
-    if(instance->mop != RPL_MOP_NO_DOWNWARD_ROUTES) {
+    if(RPL_IS_NON_STORING(instance)) {
+      /* The DAO announcing the new parent replaces the link at the
+         root, and the links of the sub-DODAG are unchanged: neither a
+         No-Path DAO nor new DAOs from the children are needed. */
+      rpl_schedule_dao(instance);
+    } else if(instance->mop != RPL_MOP_NO_DOWNWARD_ROUTES) {
       if(last_parent != NULL) {
         /* Send a No-Path DAO to the removed preferred parent. */
         dao_output(last_parent, RPL_ZERO_LIFETIME);
@@ -689,10 +733,15 @@ rpl_select_dag(rpl_instance_t *instance, rpl_parent_t *p)
       RPL_LOLLIPOP_INCREMENT(instance->dtsn_out);
       rpl_schedule_dao(instance);
     }
-    rpl_reset_dio_timer(instance);
-  } else if(best_dag->rank != old_rank) {
-    PRINTF("RPL: Preferred parent update, rank changed from %u to %u\n",
-  	(unsigned)old_rank, best_dag->rank);
+    rpl_dio_metric_changed(instance);
+  } else {
+    if(best_dag->rank != old_rank) {
+      PRINTF("RPL: Preferred parent update, rank changed from %u to %u\n",
+             (unsigned)old_rank, best_dag->rank);
+    }
+#if RPL_DIO_HYSTERESIS
+    rpl_dio_metric_changed(instance);
+#endif /* RPL_DIO_HYSTERESIS */
   }
   return best_dag;
 }
@@ -820,9 +869,7 @@ rpl_find_of(rpl_ocp_t ocp)
 {
   unsigned int i;
 
-  for(i = 0;
-      i < sizeof(objective_functions) / sizeof(objective_functions[0]);
-      i++) {
+  for(i = 0; i < RPL_MAX_OFS && objective_functions[i] != NULL; i++) {
     if(objective_functions[i]->ocp == ocp) {
       return objective_functions[i];
     }
@@ -831,6 +878,28 @@ rpl_find_of(rpl_ocp_t ocp)
   return NULL;
 }
 /*---------------------------------------------------------------------------*/
+int
+rpl_register_of(rpl_of_t *of)
+{
+  unsigned int i;
+
+  for(i = 0; i < RPL_MAX_OFS; i++) {
+    if(objective_functions[i] == NULL) {
+      objective_functions[i] = of;
+      return 1;
+    }
+    if(objective_functions[i] == of) {
+      return 1;
+    }
+    if(objective_functions[i]->ocp == of->ocp) {
+      PRINTF("RPL: OCP %u is already used by another objective function\n",
+             (unsigned)of->ocp);
+      return 0;
+    }
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
 void
 rpl_join_instance(uip_ipaddr_t *from, rpl_dio_t *dio)
 {
@@ -1240,14 +1309,13 @@ rpl_process_dio(uip_ipaddr_t *from, rpl_dio_t *dio)
       }
     }
   } else {
-    if(p->rank == dio->rank) {
+    if(rpl_dio_rank_consistent(p->rank, dio->rank)) {
       PRINTF("RPL: Received consistent DIO\n");
       if(dag->joined) {
         instance->dio_counter++;
       }
-    } else {
-      p->rank=dio->rank;
     }
+    p->rank=dio->rank;
   }
 
   PRINTF("RPL: preferred DAG ");
@@ -1260,7 +1328,10 @@ rpl_process_dio(uip_ipaddr_t *from, rpl_dio_t *dio)
   /* We have allocated a candidate parent; process the DIO further. */
 
 #if RPL_DAG_MC != RPL_DAG_MC_NONE
-  memcpy(&p->mc, &dio->mc, sizeof(p->mc));
+  if(memcmp(&p->mc, &dio->mc, sizeof(p->mc)) != 0) {
+    memcpy(&p->mc, &dio->mc, sizeof(p->mc));
+    RPL_PARENT_INVALIDATE_QUALITY(p);
+  }
 #endif /* RPL_DAG_MC != RPL_DAG_MC_NONE */
   if(rpl_process_parent_event(instance, p) == 0) {
     PRINTF("RPL: The candidate parent is rejected\n");
@@ -46,6 +46,7 @@
 #include "net/tcpip.h"
 #include "net/uip-ds6.h"
 #include "net/rpl/rpl-private.h"
+#include "net/rpl/rpl-ns.h"
 
 #define DEBUG DEBUG_NONE
 #include "net/uip-debug.h"
@@ -61,8 +62,21 @@
 #define UIP_EXT_HDR_OPT_BUF       ((struct uip_ext_hdr_opt *)&uip_buf[uip_l2_l3_hdr_len + uip_ext_opt_offset])
 #define UIP_EXT_HDR_OPT_PADN_BUF  ((struct uip_ext_hdr_opt_padn *)&uip_buf[uip_l2_l3_hdr_len + uip_ext_opt_offset])
 #define UIP_EXT_HDR_OPT_RPL_BUF   ((struct uip_ext_hdr_opt_rpl *)&uip_buf[uip_l2_l3_hdr_len + uip_ext_opt_offset])
+
+/* Fields of the RPL source routing header (RFC 6554) that follow the
+   generic routing header, and the offset of its address vector. */
+#define RPL_SRH_CMPR               4 /* CmprI << 4 | CmprE */
+#define RPL_SRH_PAD                5 /* Pad << 4 */
+#define RPL_SRH_ADDRESSES          8
 /*---------------------------------------------------------------------------*/
 #if UIP_CONF_IPV6
+/* Instance of the packets sent by the application, NULL for the default. */
+static rpl_instance_t *flow_instance;
+#if RPL_WITH_NON_STORING
+static uint8_t *srh_find(void);
+static rpl_dag_t *ns_root_dag(rpl_instance_t *instance);
+#endif /* RPL_WITH_NON_STORING */
+/*---------------------------------------------------------------------------*/
 int
 rpl_verify_header(int uip_ext_opt_offset)
 {
@@ -158,7 +172,8 @@ set_rpl_opt(unsigned uip_ext_opt_offset)
   UIP_EXT_HDR_OPT_RPL_BUF->opt_type = UIP_EXT_HDR_OPT_RPL;
   UIP_EXT_HDR_OPT_RPL_BUF->opt_len = RPL_HDR_OPT_LEN;
   UIP_EXT_HDR_OPT_RPL_BUF->flags = 0;
-  UIP_EXT_HDR_OPT_RPL_BUF->instance = 0;
+  UIP_EXT_HDR_OPT_RPL_BUF->instance =
+    flow_instance != NULL ? flow_instance->instance_id : 0;
   UIP_EXT_HDR_OPT_RPL_BUF->senderrank = 0;
   uip_len += RPL_HOP_BY_HOP_LEN;
   temp_len = UIP_IP_BUF->len[1];
@@ -215,6 +230,22 @@ rpl_update_header_empty(void)
        which states that if a packet is going down it should in
        general not go back up again. If this happens, a
        RPL_HDR_OPT_FWD_ERR should be flagged. */
+#if RPL_WITH_NON_STORING
+    if(RPL_IS_NON_STORING(instance)) {
+      /* Routers below the root hold no routes: a packet goes down when
+         it follows a source route, or is about to get one at the root. */
+      if(srh_find() != NULL ||
+         (ns_root_dag(instance) != NULL &&
+          rpl_ns_is_node_reachable(ns_root_dag(instance),
+                                   &UIP_IP_BUF->destipaddr))) {
+        UIP_EXT_HDR_OPT_RPL_BUF->flags |= RPL_HDR_OPT_DOWN;
+        PRINTF("RPL option going down\n");
+      } else {
+        UIP_EXT_HDR_OPT_RPL_BUF->flags &= ~RPL_HDR_OPT_DOWN;
+        PRINTF("RPL option going up\n");
+      }
+    } else
+#endif /* RPL_WITH_NON_STORING */
     if((UIP_EXT_HDR_OPT_RPL_BUF->flags & RPL_HDR_OPT_DOWN)) {
       if(uip_ds6_route_lookup(&UIP_IP_BUF->destipaddr) == NULL) {
         UIP_EXT_HDR_OPT_RPL_BUF->flags |= RPL_HDR_OPT_FWD_ERR;
@@ -248,6 +279,7 @@ rpl_update_header_empty(void)
 int
 rpl_update_header_final(uip_ipaddr_t *addr)
 {
+  rpl_instance_t *instance;
   rpl_parent_t *parent;
   int uip_ext_opt_offset;
   int last_uip_ext_len;
@@ -266,16 +298,17 @@ rpl_update_header_final(uip_ipaddr_t *addr)
     if(UIP_EXT_HDR_OPT_BUF->type == UIP_EXT_HDR_OPT_RPL) {
       if(UIP_EXT_HDR_OPT_RPL_BUF->senderrank == 0) {
         PRINTF("RPL: Updating RPL option\n");
-        if(default_instance == NULL || !default_instance->used || !default_instance->current_dag->joined) {
+        instance = flow_instance != NULL ? flow_instance : default_instance;
+        if(instance == NULL || !instance->used || !instance->current_dag->joined) {
           PRINTF("RPL: Unable to add hop-by-hop extension header: incorrect default instance\n");
           return 1;
         }
-        parent = rpl_find_parent(default_instance->current_dag, addr);
+        parent = rpl_find_parent(instance->current_dag, addr);
         if(parent == NULL || parent != parent->dag->preferred_parent) {
           UIP_EXT_HDR_OPT_RPL_BUF->flags = RPL_HDR_OPT_DOWN;
         }
-        UIP_EXT_HDR_OPT_RPL_BUF->instance = default_instance->instance_id;
-        UIP_EXT_HDR_OPT_RPL_BUF->senderrank = default_instance->current_dag->rank;
+        UIP_EXT_HDR_OPT_RPL_BUF->instance = instance->instance_id;
+        UIP_EXT_HDR_OPT_RPL_BUF->senderrank = instance->current_dag->rank;
         uip_ext_len = last_uip_ext_len;
       }
     }
@@ -347,7 +380,11 @@ void
 rpl_insert_header(void)
 {
   uint8_t uip_ext_opt_offset;
-  if(default_instance != NULL) {
+  if(flow_instance != NULL) {
+    /* The option is what selects the instance of the packet at every
+       hop, so it is always added to flows bound to an instance. */
+    rpl_update_header_empty();
+  } else if(default_instance != NULL) {
     uip_ext_opt_offset = 2;
     if(UIP_EXT_HDR_OPT_BUF->type == UIP_EXT_HDR_OPT_RPL) {
       rpl_update_header_empty();
@@ -355,4 +392,310 @@ rpl_insert_header(void)
   }
 }
 /*---------------------------------------------------------------------------*/
+void
+rpl_set_flow_instance(rpl_instance_t *instance)
+{
+  flow_instance = instance;
+}
+/*---------------------------------------------------------------------------*/
+uip_ipaddr_t *
+rpl_get_flow_nexthop(void)
+{
+  rpl_instance_t *instance;
+  int uip_ext_opt_offset;
+  int last_uip_ext_len;
+
+  last_uip_ext_len = uip_ext_len;
+  uip_ext_len = 0;
+  uip_ext_opt_offset = 2;
+
+  instance = NULL;
+  if(UIP_IP_BUF->proto == UIP_PROTO_HBHO &&
+     UIP_HBHO_BUF->len == RPL_HOP_BY_HOP_LEN - 8 &&
+     UIP_EXT_HDR_OPT_BUF->type == UIP_EXT_HDR_OPT_RPL) {
+    instance = rpl_get_instance(UIP_EXT_HDR_OPT_RPL_BUF->instance);
+  }
+  uip_ext_len = last_uip_ext_len;
+
+  /* Packets without an instance of their own belong to the default
+     instance. Its preferred parent is used rather than the head of
+     the default router list, which may have been added otherwise. */
+  if(instance == NULL) {
+    instance = default_instance;
+  }
+  if(instance == NULL || !instance->used || instance->current_dag == NULL ||
+     !instance->current_dag->joined ||
+     instance->current_dag->preferred_parent == NULL) {
+    return NULL;
+  }
+  return rpl_get_parent_ipaddr(instance->current_dag->preferred_parent);
+}
+/*---------------------------------------------------------------------------*/
+#if RPL_WITH_NON_STORING
+/* The source routing header of the packet in uip_buf, if any. Only a
+   routing header that follows the IPv6 header or the hop-by-hop
+   options header is considered, as RPL puts it there. */
+static uint8_t *
+srh_find(void)
+{
+  uint8_t *hdr;
+  uint8_t proto;
+
+  hdr = &uip_buf[UIP_LLH_LEN + UIP_IPH_LEN];
+  proto = UIP_IP_BUF->proto;
+  if(proto == UIP_PROTO_HBHO) {
+    proto = hdr[0];
+    hdr += (hdr[1] + 1) * 8;
+  }
+  if(proto != UIP_PROTO_ROUTING ||
+     hdr + RPL_SRH_ADDRESSES > &uip_buf[UIP_LLH_LEN + uip_len] ||
+     hdr[2] != RPL_RH_TYPE_SRH) {
+    return NULL;
+  }
+  return hdr;
+}
+/*---------------------------------------------------------------------------*/
+/* The DAG of the instance if this node is its non-storing root. */
+static rpl_dag_t *
+ns_root_dag(rpl_instance_t *instance)
+{
+  if(RPL_IS_NON_STORING(instance) && instance->used &&
+     instance->current_dag != NULL && instance->current_dag->joined &&
+     instance->current_dag->rank == ROOT_RANK(instance)) {
+    return instance->current_dag;
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+/* Number of leading bytes that a and b have in common, at most 15. */
+static uint8_t
+common_prefix_len(const uip_ipaddr_t *a, const uip_ipaddr_t *b)
+{
+  uint8_t n;
+
+  for(n = 0; n < 15 && a->u8[n] == b->u8[n]; n++);
+  return n;
+}
+/*---------------------------------------------------------------------------*/
+/*
+ * Insert a source routing header at the root of a non-storing DAG. The
+ * route is read backwards from the parent graph: the first hop becomes
+ * the IPv6 destination and the header lists the following hops, ending
+ * with the final destination. Returns 1 if the packet can be sent along
+ * a source route, including the case of a child of the root that needs
+ * no header, and 0 otherwise.
+ */
+static int
+insert_srh(void)
+{
+  rpl_instance_t *instance;
+  rpl_dag_t *dag;
+  rpl_ns_node_t *dest_node;
+  rpl_ns_node_t *root_node;
+  rpl_ns_node_t *node;
+  uip_ipaddr_t first_hop;
+  uip_ipaddr_t addr;
+  uint8_t *srh;
+  uint8_t *vector;
+  uint8_t cmpri, cmpre, pad;
+  uint16_t ext_offset;
+  uint16_t srh_len;
+  uint16_t payload_len;
+  int hops;
+  int i;
+  int uip_ext_opt_offset;
+  int last_uip_ext_len;
+
+  if(uip_is_addr_mcast(&UIP_IP_BUF->destipaddr)) {
+    return 0;
+  }
+
+  /* A forwarded packet has the RPL option of its instance, a packet
+     of our own gets it in rpl_update_header_final(). */
+  last_uip_ext_len = uip_ext_len;
+  uip_ext_len = 0;
+  uip_ext_opt_offset = 2;
+  instance = flow_instance != NULL ? flow_instance : default_instance;
+  if(UIP_IP_BUF->proto == UIP_PROTO_HBHO &&
+     UIP_HBHO_BUF->len == RPL_HOP_BY_HOP_LEN - 8 &&
+     UIP_EXT_HDR_OPT_BUF->type == UIP_EXT_HDR_OPT_RPL &&
+     UIP_EXT_HDR_OPT_RPL_BUF->senderrank != 0) {
+    instance = rpl_get_instance(UIP_EXT_HDR_OPT_RPL_BUF->instance);
+  }
+  uip_ext_len = last_uip_ext_len;
+
+  dag = ns_root_dag(instance);
+  if(dag == NULL || !rpl_ns_is_node_reachable(dag, &UIP_IP_BUF->destipaddr)) {
+    return 0;
+  }
+  dest_node = rpl_ns_get_node(dag, &UIP_IP_BUF->destipaddr);
+  root_node = rpl_ns_get_node(dag, &dag->dag_id);
+
+  /* Count the routers between the root and the destination. */
+  hops = 0;
+  for(node = dest_node->parent; node != root_node; node = node->parent) {
+    hops++;
+  }
+  if(hops == 0) {
+    PRINTF("RPL: No source routing header needed for a child of the root\n");
+    return 1;
+  }
+
+  /* The first hop is the router next to the root, hops away from the
+     destination. */
+  node = dest_node;
+  for(i = 0; i < hops; i++) {
+    node = node->parent;
+  }
+  rpl_ns_get_node_global_addr(&first_hop, node);
+
+  /* Each address is rebuilt from the IPv6 destination that it replaces
+     (RFC 6554, section 3): the intermediate addresses elide the bytes
+     that they all share with the first hop, and the final destination
+     the bytes it shares with its parent, the last hop before it. */
+  rpl_ns_get_node_global_addr(&addr, dest_node->parent);
+  cmpre = common_prefix_len(&UIP_IP_BUF->destipaddr, &addr);
+  cmpri = 15;
+  for(node = dest_node->parent, i = 1; i < hops; node = node->parent, i++) {
+    rpl_ns_get_node_global_addr(&addr, node);
+    if(common_prefix_len(&addr, &first_hop) < cmpri) {
+      cmpri = common_prefix_len(&addr, &first_hop);
+    }
+  }
+  srh_len = RPL_SRH_ADDRESSES + (hops - 1) * (16 - cmpri) + (16 - cmpre);
+  pad = (8 - (srh_len & 7)) & 7;
+  srh_len += pad;
+
+  if(uip_len + srh_len > UIP_LINK_MTU ||
+     UIP_LLH_LEN + uip_len + srh_len > UIP_BUFSIZE) {
+    PRINTF("RPL: Packet too long for a source routing header\n");
+    return 0;
+  }
+
+  /* Make room after the hop-by-hop options header, if any. */
+  ext_offset = UIP_IPH_LEN;
+  if(UIP_IP_BUF->proto == UIP_PROTO_HBHO) {
+    ext_offset += (uip_buf[UIP_LLH_LEN + UIP_IPH_LEN + 1] + 1) * 8;
+  }
+  srh = &uip_buf[UIP_LLH_LEN + ext_offset];
+  memmove(srh + srh_len, srh, uip_len - ext_offset);
+  memset(srh, 0, srh_len);
+
+  if(UIP_IP_BUF->proto == UIP_PROTO_HBHO) {
+    srh[0] = uip_buf[UIP_LLH_LEN + UIP_IPH_LEN];
+    uip_buf[UIP_LLH_LEN + UIP_IPH_LEN] = UIP_PROTO_ROUTING;
+  } else {
+    srh[0] = UIP_IP_BUF->proto;
+    UIP_IP_BUF->proto = UIP_PROTO_ROUTING;
+  }
+  srh[1] = srh_len / 8 - 1;
+  srh[2] = RPL_RH_TYPE_SRH;
+  srh[3] = hops;
+  srh[RPL_SRH_CMPR] = (cmpri << 4) | cmpre;
+  srh[RPL_SRH_PAD] = pad << 4;
+
+  /* Fill the address vector from its end: the destination comes last,
+     preceded by its parents up to the one after the first hop. */
+  vector = srh + RPL_SRH_ADDRESSES + (hops - 1) * (16 - cmpri);
+  memcpy(vector, &UIP_IP_BUF->destipaddr.u8[cmpre], 16 - cmpre);
+  for(node = dest_node->parent, i = 1; i < hops; node = node->parent, i++) {
+    vector -= 16 - cmpri;
+    rpl_ns_get_node_global_addr(&addr, node);
+    memcpy(vector, &addr.u8[cmpri], 16 - cmpri);
+  }
+
+  uip_ipaddr_copy(&UIP_IP_BUF->destipaddr, &first_hop);
+  uip_len += srh_len;
+  payload_len = ((UIP_IP_BUF->len[0] << 8) | UIP_IP_BUF->len[1]) + srh_len;
+  UIP_IP_BUF->len[0] = payload_len >> 8;
+  UIP_IP_BUF->len[1] = payload_len & 0xff;
+
+  PRINTF("RPL: Inserted a source routing header with %d hops to ", hops);
+  PRINT6ADDR(&first_hop);
+  PRINTF("\n");
+
+  return 1;
+}
+#endif /* RPL_WITH_NON_STORING */
+/*---------------------------------------------------------------------------*/
+int
+rpl_srh_get_next_hop(uip_ipaddr_t *ipaddr)
+{
+#if RPL_WITH_NON_STORING
+  if(srh_find() != NULL || insert_srh()) {
+    /* Neighbors are known by their link-local address, which shares
+       its interface identifier with the global one. */
+    uip_create_linklocal_prefix(ipaddr);
+    memcpy(&ipaddr->u8[8], &UIP_IP_BUF->destipaddr.u8[8], 8);
+    if(uip_ds6_nbr_lookup(ipaddr) == NULL) {
+      uip_ipaddr_copy(ipaddr, &UIP_IP_BUF->destipaddr);
+    }
+    return 1;
+  }
+#endif /* RPL_WITH_NON_STORING */
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+int
+rpl_process_srh_header(void)
+{
+#if RPL_WITH_NON_STORING
+  uint8_t *srh;
+  uint8_t *slot;
+  uip_ipaddr_t next_hop;
+  uint8_t cmpri, cmpre, pad;
+  uint8_t segments_left;
+  uint8_t size;
+  int n;
+  int i;
+
+  srh = srh_find();
+  if(srh == NULL || srh[3] == 0) {
+    return 0;
+  }
+
+  cmpri = srh[RPL_SRH_CMPR] >> 4;
+  cmpre = srh[RPL_SRH_CMPR] & 0x0f;
+  pad = srh[RPL_SRH_PAD] >> 4;
+  if((srh[1] + 1) * 8 < RPL_SRH_ADDRESSES + pad + 16 - cmpre ||
+     srh + (srh[1] + 1) * 8 > &uip_buf[UIP_LLH_LEN + uip_len]) {
+    PRINTF("RPL: Malformed source routing header\n");
+    return 0;
+  }
+  /* RFC 6554, section 4.2. */
+  n = (srh[1] * 8 - pad - (16 - cmpre)) / (16 - cmpri) + 1;
+  segments_left = srh[3];
+  if(segments_left > n) {
+    PRINTF("RPL: Bad segments left in source routing header\n");
+    return 0;
+  }
+
+  segments_left--;
+  i = n - segments_left;
+  size = i < n ? 16 - cmpri : 16 - cmpre;
+  slot = srh + RPL_SRH_ADDRESSES + (i - 1) * (16 - cmpri);
+
+  uip_ipaddr_copy(&next_hop, &UIP_IP_BUF->destipaddr);
+  memcpy(&next_hop.u8[16 - size], slot, size);
+  if(uip_is_addr_mcast(&next_hop) ||
+     uip_is_addr_mcast(&UIP_IP_BUF->destipaddr) ||
+     uip_ds6_is_my_addr(&next_hop)) {
+    PRINTF("RPL: Bad address in source routing header\n");
+    return 0;
+  }
+
+  memcpy(slot, &UIP_IP_BUF->destipaddr.u8[16 - size], size);
+  uip_ipaddr_copy(&UIP_IP_BUF->destipaddr, &next_hop);
+  srh[3] = segments_left;
+
+  PRINTF("RPL: Source routing header processed, next hop ");
+  PRINT6ADDR(&next_hop);
+  PRINTF("\n");
+
+  return 1;
+#else /* RPL_WITH_NON_STORING */
+  return 0;
+#endif /* RPL_WITH_NON_STORING */
+}
+/*---------------------------------------------------------------------------*/
 #endif /* UIP_CONF_IPV6 */
@@ -48,6 +48,7 @@
 #include "net/uip-nd6.h"
 #include "net/uip-icmp6.h"
 #include "net/rpl/rpl-private.h"
+#include "net/rpl/rpl-ns.h"
 #include "net/packetbuf.h"
 
 #include <limits.h>
@@ -147,6 +148,153 @@ set16(uint8_t *buffer, int pos, uint16_t value)
   buffer[pos++] = value & 0xff;
 }
 /*---------------------------------------------------------------------------*/
+/*
+ * A DAG Metric Container option holds one RFC 6551 metric object per
+ * metric: a 4-byte header (type, flags, aggregation and precision,
+ * length) followed by the value. A metric container type stands for
+ * the set of objects it is made of, so that the composite containers
+ * of the latency and fuzzy objective functions are made of standard
+ * objects. Values are encoded compactly: ETX and latency (in ms) on 16
+ * bits and the hop count on 8 bits, which keeps the fuzzy container at
+ * 26 bytes and a DIO with a prefix information option within one
+ * 802.15.4 frame.
+ */
+#define MC_OBJ_ENERGY     0x01
+#define MC_OBJ_HOPCOUNT   0x02
+#define MC_OBJ_LATENCY    0x04
+#define MC_OBJ_ETX        0x08
+
+#define MC_OBJ_HDR_LEN    4
+
+static const struct {
+  uint8_t type;
+  uint8_t objects;
+} mc_objects[] = {
+  { RPL_DAG_MC_ETX, MC_OBJ_ETX },
+  { RPL_DAG_MC_ENERGY, MC_OBJ_ENERGY },
+  { RPL_DAG_MC_LATENCY, MC_OBJ_LATENCY | MC_OBJ_ETX },
+  { RPL_DAG_MC_FUZZY,
+    MC_OBJ_ENERGY | MC_OBJ_HOPCOUNT | MC_OBJ_LATENCY | MC_OBJ_ETX }
+};
+
+#define MC_TYPES (sizeof(mc_objects) / sizeof(mc_objects[0]))
+/*---------------------------------------------------------------------------*/
+#if !RPL_LEAF_ONLY
+static int
+write_mc_object(uint8_t *buffer, int pos, rpl_metric_container_t *mc,
+                uint8_t type, uint8_t length)
+{
+  buffer[pos++] = type;
+  buffer[pos++] = mc->flags >> 1;
+  buffer[pos] = (mc->flags & 1) << 7;
+  buffer[pos++] |= (mc->aggr << 4) | mc->prec;
+  buffer[pos++] = length;
+  return pos;
+}
+/*---------------------------------------------------------------------------*/
+static int
+write_mc(uint8_t *buffer, int pos, rpl_metric_container_t *mc)
+{
+  uint8_t objects;
+  int start;
+  int i;
+
+  objects = 0;
+  for(i = 0; i < MC_TYPES; i++) {
+    if(mc_objects[i].type == mc->type) {
+      objects = mc_objects[i].objects;
+    }
+  }
+  if(objects == 0) {
+    return -1;
+  }
+
+  buffer[pos++] = RPL_OPTION_DAG_METRIC_CONTAINER;
+  start = pos++;
+
+  /* Objects in increasing order of their type. */
+  if(objects & MC_OBJ_ENERGY) {
+    pos = write_mc_object(buffer, pos, mc, RPL_DAG_MC_ENERGY, 2);
+    buffer[pos++] = mc->obj.energy.flags;
+    buffer[pos++] = mc->obj.energy.energy_est;
+  }
+  if(objects & MC_OBJ_HOPCOUNT) {
+    pos = write_mc_object(buffer, pos, mc, RPL_DAG_MC_HOPCOUNT, 2);
+    buffer[pos++] = 0; /* flags */
+    buffer[pos++] = mc->obj.hopcount > 0xff ? 0xff : mc->obj.hopcount;
+  }
+  if(objects & MC_OBJ_LATENCY) {
+    pos = write_mc_object(buffer, pos, mc, RPL_DAG_MC_LATENCY, 2);
+    set16(buffer, pos, mc->obj.latency);
+    pos += 2;
+  }
+  if(objects & MC_OBJ_ETX) {
+    pos = write_mc_object(buffer, pos, mc, RPL_DAG_MC_ETX, 2);
+    set16(buffer, pos, mc->obj.etx);
+    pos += 2;
+  }
+
+  buffer[start] = pos - start - 1;
+  return pos;
+}
+#endif /* !RPL_LEAF_ONLY */
+/*---------------------------------------------------------------------------*/
+static int
+read_mc(uint8_t *buffer, int pos, int end, rpl_metric_container_t *mc)
+{
+  uint8_t objects, type, length;
+  uint32_t latency;
+  int i;
+
+  objects = 0;
+  mc->length = 0;
+  for(; pos + MC_OBJ_HDR_LEN <= end; pos += length) {
+    type = buffer[pos];
+    length = buffer[pos + 3];
+    if(objects == 0) {
+      mc->flags = buffer[pos + 1] << 1;
+      mc->flags |= buffer[pos + 2] >> 7;
+      mc->aggr = (buffer[pos + 2] >> 4) & 0x3;
+      mc->prec = buffer[pos + 2] & 0xf;
+    }
+    pos += MC_OBJ_HDR_LEN;
+    if(pos + length > end) {
+      return -1;
+    }
+    mc->length += length;
+
+    if(type == RPL_DAG_MC_ENERGY && length >= 2) {
+      mc->obj.energy.flags = buffer[pos];
+      mc->obj.energy.energy_est = buffer[pos + 1];
+      objects |= MC_OBJ_ENERGY;
+    } else if(type == RPL_DAG_MC_HOPCOUNT && length >= 2) {
+      mc->obj.hopcount = buffer[pos + 1];
+      objects |= MC_OBJ_HOPCOUNT;
+    } else if(type == RPL_DAG_MC_LATENCY && length >= 2) {
+      /* RFC 6551 uses 32 bits, accept both encodings. */
+      latency = length >= 4 ? get32(buffer, pos) : get16(buffer, pos);
+      mc->obj.latency = latency > 0xffff ? 0xffff : latency;
+      objects |= MC_OBJ_LATENCY;
+    } else if(type == RPL_DAG_MC_ETX && length >= 2) {
+      mc->obj.etx = get16(buffer, pos);
+      objects |= MC_OBJ_ETX;
+    } else {
+      PRINTF("RPL: Ignoring DAG MC object type %u\n", (unsigned)type);
+    }
+  }
+  if(pos != end) {
+    return -1;
+  }
+
+  for(i = 0; i < MC_TYPES; i++) {
+    if(mc_objects[i].objects == objects) {
+      mc->type = mc_objects[i].type;
+      return 0;
+    }
+  }
+  return -1;
+}
+/*---------------------------------------------------------------------------*/
 static void
 dis_input(void)
 {
@@ -309,56 +457,22 @@ dio_input(void)
 
     switch(subopt_type) {
     case RPL_OPTION_DAG_METRIC_CONTAINER:
-      if(len < 6) {
+      if(len < 2 + MC_OBJ_HDR_LEN) {
         PRINTF("RPL: Invalid DAG MC, len = %d\n", len);
 	RPL_STAT(rpl_stats.malformed_msgs++);
         return;
       }
-      dio.mc.type = buffer[i + 2];
-      dio.mc.flags = buffer[i + 3] << 1;
-      dio.mc.flags |= buffer[i + 4] >> 7;
-      dio.mc.aggr = (buffer[i + 4] >> 4) & 0x3;
-      dio.mc.prec = buffer[i + 4] & 0xf;
-      dio.mc.length = buffer[i + 5];
-
-      if(dio.mc.type == RPL_DAG_MC_NONE) {
-        /* No metric container: do nothing */
-      } 
-       else if(dio.mc.type == RPL_DAG_MC_FUZZY){
-        dio.mc.obj.energy.flags = buffer[i + 6];
-        dio.mc.obj.energy.energy_est = buffer[i + 7];
-        dio.mc.obj.etx = get16(buffer, i + 8);
-        dio.mc.obj.latency = get16(buffer, i + 10);
-        dio.mc.obj.hopcount = get16(buffer, i + 12);
-      }
-
-
-       else if(dio.mc.type == RPL_DAG_MC_ETX) {
-        dio.mc.obj.etx = get16(buffer, i + 6);
-
-        PRINTF("RPL: DAG MC: type %u, flags %u, aggr %u, prec %u, length %u, ETX %u\n",
-	       (unsigned)dio.mc.type,  
-	       (unsigned)dio.mc.flags, 
-       (unsigned)dio.mc.aggr, 
-	       (unsigned)dio.mc.prec, 
-	       (unsigned)dio.mc.length, 
-	       (unsigned)dio.mc.obj.etx);
-     } 
-      
-      else if(dio.mc.type == RPL_DAG_MC_ENERGY) {
-        dio.mc.obj.energy.flags = buffer[i + 6];
-        dio.mc.obj.energy.energy_est = buffer[i + 7];
-      } 
-
-       else if(dio.mc.type == RPL_DAG_MC_LATENCY){
-        dio.mc.obj.etx = get16(buffer, i + 6);
-        dio.mc.obj.latency = get16(buffer, i + 8);
-      }
-        
-       else {
-       PRINTF("RPL: Unhandled DAG MC type: %u\n", (unsigned)dio.mc.type);
-       return;
+      if(read_mc(buffer, i + 2, i + len, &dio.mc) < 0) {
+        PRINTF("RPL: Unhandled DAG MC\n");
+        return;
       }
+      PRINTF("RPL: DAG MC: type %u, flags %u, aggr %u, prec %u, length %u, ETX %u\n",
+             (unsigned)dio.mc.type,
+             (unsigned)dio.mc.flags,
+             (unsigned)dio.mc.aggr,
+             (unsigned)dio.mc.prec,
+             (unsigned)dio.mc.length,
+             (unsigned)dio.mc.obj.etx);
       break;
     case RPL_OPTION_ROUTE_INFO:
       if(len < 9) {
@@ -493,44 +607,9 @@ dio_output(rpl_instance_t *instance, uip_ipaddr_t *uc_addr)
   if(instance->mc.type != RPL_DAG_MC_NONE) {
     instance->of->update_metric_container(instance);
 
-    buffer[pos++] = RPL_OPTION_DAG_METRIC_CONTAINER;
-    buffer[pos++]= 12;
-    buffer[pos++] = instance->mc.type;
-    buffer[pos++] = instance->mc.flags >> 1;
-    buffer[pos] = (instance->mc.flags & 1) << 7;
-    buffer[pos++] |= (instance->mc.aggr << 4) | instance->mc.prec;
-    if(instance->mc.type == RPL_DAG_MC_ETX) {
-      buffer[pos++] = 2;
-      set16(buffer, pos, instance->mc.obj.etx);
-      pos += 2;
-    }
- else if(instance->mc.type == RPL_DAG_MC_FUZZY){
-      buffer[pos++] = 8;
-      buffer[pos++] = instance->mc.obj.energy.flags;
-      buffer[pos++] = instance->mc.obj.energy.energy_est;
-      set16(buffer, pos, instance->mc.obj.etx);
-      pos += 2;
-      set16(buffer, pos, instance->mc.obj.latency);
-     pos += 2;
-     set16(buffer, pos, instance->mc.obj.hopcount);
-     pos += 2;
-    }
-    else if(instance->mc.type == RPL_DAG_MC_ENERGY) {
-      buffer[pos++] = 2;
-      buffer[pos++] = instance->mc.obj.energy.flags;
-      buffer[pos++] = instance->mc.obj.energy.energy_est;
-    }
-#if CONTIKI_DELAY
- else if(instance->mc.type == RPL_DAG_MC_LATENCY){
-      buffer[pos++] = 4;
-      set16(buffer, pos, instance->mc.obj.etx);
-      pos += 2;
-      set16(buffer, pos, instance->mc.obj.latency);
-     pos += 2;
-    }
-#endif
-else {
-     PRINTF("RPL: Unable to send DIO because of unhandled DAG MC type %u\n",
+    pos = write_mc(buffer, pos, &instance->mc);
+    if(pos < 0) {
+      PRINTF("RPL: Unable to send DIO because of unhandled DAG MC type %u\n",
 	(unsigned)instance->mc.type);
       return;
     }
@@ -631,6 +710,12 @@ dao_input(void)
   int i;
   int learned_from;
   rpl_parent_t *p;
+#if RPL_WITH_NON_STORING
+  uip_ipaddr_t dao_parent_addr;
+  uint8_t dao_parent_found;
+
+  dao_parent_found = 0;
+#endif /* RPL_WITH_NON_STORING */
 
   prefixlen = 0;
 
@@ -695,7 +780,14 @@ dao_input(void)
       /*      pathcontrol = buffer[i + 3];
               pathsequence = buffer[i + 4];*/
       lifetime = buffer[i + 5];
-      /* The parent address is also ignored. */
+#if RPL_WITH_NON_STORING
+      /* In non-storing mode, the transit option carries the global
+         address of the parent of the target. */
+      if(len >= 6 + (int)sizeof(dao_parent_addr)) {
+        memcpy(&dao_parent_addr, buffer + i + 6, sizeof(dao_parent_addr));
+        dao_parent_found = 1;
+      }
+#endif /* RPL_WITH_NON_STORING */
       break;
     }
   }
@@ -705,6 +797,34 @@ dao_input(void)
   PRINT6ADDR(&prefix);
   PRINTF("\n");
 
+#if RPL_WITH_NON_STORING
+  if(RPL_IS_NON_STORING(instance)) {
+    /* The DAO is addressed to the root, which records the link in its
+       parent graph. No route is stored and the DAO goes no further. */
+    if(dag->rank != ROOT_RANK(instance)) {
+      PRINTF("RPL: Ignoring a non-storing DAO at a non-root node\n");
+      return;
+    }
+    if(!dao_parent_found) {
+      PRINTF("RPL: Ignoring a non-storing DAO without parent address\n");
+      return;
+    }
+    if(lifetime == RPL_ZERO_LIFETIME) {
+      PRINTF("RPL: No-Path DAO received\n");
+      rpl_ns_expire_parent(dag, &prefix, &dao_parent_addr);
+    } else if(rpl_ns_update_node(dag, &prefix, &dao_parent_addr,
+                                 RPL_LIFETIME(instance, lifetime)) == NULL) {
+      RPL_STAT(rpl_stats.mem_overflows++);
+      PRINTF("RPL: Could not add a link after receiving a DAO\n");
+      return;
+    }
+    if(flags & RPL_DAO_K_FLAG) {
+      dao_ack_output(instance, &dao_sender_addr, sequence);
+    }
+    return;
+  }
+#endif /* RPL_WITH_NON_STORING */
+
   rep = uip_ds6_route_lookup(&prefix);
 
   if(lifetime == RPL_ZERO_LIFETIME) {
@@ -801,6 +921,10 @@ dao_output_target(rpl_parent_t *parent, uip_ipaddr_t *prefix, uint8_t lifetime)
   unsigned char *buffer;
   uint8_t prefixlen;
   int pos;
+  uip_ipaddr_t *dest_ipaddr;
+#if RPL_WITH_NON_STORING
+  uip_ipaddr_t parent_ipaddr;
+#endif /* RPL_WITH_NON_STORING */
 
   /* Destination Advertisement Object */
 
@@ -859,23 +983,50 @@ dao_output_target(rpl_parent_t *parent, uip_ipaddr_t *prefix, uint8_t lifetime)
   memcpy(buffer + pos, prefix, (prefixlen + 7) / CHAR_BIT);
   pos += ((prefixlen + 7) / CHAR_BIT);
 
+  dest_ipaddr = rpl_get_parent_ipaddr(parent);
+  if(dest_ipaddr == NULL) {
+    PRINTF("RPL dao_output_target error parent address NULL\n");
+    return;
+  }
+
   /* Create a transit information sub-option. */
   buffer[pos++] = RPL_OPTION_TRANSIT;
-  buffer[pos++] = 4;
+#if RPL_WITH_NON_STORING
+  if(RPL_IS_NON_STORING(instance)) {
+    /* Report the global address of the parent to the root and send
+       the DAO to the root directly. */
+    if(dag->prefix_info.length == 0) {
+      PRINTF("RPL: No DAG prefix to address the parent - suppressing DAO\n");
+      return;
+    }
+    memcpy(&parent_ipaddr, &dag->prefix_info.prefix, 8);
+    memcpy(((unsigned char *)&parent_ipaddr) + 8,
+           ((unsigned char *)dest_ipaddr) + 8, 8);
+    buffer[pos++] = 4 + sizeof(parent_ipaddr);
+  } else
+#endif /* RPL_WITH_NON_STORING */
+  {
+    buffer[pos++] = 4;
+  }
   buffer[pos++] = 0; /* flags - ignored */
   buffer[pos++] = 0; /* path control - ignored */
   buffer[pos++] = 0; /* path seq - ignored */
   buffer[pos++] = lifetime;
+#if RPL_WITH_NON_STORING
+  if(RPL_IS_NON_STORING(instance)) {
+    memcpy(buffer + pos, &parent_ipaddr, sizeof(parent_ipaddr));
+    pos += sizeof(parent_ipaddr);
+    dest_ipaddr = &dag->dag_id;
+  }
+#endif /* RPL_WITH_NON_STORING */
 
   printf("RPL: Sending DAO with prefix ");
   PRINT6ADDR(prefix);
   printf(" to ");
-  PRINT6ADDR(rpl_get_parent_ipaddr(parent));
+  PRINT6ADDR(dest_ipaddr);
   printf("\n");
 
-  if(rpl_get_parent_ipaddr(parent) != NULL) {
-    uip_icmp6_send(rpl_get_parent_ipaddr(parent), ICMP6_RPL, RPL_CODE_DAO, pos);
-  }
+  uip_icmp6_send(dest_ipaddr, ICMP6_RPL, RPL_CODE_DAO, pos);
 }
 /*---------------------------------------------------------------------------*/
 static void
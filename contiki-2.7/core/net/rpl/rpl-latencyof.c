@@ -3,14 +3,8 @@
 #include "net/nbr-table.h"
 #include "net/delay.h"
 #include "delay_func.h"
-#include "lib/list.h"
-#include "lib/memb.h"
 #define DLY_SCALE	100
 #define DLY_ALPHA	90
-extern unsigned long before_trans;
-extern unsigned long after_ack;
-MEMB(time_memb, struct time_queue, MAX_QUEUED_PACKETS);
-LIST(time_list);
 
 #define DEBUG DEBUG_PRINT
 #include "net/uip-debug.h"
@@ -78,7 +72,6 @@ reset(rpl_dag_t *sag)
 static void
 neighbor_link_callback(rpl_parent_t *p, int status, int numtx){
 
-  struct time_queue *item;
   delay_t packet_delay,  new_delay;
   delay_t recorded_delay= p->delay_metric;
 
@@ -88,20 +81,13 @@ neighbor_link_callback(rpl_parent_t *p, int status, int numtx){
 
   /* Do not penalize the ETX when collisions or transmission errors occur. */
   if(status == MAC_TX_OK || status == MAC_TX_NOACK) {
+    packet_delay = recorded_delay;
     if(status == MAC_TX_OK) {
-    if(list_length(time_list) > 0){
-	  item = list_pop(time_list);
-	  packet_delay = (before_trans - item->before_mac) + (after_ack - before_trans)/2;
-	  memb_free(&time_memb,item); 
-    } 
+      neighbor_info_packet_delay(&packet_delay);
     }
     else if(status == MAC_TX_NOACK) {
       packet_etx = MAX_LINK_METRIC * RPL_DAG_MC_ETX_DIVISOR;
       //packet_delay= MAX_DELAY;
-      if(list_length(time_list) > 0){
-		item = list_pop(time_list);
-		memb_free(&time_memb,item);
-	}
     }
     
     new_etx = ((uint32_t)recorded_etx * ETX_ALPHA +
@@ -113,21 +99,16 @@ neighbor_link_callback(rpl_parent_t *p, int status, int numtx){
         (unsigned)(packet_etx / RPL_DAG_MC_ETX_DIVISOR));
     p->link_metric = new_etx;
     if(packet_delay > MAX_DELAY) packet_delay = MAX_DELAY;
-    new_delay = new_delay = (recorded_delay * DLY_ALPHA +
+    new_delay = (recorded_delay * DLY_ALPHA +
 						packet_delay * (DLY_SCALE - DLY_ALPHA)) / DLY_SCALE;
+    p->delay_metric = new_delay;
 
     PRINTF("RPL: delay changed from %u to %u (packet delay = %u)\n",
         (unsigned)(recorded_delay),
         (unsigned)(new_delay),
         (unsigned)(packet_delay));        
-
-  }else{
-    if(list_length(time_list) > 0){
-		item = list_pop(time_list);
-		memb_free(&time_memb,item);  
   }
 }
-}
 
 static rpl_rank_t
 calculate_rank(rpl_parent_t *p, rpl_rank_t base_rank)
@@ -210,7 +191,7 @@ update_metric_container(rpl_instance_t *instance)
 {
   rpl_path_metric_t path_metric, delay_metric;
   rpl_dag_t *dag;
-  instance->mc.type = RPL_DAG_MC;
+  instance->mc.type = RPL_DAG_MC_LATENCY;
   instance->mc.flags = RPL_DAG_MC_FLAG_P;
   instance->mc.aggr = RPL_DAG_MC_AGGR_ADDITIVE;
   instance->mc.prec = 0;
@@ -241,23 +222,3 @@ update_metric_container(rpl_instance_t *instance)
 	 RPL_DAG_MC_ETX_DIVISOR);
 
 }
-
-void neighbor_info_send_mac (rimeaddr_t *dest) {
-    struct time_queue *item;
-    if(!rimeaddr_cmp(dest,&rimeaddr_null)){
-    	item = memb_alloc(&time_memb);
-    	if(item != NULL){
-    		item->dest = *dest;
-    		item->before_mac = (clock_time()*1000)/CLOCK_SECOND;
-    		list_add(time_list,item);
-    	}
-    	else {
-    		printf("delay: could not allocate time_memb\n");
-    	}
-    }
-}
-
-void time_memb_init(){
-    memb_init(&time_memb);
-}
-
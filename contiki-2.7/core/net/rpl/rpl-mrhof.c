@@ -50,6 +50,18 @@
 #define DEBUG DEBUG_NONE
 #include "net/uip-debug.h"
 
+/*
+ * Metric container used by MRHOF instances. When the system-wide
+ * container is one that MRHOF does not handle (e.g. the fuzzy one used
+ * by other instances), MRHOF instances advertise ETX.
+ */
+#if RPL_DAG_MC == RPL_DAG_MC_NONE || RPL_DAG_MC == RPL_DAG_MC_ETX || \
+    RPL_DAG_MC == RPL_DAG_MC_ENERGY
+#define MRHOF_DAG_MC RPL_DAG_MC
+#else
+#define MRHOF_DAG_MC RPL_DAG_MC_ETX
+#endif
+
 static void reset(rpl_dag_t *);
 static void neighbor_link_callback(rpl_parent_t *, int, int);
 static rpl_parent_t *best_parent(rpl_parent_t *, rpl_parent_t *);
@@ -92,15 +104,15 @@ calculate_path_metric(rpl_parent_t *p)
     return MAX_PATH_COST * RPL_DAG_MC_ETX_DIVISOR;
   }
 
-#if RPL_DAG_MC == RPL_DAG_MC_NONE
+#if MRHOF_DAG_MC == RPL_DAG_MC_NONE
   return p->rank + (uint16_t)p->link_metric;
-#elif RPL_DAG_MC == RPL_DAG_MC_ETX
+#elif MRHOF_DAG_MC == RPL_DAG_MC_ETX
   return p->mc.obj.etx + (uint16_t)p->link_metric;
-#elif RPL_DAG_MC == RPL_DAG_MC_ENERGY
+#elif MRHOF_DAG_MC == RPL_DAG_MC_ENERGY
   return p->mc.obj.energy.energy_est + (uint16_t)p->link_metric;
 #else
 #error "Unsupported RPL_DAG_MC configured. See rpl.h."
-#endif /* RPL_DAG_MC */
+#endif /* MRHOF_DAG_MC */
 }
 
 static void
@@ -208,11 +220,11 @@ best_parent(rpl_parent_t *p1, rpl_parent_t *p2)
   return p1_metric < p2_metric ? p1 : p2;
 }
 
-#if RPL_DAG_MC == RPL_DAG_MC_NONE
+#if MRHOF_DAG_MC == RPL_DAG_MC_NONE
 static void
 update_metric_container(rpl_instance_t *instance)
 {
-  instance->mc.type = RPL_DAG_MC;
+  instance->mc.type = MRHOF_DAG_MC;
 }
 #else
 static void
@@ -220,11 +232,11 @@ update_metric_container(rpl_instance_t *instance)
 {
   rpl_path_metric_t path_metric;
   rpl_dag_t *dag;
-#if RPL_DAG_MC == RPL_DAG_MC_ENERGY
+#if MRHOF_DAG_MC == RPL_DAG_MC_ENERGY
   uint8_t type;
 #endif
 
-  instance->mc.type = RPL_DAG_MC;
+  instance->mc.type = MRHOF_DAG_MC;
   instance->mc.flags = RPL_DAG_MC_FLAG_P;
   instance->mc.aggr = RPL_DAG_MC_AGGR_ADDITIVE;
   instance->mc.prec = 0;
@@ -242,7 +254,7 @@ update_metric_container(rpl_instance_t *instance)
     path_metric = calculate_path_metric(dag->preferred_parent);
   }
 
-#if RPL_DAG_MC == RPL_DAG_MC_ETX
+#if MRHOF_DAG_MC == RPL_DAG_MC_ETX
   instance->mc.length = sizeof(instance->mc.obj.etx);
   instance->mc.obj.etx = path_metric;
 
@@ -250,7 +262,7 @@ update_metric_container(rpl_instance_t *instance)
 	instance->mc.obj.etx / RPL_DAG_MC_ETX_DIVISOR,
 	(instance->mc.obj.etx % RPL_DAG_MC_ETX_DIVISOR * 100) /
 	 RPL_DAG_MC_ETX_DIVISOR);
-#elif RPL_DAG_MC == RPL_DAG_MC_ENERGY
+#elif MRHOF_DAG_MC == RPL_DAG_MC_ENERGY
   instance->mc.length = sizeof(instance->mc.obj.energy);
 
   if(dag->rank == ROOT_RANK(instance)) {
@@ -261,6 +273,6 @@ update_metric_container(rpl_instance_t *instance)
 
   instance->mc.obj.energy.flags = type << RPL_DAG_MC_ENERGY_TYPE;
   instance->mc.obj.energy.energy_est = path_metric;
-#endif /* RPL_DAG_MC == RPL_DAG_MC_ETX */
+#endif /* MRHOF_DAG_MC == RPL_DAG_MC_ETX */
 }
-#endif /* RPL_DAG_MC == RPL_DAG_MC_NONE */
+#endif /* MRHOF_DAG_MC == RPL_DAG_MC_NONE */
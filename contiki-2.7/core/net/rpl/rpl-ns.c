@@ -0,0 +1,233 @@
+/**
+ * \file
+ *         Parent graph of a non-storing RPL DAG, kept by the DAG root.
+ *
+ *         The graph is a list of nodes allocated from a pool of
+ *         RPL_NS_LINK_NUM entries. A node is looked up by the DAG
+ *         prefix of its global address and its interface identifier,
+ *         and points to the node of its parent.
+ */
+
+#include "net/rpl/rpl-private.h"
+#include "net/rpl/rpl-ns.h"
+#include "lib/list.h"
+#include "lib/memb.h"
+
+#define DEBUG DEBUG_NONE
+#include "net/uip-debug.h"
+
+#include <string.h>
+
+#if RPL_WITH_NON_STORING
+
+LIST(nodelist);
+#if RPL_NS_LINK_NUM > 0
+MEMB(nodememb, rpl_ns_node_t, RPL_NS_LINK_NUM);
+#define node_alloc()		memb_alloc(&nodememb)
+#define node_free(node)		memb_free(&nodememb, (node))
+#define node_memb_init()	memb_init(&nodememb)
+#else
+/* Nodes that never become a root have no graph, and no node is added. */
+#define node_alloc()		NULL
+#define node_free(node)
+#define node_memb_init()
+#endif /* RPL_NS_LINK_NUM > 0 */
+
+static int num_nodes;
+
+/*---------------------------------------------------------------------------*/
+static int
+node_matches_address(const rpl_dag_t *dag, const rpl_ns_node_t *node,
+                     const uip_ipaddr_t *addr)
+{
+  return addr != NULL && node != NULL && dag != NULL
+    && dag == node->dag
+    && !memcmp(addr, &dag->prefix_info.prefix, 8)
+    && !memcmp(((const unsigned char *)addr) + 8, node->link_identifier, 8);
+}
+/*---------------------------------------------------------------------------*/
+rpl_ns_node_t *
+rpl_ns_get_node(const rpl_dag_t *dag, const uip_ipaddr_t *addr)
+{
+  rpl_ns_node_t *l;
+
+  for(l = list_head(nodelist); l != NULL; l = list_item_next(l)) {
+    if(node_matches_address(dag, l, addr)) {
+      return l;
+    }
+  }
+  return NULL;
+}
+/*---------------------------------------------------------------------------*/
+static rpl_ns_node_t *
+add_node(rpl_dag_t *dag, const uip_ipaddr_t *addr)
+{
+  rpl_ns_node_t *node;
+
+  node = node_alloc();
+  if(node == NULL) {
+    PRINTF("RPL: NS graph full, cannot add ");
+    PRINT6ADDR(addr);
+    PRINTF("\n");
+    return NULL;
+  }
+  node->dag = dag;
+  node->lifetime = 0;
+  node->parent = NULL;
+  memcpy(node->link_identifier, ((const unsigned char *)addr) + 8, 8);
+  list_add(nodelist, node);
+  num_nodes++;
+  return node;
+}
+/*---------------------------------------------------------------------------*/
+rpl_ns_node_t *
+rpl_ns_update_node(rpl_dag_t *dag, const uip_ipaddr_t *child,
+                   const uip_ipaddr_t *parent, uint32_t lifetime)
+{
+  rpl_ns_node_t *child_node;
+  rpl_ns_node_t *parent_node;
+
+  child_node = rpl_ns_get_node(dag, child);
+  if(child_node == NULL) {
+    child_node = add_node(dag, child);
+    if(child_node == NULL) {
+      return NULL;
+    }
+  }
+
+  parent_node = rpl_ns_get_node(dag, parent);
+  if(parent_node == NULL) {
+    /* The parent is known from now on, but unreachable until it has
+       sent its own DAO. */
+    parent_node = add_node(dag, parent);
+    if(parent_node == NULL) {
+      return NULL;
+    }
+  }
+
+  if(parent_node == child_node) {
+    return NULL;
+  }
+
+  child_node->parent = parent_node;
+  child_node->lifetime = lifetime;
+
+  PRINTF("RPL: NS link ");
+  PRINT6ADDR(child);
+  PRINTF(" -> ");
+  PRINT6ADDR(parent);
+  PRINTF(" lifetime %lu\n", (unsigned long)lifetime);
+
+  return child_node;
+}
+/*---------------------------------------------------------------------------*/
+void
+rpl_ns_expire_parent(rpl_dag_t *dag, const uip_ipaddr_t *child,
+                     const uip_ipaddr_t *parent)
+{
+  rpl_ns_node_t *l;
+
+  l = rpl_ns_get_node(dag, child);
+  /* Only the link to the given parent is removed: the No-Path DAO of
+     an old parent may arrive after the DAO announcing the new one. */
+  if(l != NULL && node_matches_address(dag, l->parent, parent)) {
+    l->lifetime = 0;
+  }
+}
+/*---------------------------------------------------------------------------*/
+int
+rpl_ns_is_node_reachable(const rpl_dag_t *dag, const uip_ipaddr_t *addr)
+{
+  const rpl_ns_node_t *l;
+  int max_depth;
+
+  l = rpl_ns_get_node(dag, addr);
+  for(max_depth = RPL_NS_LINK_NUM; l != NULL && max_depth > 0; max_depth--) {
+    if(node_matches_address(dag, l, &dag->dag_id)) {
+      return 1;
+    }
+    if(l->lifetime == 0) {
+      return 0;
+    }
+    l = l->parent;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+void
+rpl_ns_get_node_global_addr(uip_ipaddr_t *addr, const rpl_ns_node_t *node)
+{
+  if(addr != NULL && node != NULL && node->dag != NULL) {
+    memcpy(addr, &node->dag->prefix_info.prefix, 8);
+    memcpy(((unsigned char *)addr) + 8, node->link_identifier, 8);
+  }
+}
+/*---------------------------------------------------------------------------*/
+rpl_ns_node_t *
+rpl_ns_node_head(void)
+{
+  return list_head(nodelist);
+}
+/*---------------------------------------------------------------------------*/
+rpl_ns_node_t *
+rpl_ns_node_next(rpl_ns_node_t *item)
+{
+  return list_item_next(item);
+}
+/*---------------------------------------------------------------------------*/
+int
+rpl_ns_num_nodes(void)
+{
+  return num_nodes;
+}
+/*---------------------------------------------------------------------------*/
+void
+rpl_ns_periodic(void)
+{
+  rpl_ns_node_t *l;
+  rpl_ns_node_t *next;
+  rpl_ns_node_t *child;
+
+  for(l = list_head(nodelist); l != NULL; l = list_item_next(l)) {
+    if(l->lifetime > 0) {
+      l->lifetime--;
+    }
+  }
+
+  /* Free the expired nodes that are no longer the parent of a node with
+     a live link. Children that still point to them are detached. */
+  for(l = list_head(nodelist); l != NULL; l = next) {
+    next = list_item_next(l);
+    if(l->lifetime > 0) {
+      continue;
+    }
+    for(child = list_head(nodelist); child != NULL;
+        child = list_item_next(child)) {
+      if(child->parent == l && child->lifetime > 0) {
+        break;
+      }
+    }
+    if(child != NULL) {
+      continue;
+    }
+    for(child = list_head(nodelist); child != NULL;
+        child = list_item_next(child)) {
+      if(child->parent == l) {
+        child->parent = NULL;
+      }
+    }
+    list_remove(nodelist, l);
+    node_free(l);
+    num_nodes--;
+  }
+}
+/*---------------------------------------------------------------------------*/
+void
+rpl_ns_init(void)
+{
+  num_nodes = 0;
+  node_memb_init();
+  list_init(nodelist);
+}
+/*---------------------------------------------------------------------------*/
+#endif /* RPL_WITH_NON_STORING */
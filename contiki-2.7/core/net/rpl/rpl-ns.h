@@ -0,0 +1,55 @@
+/**
+ * \file
+ *         Parent graph of a non-storing RPL DAG, kept by the DAG root.
+ *
+ *         Every DAO received by the root of a non-storing DAG reports a
+ *         child-parent link (RFC 6550, section 9.7). The root stores
+ *         one node per target, identified by its interface identifier
+ *         and pointing to the node of its parent, and builds the source
+ *         routes of its downward traffic by walking the parent pointers
+ *         up to itself. Nodes that are only known as parents have a
+ *         lifetime of 0 until their own DAO arrives.
+ */
+
+#ifndef RPL_NS_H
+#define RPL_NS_H
+
+#include "net/rpl/rpl.h"
+
+typedef struct rpl_ns_node {
+  struct rpl_ns_node *next;
+  uint32_t lifetime;
+  rpl_dag_t *dag;
+  /* The interface identifier of the node, below the DAG prefix. */
+  unsigned char link_identifier[8];
+  struct rpl_ns_node *parent;
+} rpl_ns_node_t;
+
+void rpl_ns_init(void);
+
+/* Record that child is attached to parent for lifetime seconds. */
+rpl_ns_node_t *rpl_ns_update_node(rpl_dag_t *dag, const uip_ipaddr_t *child,
+                                  const uip_ipaddr_t *parent,
+                                  uint32_t lifetime);
+
+/* Forget the link from child to parent (a No-Path DAO). */
+void rpl_ns_expire_parent(rpl_dag_t *dag, const uip_ipaddr_t *child,
+                          const uip_ipaddr_t *parent);
+
+rpl_ns_node_t *rpl_ns_get_node(const rpl_dag_t *dag,
+                               const uip_ipaddr_t *addr);
+
+/* Does the chain of parents of node lead to the root with live links? */
+int rpl_ns_is_node_reachable(const rpl_dag_t *dag, const uip_ipaddr_t *addr);
+
+void rpl_ns_get_node_global_addr(uip_ipaddr_t *addr,
+                                 const rpl_ns_node_t *node);
+
+rpl_ns_node_t *rpl_ns_node_head(void);
+rpl_ns_node_t *rpl_ns_node_next(rpl_ns_node_t *item);
+int rpl_ns_num_nodes(void);
+
+/* Age the links by one second and free the nodes that have expired. */
+void rpl_ns_periodic(void);
+
+#endif /* RPL_NS_H */
@@ -177,10 +177,16 @@
 
 #ifdef  RPL_CONF_MOP
 #define RPL_MOP_DEFAULT                 RPL_CONF_MOP
+#elif RPL_WITH_NON_STORING
+#define RPL_MOP_DEFAULT                 RPL_MOP_NON_STORING
 #else
 #define RPL_MOP_DEFAULT                 RPL_MOP_STORING_NO_MULTICAST
 #endif
 
+#define RPL_IS_NON_STORING(instance) \
+  (RPL_WITH_NON_STORING && (instance) != NULL && \
+   (instance)->mop == RPL_MOP_NON_STORING)
+
 /*
  * The ETX in the metric container is expressed as a fixed-point value 
  * whose integer part can be obtained by dividing the value by 
@@ -310,6 +316,8 @@ rpl_of_t *rpl_find_of(rpl_ocp_t);
 /* Timer functions. */
 void rpl_schedule_dao(rpl_instance_t *);
 void rpl_reset_dio_timer(rpl_instance_t *);
+void rpl_dio_metric_changed(rpl_instance_t *);
+int rpl_dio_rank_consistent(rpl_rank_t heard, rpl_rank_t rank);
 void rpl_reset_periodic_timer(void);
 
 /* Route poisoning. */
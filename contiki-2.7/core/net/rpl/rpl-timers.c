@@ -41,9 +41,12 @@
 
 #include "contiki-conf.h"
 #include "net/rpl/rpl-private.h"
+#include "net/rpl/rpl-ns.h"
 #include "lib/random.h"
 #include "sys/ctimer.h"
 
+#include <string.h>
+
 #if UIP_CONF_IPV6
 
 #define DEBUG DEBUG_NONE
@@ -66,6 +69,9 @@ static void
 handle_periodic_timer(void *ptr)
 {
   rpl_purge_routes();
+#if RPL_WITH_NON_STORING
+  rpl_ns_periodic();
+#endif /* RPL_WITH_NON_STORING */
   rpl_recalculate_ranks();
 
   /* handle DIS */
@@ -148,10 +154,12 @@ handle_dio_timer(void *ptr)
 #if RPL_CONF_STATS
       instance->dio_totsend++;
 #endif /* RPL_CONF_STATS */
+      instance->dio_sent++;
       dio_output(instance, NULL);
     } else {
       PRINTF("RPL: Supressing DIO transmission (%d >= %d)\n",
              instance->dio_counter, instance->dio_redundancy);
+      instance->dio_suppressed++;
     }
     instance->dio_send = 0;
     PRINTF("RPL: Scheduling DIO timer %lu ticks in future (sent)\n",
@@ -176,11 +184,92 @@ rpl_reset_periodic_timer(void)
   ctimer_set(&periodic_timer, CLOCK_SECOND, handle_periodic_timer, NULL);
 }
 /*---------------------------------------------------------------------------*/
+#if RPL_DIO_HYSTERESIS
+/* Has value moved by more than RPL_DIO_HYSTERESIS percent from ref? */
+static int
+moved(uint32_t ref, uint32_t value)
+{
+  uint32_t diff;
+
+  diff = value > ref ? value - ref : ref - value;
+  return diff * 100 > (ref > 0 ? ref : 1) * RPL_DIO_HYSTERESIS;
+}
+/*---------------------------------------------------------------------------*/
+/* How much the rank and the metric container of the instance have
+   changed since the last reset: 0 not at all, 1 within the hysteresis,
+   2 beyond it. */
+static int
+metric_change(rpl_instance_t *instance)
+{
+  rpl_rank_t rank;
+  int change;
+
+  rank = instance->current_dag->rank;
+  change = rank != instance->dio_ref_rank;
+  if(moved(instance->dio_ref_rank, rank)) {
+    return 2;
+  }
+#if RPL_DAG_MC != RPL_DAG_MC_NONE
+  if(memcmp(&instance->mc.obj, &instance->dio_ref_mc.obj,
+            sizeof(instance->mc.obj)) != 0) {
+    change = 1;
+    if(moved(instance->dio_ref_mc.obj.etx, instance->mc.obj.etx) ||
+       moved(instance->dio_ref_mc.obj.latency, instance->mc.obj.latency) ||
+       moved(instance->dio_ref_mc.obj.hopcount, instance->mc.obj.hopcount) ||
+       moved(instance->dio_ref_mc.obj.energy.energy_est,
+             instance->mc.obj.energy.energy_est)) {
+      return 2;
+    }
+  }
+#endif /* RPL_DAG_MC != RPL_DAG_MC_NONE */
+  return change;
+}
+#endif /* RPL_DIO_HYSTERESIS */
+/*---------------------------------------------------------------------------*/
+/*
+ * Called when the rank or the metric container of the instance may have
+ * changed. Resets the DIO timer, unless RPL_DIO_HYSTERESIS is set and
+ * the change since the last reset is within it.
+ */
+void
+rpl_dio_metric_changed(rpl_instance_t *instance)
+{
+#if RPL_DIO_HYSTERESIS
+  switch(metric_change(instance)) {
+  case 0:
+    return;
+  case 1:
+    PRINTF("RPL: Rank %u within DIO hysteresis of %u\n",
+           instance->current_dag->rank, instance->dio_ref_rank);
+    instance->dio_resets_avoided++;
+    return;
+  }
+#endif /* RPL_DIO_HYSTERESIS */
+  rpl_reset_dio_timer(instance);
+}
+/*---------------------------------------------------------------------------*/
+/* Is a DIO advertising rank consistent with the rank heard before? */
+int
+rpl_dio_rank_consistent(rpl_rank_t heard, rpl_rank_t rank)
+{
+#if RPL_DIO_HYSTERESIS
+  return !moved(heard, rank);
+#else
+  return heard == rank;
+#endif /* RPL_DIO_HYSTERESIS */
+}
+/*---------------------------------------------------------------------------*/
 /* Resets the DIO timer in the instance to its minimal interval. */
 void
 rpl_reset_dio_timer(rpl_instance_t *instance)
 {
 #if !RPL_LEAF_ONLY
+  if(instance->current_dag != NULL) {
+    instance->dio_ref_rank = instance->current_dag->rank;
+#if RPL_DAG_MC != RPL_DAG_MC_NONE
+    memcpy(&instance->dio_ref_mc, &instance->mc, sizeof(instance->mc));
+#endif /* RPL_DAG_MC != RPL_DAG_MC_NONE */
+  }
   /* Do not reset if we are already on the minimum interval,
      unless forced to do so. */
   if(instance->dio_intcurrent > instance->dio_intmin) {
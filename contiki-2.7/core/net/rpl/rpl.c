@@ -45,6 +45,8 @@
 #include "net/uip-ds6.h"
 #include "net/rpl/rpl-private.h"
 #include "net/rpl/delay_func.h"
+#include "net/rpl/battery.h"
+#include "net/rpl/rpl-ns.h"
 
 #define DEBUG DEBUG_NONE
 #include "net/uip-debug.h"
@@ -88,7 +90,7 @@ rpl_purge_routes(void)
     if(r->state.lifetime < 1) {
       /* Routes with lifetime == 1 have only just been decremented from 2 to 1,
        * thus we want to keep them. Hence < and not <= */
-      uip_ipaddr_copy(&prefix, &r->ipaddr);
+      uip_ds6_route_ipaddr(r, &prefix);
       uip_ds6_route_rm(r);
       r = uip_ds6_route_head();
       PRINTF("No more routes to ");
@@ -176,6 +178,10 @@ rpl_link_neighbor_callback(const rimeaddr_t *addr, int status, int numtx)
   rpl_instance_t *instance;
   rpl_instance_t *end;
 
+#if CONTIKI_DELAY
+  neighbor_info_sent_mac(addr, status);
+#endif /* CONTIKI_DELAY */
+
   uip_ip6addr(&ipaddr, 0xfe80, 0, 0, 0, 0, 0, 0, 0);
   uip_ds6_set_addr_iid(&ipaddr, (uip_lladdr_t *)addr);
 
@@ -223,10 +229,14 @@ rpl_init(void)
   uip_ipaddr_t rplmaddr;
   PRINTF("RPL started\n");
   default_instance = NULL;
-  #if CONTIKI_DELAY
-  time_memb_init();
-  #endif
+#if CONTIKI_DELAY
+  neighbor_info_init();
+  battery_init();
+#endif /* CONTIKI_DELAY */
   rpl_dag_init();
+#if RPL_WITH_NON_STORING
+  rpl_ns_init();
+#endif /* RPL_WITH_NON_STORING */
   rpl_reset_periodic_timer();
 
   /* add rpl multicast address */
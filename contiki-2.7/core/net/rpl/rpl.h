@@ -122,8 +122,16 @@ struct rpl_parent {
   delay_t delay_metric;
   uint8_t dtsn;
   uint8_t updated;
+  uint16_t quality; /* cached by the OF, RPL_PARENT_QUALITY_UNKNOWN if stale */
 };
 typedef struct rpl_parent rpl_parent_t;
+
+/*
+ * Invalidate the path quality cached for a parent. Must be called
+ * whenever the metric container or the link metrics of the parent change.
+ */
+#define RPL_PARENT_QUALITY_UNKNOWN	0xffff
+#define RPL_PARENT_INVALIDATE_QUALITY(p) ((p)->quality = RPL_PARENT_QUALITY_UNKNOWN)
 /*---------------------------------------------------------------------------*/
 /* RPL DIO prefix suboption */
 struct rpl_prefix {
@@ -222,6 +230,16 @@ struct rpl_instance {
   rpl_rank_t max_rankinc;
   rpl_rank_t min_hoprankinc;
   uint16_t lifetime_unit; /* lifetime in seconds = l_u * d_l */
+  /* DIOs sent and suppressed by Trickle, and rank or metric changes
+     that stayed within RPL_DIO_HYSTERESIS and did not reset the timer. */
+  uint16_t dio_sent;
+  uint16_t dio_suppressed;
+  uint16_t dio_resets_avoided;
+  /* Rank and metric container when the DIO timer was last reset. */
+  rpl_rank_t dio_ref_rank;
+#if RPL_DAG_MC != RPL_DAG_MC_NONE
+  rpl_metric_container_t dio_ref_mc;
+#endif /* RPL_DAG_MC != RPL_DAG_MC_NONE */
 #if RPL_CONF_STATS
   uint16_t dio_totint;
   uint16_t dio_totsend;
@@ -232,11 +250,36 @@ struct rpl_instance {
   struct ctimer dao_timer;
 };
 
+/*---------------------------------------------------------------------------*/
+/*
+ * Objective functions that can be registered with rpl_register_of() to
+ * run several instances with different objective functions, e.g. with
+ * RPL_CONF_MAX_INSTANCES set to 2:
+ *
+ *   rpl_set_root(RPL_DEFAULT_INSTANCE, &dag_id);
+ *   rpl_set_root_with_of(ALARM_INSTANCE, &dag_id, &rpl_latencyof);
+ *
+ * at the root, rpl_register_of(&rpl_latencyof) at the other nodes, and
+ * simple_udp_set_rpl_instance(&conn, ALARM_INSTANCE) on the connections
+ * whose packets must be routed on the latency instance.
+ */
+extern rpl_of_t rpl_fuzzyof;
+extern rpl_of_t rpl_mrhof;
+extern rpl_of_t rpl_latencyof;
+/*---------------------------------------------------------------------------*/
+/* Routing header type of the RPL source routing header (RFC 6554). */
+#define RPL_RH_TYPE_SRH 3
 /*---------------------------------------------------------------------------*/
 /* Public RPL functions. */
 void rpl_init(void);
 void uip_rpl_input(void);
 rpl_dag_t *rpl_set_root(uint8_t instance_id, uip_ipaddr_t * dag_id);
+rpl_dag_t *rpl_set_root_with_of(uint8_t instance_id, uip_ipaddr_t *dag_id,
+                                rpl_of_t *of);
+int rpl_register_of(rpl_of_t *of);
+void rpl_set_default_instance(rpl_instance_t *instance);
+void rpl_set_flow_instance(rpl_instance_t *instance);
+uip_ipaddr_t *rpl_get_flow_nexthop(void);
 int rpl_set_prefix(rpl_dag_t *dag, uip_ipaddr_t *prefix, unsigned len);
 int rpl_repair_root(uint8_t instance_id);
 int rpl_set_default_route(rpl_instance_t *instance, uip_ipaddr_t *from);
@@ -248,6 +291,8 @@ int rpl_verify_header(int);
 void rpl_insert_header(void);
 void rpl_remove_header(void);
 uint8_t rpl_invert_header(void);
+int rpl_srh_get_next_hop(uip_ipaddr_t *ipaddr);
+int rpl_process_srh_header(void);
 uip_ipaddr_t *rpl_get_parent_ipaddr(rpl_parent_t *nbr);
 rpl_rank_t rpl_get_parent_rank(uip_lladdr_t *addr);
 uint16_t rpl_get_parent_link_metric(uip_lladdr_t *addr);
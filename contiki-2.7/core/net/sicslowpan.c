@@ -66,6 +66,8 @@
 #include "net/rime.h"
 #include "net/sicslowpan.h"
 #include "net/netstack.h"
+#include "lib/list.h"
+#include "lib/memb.h"
 
 #if CONTIKI_DELAY
 #include "net/delay.h"
@@ -219,40 +221,95 @@ static uint8_t uncomp_hdr_len;
 static int last_tx_status;
 /** @} */
 
+#if SICSLOWPAN_CONF_FRAG && UIP_CONF_ROUTER
+#define FRAG_FORWARDING SICSLOWPAN_FRAG_FORWARDING
+#else
+#define FRAG_FORWARDING 0
+#endif
+
+#if FRAG_FORWARDING && UIP_CONF_IPV6_QUEUE_PKT
+/* Forwarded first fragments must not be queued by the neighbor cache,
+   as only the beginning of the packet is in uip_buf. */
+#error "6lowpan fragment forwarding needs UIP_CONF_IPV6_QUEUE_PKT 0"
+#endif
+
 #if SICSLOWPAN_CONF_FRAG
 /** \name Fragmentation related variables
  *  @{
  */
 
+/** The total length of the IPv6 packet in the sicslowpan_buf. */
 static uint16_t sicslowpan_len;
 
 /**
- * The buffer used for the 6lowpan reassembly.
- * This buffer contains only the IPv6 packet (no MAC header, 6lowpan, etc).
- * It has a fix size as we do not use dynamic memory allocation.
+ * A packet being reassembled. The fragments of a packet are identified
+ * by the link-layer address of their sender, their datagram tag and the
+ * size of the packet (RFC 4944, section 5.3).
  */
-static uip_buf_t sicslowpan_aligned_buf;
-#define sicslowpan_buf (sicslowpan_aligned_buf.u8)
+struct reass_context {
+  struct reass_context *next;
+  rimeaddr_t sender;
+  uint16_t tag;
+  uint16_t size;
+  /**
+   * length of the ip packet already received.
+   * It includes IP and transport headers.
+   */
+  uint16_t processed_len;
+  /** Reassembly timeout of the packet. */
+  struct timer timer;
+  /**
+   * The buffer the packet is reassembled in. It contains only the
+   * IPv6 packet (no MAC header, 6lowpan, etc).
+   */
+  uip_buf_t buf;
+};
 
-/** The total length of the IPv6 packet in the sicslowpan_buf. */
+/**
+ * The reassembly contexts. They have a fixed size as we do not use
+ * dynamic memory allocation; the list keeps the most recently used
+ * first, and the least recently used is evicted to start reassembling
+ * a new packet when they are all in use.
+ */
+MEMB(reass_memb, struct reass_context, SICSLOWPAN_REASS_CONTEXTS);
+LIST(reass_list);
 
 /**
- * length of the ip packet already sent / received.
- * It includes IP and transport headers.
+ * The buffer the packet being received is decompressed into: the
+ * buffer of its reassembly context for fragments, uip_buf for packets
+ * that fit in a single frame, so that these are not copied once more.
  */
-static uint16_t processed_ip_in_len;
+static uint8_t *sicslowpan_buf = uip_buf;
 
 /** Datagram tag to be put in the fragments I send. */
 static uint16_t my_tag;
 
-/** When reassembling, the tag in the fragments being merged. */
-static uint16_t reass_tag;
+#if FRAG_FORWARDING
+/**
+ * A packet whose fragments are forwarded as they arrive: the fragments
+ * from the previous hop with the given tag and size are sent to the
+ * next hop with the tag we gave to the first one.
+ */
+struct frag_forward {
+  struct frag_forward *next;
+  rimeaddr_t sender;
+  uint16_t tag;
+  uint16_t size;
+  rimeaddr_t next_hop;
+  uint16_t out_tag;
+  /** Forwarding timeout of the packet. */
+  struct timer timer;
+};
 
-/** When reassembling, the source address of the fragments being merged */
-rimeaddr_t frag_sender;
+MEMB(forward_memb, struct frag_forward, SICSLOWPAN_FRAG_FORWARD_ENTRIES);
+LIST(forward_list);
 
-/** Reassembly %process %timer. */
-static struct timer reass_timer;
+/**
+ * The packet whose first fragment is being routed by the IP layer, or
+ * NULL once output() has sent it as a forwarded first fragment.
+ */
+static struct reass_context *switching;
+#endif /* FRAG_FORWARDING */
 
 /** @} */
 #else /* SICSLOWPAN_CONF_FRAG */
@@ -1340,8 +1397,9 @@ send_packet(rimeaddr_t *dest)
     packetbuf_set_attr(PACKETBUF_ATTR_RELIABLE, 1);
 #endif
 #if CONTIKI_DELAY
-neighbor_info_send_mac(dest) ;
-#endif
+  /* Timestamp and tag the frame for per-neighbor MAC delay sampling. */
+  neighbor_info_send_mac(dest);
+#endif /* CONTIKI_DELAY */
 
   /* Provide a callback function to receive the result of
      a packet transmission. */
@@ -1351,6 +1409,97 @@ neighbor_info_send_mac(dest) ;
      watchdog know that we are still alive. */
   watchdog_periodic();
 }
+#if FRAG_FORWARDING
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Is the packet in uip_buf the first fragment being routed?
+ *
+ * The IP layer may send other packets while routing it, for instance
+ * an ICMP error message, which have one of our addresses as source.
+ * The destination is not compared, as routing may rewrite it, for
+ * instance when it processes a source routing header.
+ */
+static int
+is_switching(void)
+{
+  struct uip_ip_hdr *ip;
+
+  if(switching == NULL) {
+    return 0;
+  }
+  ip = (struct uip_ip_hdr *)&switching->buf.u8[UIP_LLH_LEN];
+  return uip_ipaddr_cmp(&UIP_IP_BUF->srcipaddr, &ip->srcipaddr);
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Send the routed first fragment of a packet to its next hop.
+ * \param dest the link layer address of the next hop
+ * \param framer_hdrlen the length of the MAC header
+ *
+ * The headers in uip_buf have been compressed in packetbuf. The
+ * fragment carries the same part of the packet as the one we received,
+ * so that the offsets of the following fragments stay the same, and a
+ * forwarding entry is added for them. If this does not fit in a frame,
+ * or if routing changed the size of the packet, for instance by adding
+ * an extension header, the offsets would not hold: switching is left on,
+ * nothing is sent and the packet is reassembled instead.
+ */
+static uint8_t
+forward_first(rimeaddr_t *dest, int framer_hdrlen)
+{
+  struct frag_forward *fwd;
+  uint16_t len;
+
+  if(uip_len != switching->size) {
+    PRINTFO("sicslowpan output: routed packet changed size, reassembling\n");
+    return 0;
+  }
+  len = switching->processed_len;
+  if(uncomp_hdr_len > len ||
+     rime_hdr_len + SICSLOWPAN_FRAG1_HDR_LEN + len - uncomp_hdr_len >
+     MAC_MAX_PAYLOAD - framer_hdrlen) {
+    PRINTFO("sicslowpan output: first fragment does not fit, reassembling\n");
+    return 0;
+  }
+  fwd = memb_alloc(&forward_memb);
+  if(fwd == NULL) {
+    PRINTFO("sicslowpan output: no forwarding entry, reassembling\n");
+    return 0;
+  }
+
+  rimeaddr_copy(&fwd->sender, &switching->sender);
+  fwd->tag = switching->tag;
+  fwd->size = switching->size;
+  rimeaddr_copy(&fwd->next_hop, dest);
+  fwd->out_tag = my_tag++;
+  timer_set(&fwd->timer, SICSLOWPAN_REASS_MAXAGE * CLOCK_SECOND / 16);
+  list_add(forward_list, fwd);
+  switching = NULL;
+
+  memmove(rime_ptr + SICSLOWPAN_FRAG1_HDR_LEN, rime_ptr, rime_hdr_len);
+  SET16(RIME_FRAG_PTR, RIME_FRAG_DISPATCH_SIZE,
+        ((SICSLOWPAN_DISPATCH_FRAG1 << 8) | uip_len));
+  SET16(RIME_FRAG_PTR, RIME_FRAG_TAG, fwd->out_tag);
+  rime_hdr_len += SICSLOWPAN_FRAG1_HDR_LEN;
+  rime_payload_len = len - uncomp_hdr_len;
+  PRINTFO("sicslowpan output: forwarding first fragment (len %d, tag %d)\n",
+          rime_payload_len, fwd->out_tag);
+  memcpy(rime_ptr + rime_hdr_len,
+         (uint8_t *)UIP_IP_BUF + uncomp_hdr_len, rime_payload_len);
+  packetbuf_set_datalen(rime_payload_len + rime_hdr_len);
+  send_packet(dest);
+
+  if((last_tx_status == MAC_TX_COLLISION) ||
+     (last_tx_status == MAC_TX_ERR) ||
+     (last_tx_status == MAC_TX_ERR_FATAL)) {
+    PRINTFO("error in fragment tx, dropping subsequent fragments.\n");
+    list_remove(forward_list, fwd);
+    memb_free(&forward_memb, fwd);
+    return 0;
+  }
+  return 1;
+}
+#endif /* FRAG_FORWARDING */
 /*--------------------------------------------------------------------*/
 /** \brief Take an IP packet and format it to be sent on an 802.15.4
  *  network using 6lowpan.
@@ -1455,9 +1604,17 @@ output(uip_lladdr_t *localdest)
   framer_hdrlen = 21;
 #endif /* USE_FRAMER_HDRLEN */
 
+#if FRAG_FORWARDING
+  if(is_switching()) {
+    /* Only the beginning of the packet is in uip_buf: it is sent as a
+       first fragment even if the whole packet would fit in a frame. */
+    return forward_first(&dest, framer_hdrlen);
+  }
+#endif /* FRAG_FORWARDING */
+
   if((int)uip_len - (int)uncomp_hdr_len > (int)MAC_MAX_PAYLOAD - framer_hdrlen - (int)rime_hdr_len) {
 #if SICSLOWPAN_CONF_FRAG
-    struct queuebuf *q;
+    uint16_t frag_tag;
     /*
      * The outbound IPv6 packet is too large to fit into a single 15.4
      * packet, so we fragment it into multiple packets and send them.
@@ -1483,8 +1640,8 @@ output(uip_lladdr_t *localdest)
     SET16(RIME_FRAG_PTR, RIME_FRAG_DISPATCH_SIZE,
           ((SICSLOWPAN_DISPATCH_FRAG1 << 8) | uip_len));
 /*     RIME_FRAG_BUF->tag = uip_htons(my_tag); */
-    SET16(RIME_FRAG_PTR, RIME_FRAG_TAG, my_tag);
-    my_tag++;
+    frag_tag = my_tag++;
+    SET16(RIME_FRAG_PTR, RIME_FRAG_TAG, frag_tag);
 
     /* Copy payload and send */
     rime_hdr_len += SICSLOWPAN_FRAG1_HDR_LEN;
@@ -1493,15 +1650,7 @@ output(uip_lladdr_t *localdest)
     memcpy(rime_ptr + rime_hdr_len,
            (uint8_t *)UIP_IP_BUF + uncomp_hdr_len, rime_payload_len);
     packetbuf_set_datalen(rime_payload_len + rime_hdr_len);
-    q = queuebuf_new_from_packetbuf();
-    if(q == NULL) {
-      PRINTFO("could not allocate queuebuf for first fragment, dropping packet\n");
-      return 0;
-    }
     send_packet(&dest);
-    queuebuf_to_packetbuf(q);
-    queuebuf_free(q);
-    q = NULL;
 
     /* Check tx result. */
     if((last_tx_status == MAC_TX_COLLISION) ||
@@ -1516,17 +1665,29 @@ output(uip_lladdr_t *localdest)
     
     /*
      * Create following fragments
-     * Datagram tag is already in the buffer, we need to set the
-     * FRAGN dispatch and for each fragment, the offset
+     * Each fragment gets the FRAGN dispatch, the datagram tag and its
+     * offset
      */
     rime_hdr_len = SICSLOWPAN_FRAGN_HDR_LEN;
-/*     RIME_FRAG_BUF->dispatch_size = */
-/*       uip_htons((SICSLOWPAN_DISPATCH_FRAGN << 8) | uip_len); */
-    SET16(RIME_FRAG_PTR, RIME_FRAG_DISPATCH_SIZE,
-          ((SICSLOWPAN_DISPATCH_FRAGN << 8) | uip_len));
     rime_payload_len = (MAC_MAX_PAYLOAD - framer_hdrlen - rime_hdr_len) & 0xf8;
     while(processed_ip_out_len < uip_len) {
       PRINTFO("sicslowpan output: fragment ");
+      /*
+       * The MAC layer keeps its own copy of the fragments it queues, so
+       * the previous fragment is not saved and restored around its
+       * transmission. packetbuf is cleared instead, as the lower layers
+       * may have moved its data pointer, and the fragment is built at
+       * the new one.
+       */
+      packetbuf_clear();
+      rime_ptr = packetbuf_dataptr();
+      packetbuf_set_attr(PACKETBUF_ATTR_MAX_MAC_TRANSMISSIONS,
+                         SICSLOWPAN_MAX_MAC_TRANSMISSIONS);
+/*     RIME_FRAG_BUF->dispatch_size = */
+/*       uip_htons((SICSLOWPAN_DISPATCH_FRAGN << 8) | uip_len); */
+      SET16(RIME_FRAG_PTR, RIME_FRAG_DISPATCH_SIZE,
+            ((SICSLOWPAN_DISPATCH_FRAGN << 8) | uip_len));
+      SET16(RIME_FRAG_PTR, RIME_FRAG_TAG, frag_tag);
       RIME_FRAG_PTR[RIME_FRAG_OFFSET] = processed_ip_out_len >> 3;
       
       /* Copy payload and send */
@@ -1539,15 +1700,7 @@ output(uip_lladdr_t *localdest)
       memcpy(rime_ptr + rime_hdr_len,
              (uint8_t *)UIP_IP_BUF + processed_ip_out_len, rime_payload_len);
       packetbuf_set_datalen(rime_payload_len + rime_hdr_len);
-      q = queuebuf_new_from_packetbuf();
-      if(q == NULL) {
-        PRINTFO("could not allocate queuebuf, dropping fragment\n");
-        return 0;
-      }
       send_packet(&dest);
-      queuebuf_to_packetbuf(q);
-      queuebuf_free(q);
-      q = NULL;
       processed_ip_out_len += rime_payload_len;
 
       /* Check tx result. */
@@ -1576,6 +1729,246 @@ output(uip_lladdr_t *localdest)
   return 1;
 }
 
+#if SICSLOWPAN_CONF_FRAG
+/*--------------------------------------------------------------------*/
+/** \brief Abandon the reassembly of a packet. */
+static void
+reass_free(struct reass_context *ctx)
+{
+  if(ctx != NULL) {
+    list_remove(reass_list, ctx);
+    memb_free(&reass_memb, ctx);
+  }
+}
+/*--------------------------------------------------------------------*/
+/** \brief Abandon the reassemblies that have timed out. */
+static void
+reass_expire(void)
+{
+  struct reass_context *ctx, *next;
+
+  for(ctx = list_head(reass_list); ctx != NULL; ctx = next) {
+    next = list_item_next(ctx);
+    if(timer_expired(&ctx->timer)) {
+      PRINTFI("sicslowpan input: reassembly timed out (tag %d)\n", ctx->tag);
+      RIMESTATS_ADD(reasstimedout);
+      reass_free(ctx);
+    }
+  }
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Start reassembling a packet from the sender of the packet in
+ * packetbuf.
+ *
+ * A first fragment means that the sender has given up on any other
+ * packet it was sending us, so the reassembly of these is abandoned
+ * rather than kept until it times out; with fragment forwarding, only
+ * of the packet it sends again, as the packets forwarded by a neighbor
+ * are interleaved. If all the contexts are in use, the least recently
+ * used one is evicted.
+ */
+static struct reass_context *
+reass_new(uint16_t tag, uint16_t size)
+{
+  const rimeaddr_t *sender = packetbuf_addr(PACKETBUF_ADDR_SENDER);
+  struct reass_context *ctx, *next;
+
+  for(ctx = list_head(reass_list); ctx != NULL; ctx = next) {
+    next = list_item_next(ctx);
+    if(rimeaddr_cmp(&ctx->sender, sender)
+#if SICSLOWPAN_FRAG_FORWARDING
+       && ctx->tag == tag
+#endif /* SICSLOWPAN_FRAG_FORWARDING */
+       ) {
+      reass_free(ctx);
+    }
+  }
+
+  ctx = memb_alloc(&reass_memb);
+  if(ctx == NULL) {
+    ctx = list_chop(reass_list);
+    PRINTFI("sicslowpan input: evicting reassembly (tag %d)\n", ctx->tag);
+    RIMESTATS_ADD(reassevicted);
+  }
+
+  rimeaddr_copy(&ctx->sender, sender);
+  ctx->tag = tag;
+  ctx->size = size;
+  ctx->processed_len = 0;
+  timer_set(&ctx->timer, SICSLOWPAN_REASS_MAXAGE * CLOCK_SECOND / 16);
+  list_push(reass_list, ctx);
+  return ctx;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Find the packet that the fragment in packetbuf belongs to,
+ * and mark it as the most recently used.
+ */
+static struct reass_context *
+reass_lookup(uint16_t tag, uint16_t size)
+{
+  const rimeaddr_t *sender = packetbuf_addr(PACKETBUF_ADDR_SENDER);
+  struct reass_context *ctx;
+
+  for(ctx = list_head(reass_list); ctx != NULL; ctx = list_item_next(ctx)) {
+    if(ctx->tag == tag && ctx->size == size &&
+       rimeaddr_cmp(&ctx->sender, sender)) {
+      list_remove(reass_list, ctx);
+      list_push(reass_list, ctx);
+      return ctx;
+    }
+  }
+  return NULL;
+}
+#if FRAG_FORWARDING
+/*--------------------------------------------------------------------*/
+/** \brief Forget the forwarded packets that have timed out. */
+static void
+forward_expire(void)
+{
+  struct frag_forward *fwd, *next;
+
+  for(fwd = list_head(forward_list); fwd != NULL; fwd = next) {
+    next = list_item_next(fwd);
+    if(timer_expired(&fwd->timer)) {
+      list_remove(forward_list, fwd);
+      memb_free(&forward_memb, fwd);
+    }
+  }
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Forward the fragment in packetbuf if the first fragment of its
+ * packet was forwarded.
+ * \return 1 if the fragment was forwarded, 0 otherwise
+ *
+ * The fragment is sent as it is, with the tag we gave to the packet.
+ */
+static int
+forward_next(uint16_t tag, uint16_t size, uint8_t offset)
+{
+  const rimeaddr_t *sender = packetbuf_addr(PACKETBUF_ADDR_SENDER);
+  struct frag_forward *fwd;
+  rimeaddr_t next_hop;
+  uint8_t *frag;
+  uint16_t len;
+
+  for(fwd = list_head(forward_list); fwd != NULL; fwd = list_item_next(fwd)) {
+    if(fwd->tag == tag && fwd->size == size &&
+       rimeaddr_cmp(&fwd->sender, sender)) {
+      break;
+    }
+  }
+  if(fwd == NULL) {
+    return 0;
+  }
+
+  /* Move the fragment to the beginning of packetbuf, where the MAC
+     header of the received frame was, and give it our tag. */
+  frag = packetbuf_dataptr();
+  len = packetbuf_datalen();
+  packetbuf_clear();
+  rime_ptr = packetbuf_dataptr();
+  memmove(rime_ptr, frag, len);
+  packetbuf_set_datalen(len);
+  SET16(RIME_FRAG_PTR, RIME_FRAG_TAG, fwd->out_tag);
+  packetbuf_set_attr(PACKETBUF_ATTR_MAX_MAC_TRANSMISSIONS,
+                     SICSLOWPAN_MAX_MAC_TRANSMISSIONS);
+  PRINTFI("sicslowpan input: forwarding fragment (offset %d, tag %d)\n",
+          offset, fwd->out_tag);
+
+  rimeaddr_copy(&next_hop, &fwd->next_hop);
+  if(((uint16_t)offset << 3) + len - SICSLOWPAN_FRAGN_HDR_LEN >= size) {
+    /* This is the last fragment. */
+    list_remove(forward_list, fwd);
+    memb_free(&forward_memb, fwd);
+    fwd = NULL;
+  }
+  send_packet(&next_hop);
+
+  if(fwd != NULL &&
+     ((last_tx_status == MAC_TX_COLLISION) ||
+      (last_tx_status == MAC_TX_ERR) ||
+      (last_tx_status == MAC_TX_ERR_FATAL))) {
+    PRINTFI("error in fragment tx, dropping subsequent fragments.\n");
+    list_remove(forward_list, fwd);
+    memb_free(&forward_memb, fwd);
+  }
+  return 1;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Can the first fragment of a packet be routed without the rest?
+ *
+ * It must be a packet for another node that leaves through this
+ * interface again, for instance not to the fallback interface of a
+ * border router, and the headers a router processes must all be in it.
+ */
+static int
+switchable(struct reass_context *ctx)
+{
+  struct uip_ip_hdr *ip = (struct uip_ip_hdr *)&ctx->buf.u8[UIP_LLH_LEN];
+  uint8_t *hdr;
+  uint8_t proto;
+  uint16_t len;
+
+  if(uip_is_addr_mcast(&ip->destipaddr) ||
+     uip_ds6_is_my_addr(&ip->destipaddr) ||
+     uip_ds6_is_my_aaddr(&ip->destipaddr) ||
+     ip->ttl <= 1) {
+    return 0;
+  }
+  if(!uip_ds6_is_addr_onlink(&ip->destipaddr) &&
+     uip_ds6_route_lookup(&ip->destipaddr) == NULL &&
+     uip_ds6_defrt_choose() == NULL) {
+    return 0;
+  }
+
+  proto = ip->proto;
+  len = UIP_IPH_LEN;
+  while(proto == UIP_PROTO_HBHO || proto == UIP_PROTO_DESTO ||
+        proto == UIP_PROTO_ROUTING) {
+    if(len + 2 > ctx->processed_len) {
+      return 0;
+    }
+    hdr = (uint8_t *)ip + len;
+    proto = hdr[0];
+    len += (hdr[1] + 1) << 3;
+  }
+  return len <= ctx->processed_len;
+}
+/*--------------------------------------------------------------------*/
+/**
+ * \brief Route the first fragment of a packet and forward it.
+ * \return 1 if it was forwarded or dropped, 0 if the packet must be
+ * reassembled
+ *
+ * The IP layer is given the packet with its size, and the part that is
+ * still to come zeroed. It processes the headers as for any packet it
+ * forwards, and output() recognizes the packet and only sends the
+ * received part as a first fragment.
+ */
+static int
+forward_first_fragment(struct reass_context *ctx)
+{
+  memcpy((uint8_t *)UIP_IP_BUF, (uint8_t *)&ctx->buf.u8[UIP_LLH_LEN],
+         ctx->processed_len);
+  memset((uint8_t *)UIP_IP_BUF + ctx->processed_len, 0,
+         ctx->size - ctx->processed_len);
+  uip_len = ctx->size;
+
+  switching = ctx;
+  tcpip_input();
+  if(switching != NULL) {
+    switching = NULL;
+    return 0;
+  }
+  reass_free(ctx);
+  return 1;
+}
+#endif /* FRAG_FORWARDING */
+#endif /* SICSLOWPAN_CONF_FRAG */
 /*--------------------------------------------------------------------*/
 /** \brief Process a received 6lowpan packet.
  *  \param r The MAC layer
@@ -1583,7 +1976,8 @@ output(uip_lladdr_t *localdest)
  *  The 6lowpan packet is put in packetbuf by the MAC. If its a frag1 or
  *  a non-fragmented packet we first uncompress the IP header. The
  *  6lowpan payload and possibly the uncompressed IP header are then
- *  copied in siclowpan_buf. If the IP packet is complete it is copied
+ *  copied in uip_buf, or in the buffer of the reassembly context of the
+ *  packet for a fragment. If the IP packet is complete it is copied
  *  to uip_buf and the IP layer is called.
  *
  * \note We do not check for overlapping sicslowpan fragments
@@ -1600,7 +1994,9 @@ input(void)
 #if SICSLOWPAN_CONF_FRAG
   /* tag of the fragment */
   uint16_t frag_tag = 0;
-  uint8_t first_fragment = 0, last_fragment = 0;
+  uint8_t first_fragment = 0;
+  /* the packet the fragment belongs to */
+  struct reass_context *ctx = NULL;
 #endif /*SICSLOWPAN_CONF_FRAG*/
 
   /* init */
@@ -1611,11 +2007,12 @@ input(void)
   rime_ptr = packetbuf_dataptr();
 
 #if SICSLOWPAN_CONF_FRAG
-  /* if reassembly timed out, cancel it */
-  if(timer_expired(&reass_timer)) {
-    sicslowpan_len = 0;
-    processed_ip_in_len = 0;
-  }
+  /* cancel the reassemblies that timed out */
+  reass_expire();
+#if FRAG_FORWARDING
+  forward_expire();
+#endif /* FRAG_FORWARDING */
+
   /*
    * Since we don't support the mesh and broadcast header, the first header
    * we look for is the fragmentation header
@@ -1631,7 +2028,6 @@ input(void)
       PRINTFI("size %d, tag %d, offset %d)\n",
              frag_size, frag_tag, frag_offset);
       rime_hdr_len += SICSLOWPAN_FRAG1_HDR_LEN;
-      /*      printf("frag1 %d %d\n", reass_tag, frag_tag);*/
       first_fragment = 1;
       is_fragment = 1;
       break;
@@ -1647,72 +2043,49 @@ input(void)
       PRINTFI("size %d, tag %d, offset %d)\n",
              frag_size, frag_tag, frag_offset);
       rime_hdr_len += SICSLOWPAN_FRAGN_HDR_LEN;
-
-      /* If this is the last fragment, we may shave off any extrenous
-         bytes at the end. We must be liberal in what we accept. */
-      PRINTFI("last_fragment?: processed_ip_in_len %d rime_payload_len %d frag_size %d\n",
-              processed_ip_in_len, packetbuf_datalen() - rime_hdr_len, frag_size);
-
-      if(processed_ip_in_len + packetbuf_datalen() - rime_hdr_len >= frag_size) {
-        last_fragment = 1;
-      }
       is_fragment = 1;
       break;
     default:
       break;
   }
 
-  /* We are currently reassembling a packet, but have just received the first
-   * fragment of another packet. We can either ignore it and hope to receive
-   * the rest of the under-reassembly packet fragments, or we can discard the
-   * previous packet altogether, and start reassembling the new packet.
-   *
-   * We discard the previous packet, and start reassembling the new packet.
-   * This lessens the negative impacts of too high SICSLOWPAN_REASS_MAXAGE.
+  /*
+   * Several packets may be reassembled at the same time, from different
+   * senders. A first fragment starts the reassembly of a new packet and
+   * abandons the packets that were in progress from the same sender,
+   * as a node sends one packet at a time. With fragment forwarding, the
+   * sender may be a router relaying the packets of several nodes, and
+   * only a packet with the same tag is abandoned. The following
+   * fragments are added to the packet with the same sender, tag and
+   * size; any other fragment is dropped.
    */
-#define PRIORITIZE_NEW_PACKETS 1
-#if PRIORITIZE_NEW_PACKETS
-  if(processed_ip_in_len > 0 && first_fragment
-      && !rimeaddr_cmp(&frag_sender, packetbuf_addr(PACKETBUF_ADDR_SENDER))) {
-    sicslowpan_len = 0;
-    processed_ip_in_len = 0;
-  }
-#endif /* PRIORITIZE_NEW_PACKETS */
-
-  if(processed_ip_in_len > 0) {
-    /* reassembly is ongoing */
-    /*    printf("frag %d %d\n", reass_tag, frag_tag);*/
-    if((frag_size > 0 &&
-        (frag_size != sicslowpan_len ||
-         reass_tag  != frag_tag ||
-         !rimeaddr_cmp(&frag_sender, packetbuf_addr(PACKETBUF_ADDR_SENDER))))  ||
-       frag_size == 0) {
-      /*
-       * the packet is a fragment that does not belong to the packet
-       * being reassembled or the packet is not a fragment.
-       */
-      PRINTFI("sicslowpan input: Dropping 6lowpan packet that is not a fragment of the packet currently being reassembled\n");
+  if(is_fragment) {
+    if(frag_size == 0 || frag_size > UIP_BUFSIZE - UIP_LLH_LEN) {
+      PRINTFI("sicslowpan input: Dropping fragment of a packet of size %d\n",
+              frag_size);
+      RIMESTATS_ADD(reassdrop);
       return;
     }
-  } else {
-    /*
-     * reassembly is off
-     * start it if we received a fragment
-     */
-    if((frag_size > 0) && (frag_size <= UIP_BUFSIZE)) {
-      /* We are currently not reassembling a packet, but have received a packet fragment
-       * that is not the first one. */
-      if(is_fragment && !first_fragment) {
+#if FRAG_FORWARDING
+    if(!first_fragment && forward_next(frag_tag, frag_size, frag_offset)) {
+      return;
+    }
+#endif /* FRAG_FORWARDING */
+    if(first_fragment) {
+      ctx = reass_new(frag_tag, frag_size);
+      PRINTFI("sicslowpan input: INIT FRAGMENTATION (len %d, tag %d)\n",
+              frag_size, frag_tag);
+    } else {
+      ctx = reass_lookup(frag_tag, frag_size);
+      if(ctx == NULL) {
+        PRINTFI("sicslowpan input: Dropping 6lowpan fragment of a packet that is not being reassembled\n");
+        RIMESTATS_ADD(reassdrop);
         return;
       }
-
-      sicslowpan_len = frag_size;
-      reass_tag = frag_tag;
-      timer_set(&reass_timer, SICSLOWPAN_REASS_MAXAGE * CLOCK_SECOND / 16);
-      PRINTFI("sicslowpan input: INIT FRAGMENTATION (len %d, tag %d)\n",
-             sicslowpan_len, reass_tag);
-      rimeaddr_copy(&frag_sender, packetbuf_addr(PACKETBUF_ADDR_SENDER));
     }
+    sicslowpan_buf = ctx->buf.u8;
+  } else {
+    sicslowpan_buf = uip_buf;
   }
 
   if(rime_hdr_len == SICSLOWPAN_FRAGN_HDR_LEN) {
@@ -1750,6 +2123,9 @@ input(void)
       /* unknown header */
       PRINTFI("sicslowpan input: unknown dispatch: %u\n",
              RIME_HC1_PTR[RIME_HC1_DISPATCH]);
+#if SICSLOWPAN_CONF_FRAG
+      reass_free(ctx);
+#endif /* SICSLOWPAN_CONF_FRAG */
       return;
   }
    
@@ -1766,6 +2142,9 @@ input(void)
    */
   if(packetbuf_datalen() < rime_hdr_len) {
     PRINTF("SICSLOWPAN: packet dropped due to header > total packet\n");
+#if SICSLOWPAN_CONF_FRAG
+    reass_free(ctx);
+#endif /* SICSLOWPAN_CONF_FRAG */
     return;
   }
   rime_payload_len = packetbuf_datalen() - rime_hdr_len;
@@ -1774,34 +2153,43 @@ input(void)
   {
     int req_size = UIP_LLH_LEN + uncomp_hdr_len + (uint16_t)(frag_offset << 3)
         + rime_payload_len;
-    if(req_size > sizeof(sicslowpan_buf)) {
+    if(req_size > UIP_BUFSIZE) {
       PRINTF(
           "SICSLOWPAN: packet dropped, minimum required SICSLOWPAN_IP_BUF size: %d+%d+%d+%d=%d (current size: %d)\n",
           UIP_LLH_LEN, uncomp_hdr_len, (uint16_t)(frag_offset << 3),
-          rime_payload_len, req_size, sizeof(sicslowpan_buf));
+          rime_payload_len, req_size, UIP_BUFSIZE);
+#if SICSLOWPAN_CONF_FRAG
+      if(ctx != NULL) {
+        RIMESTATS_ADD(reassdrop);
+        reass_free(ctx);
+      }
+#endif /* SICSLOWPAN_CONF_FRAG */
       return;
     }
   }
 
   memcpy((uint8_t *)SICSLOWPAN_IP_BUF + uncomp_hdr_len + (uint16_t)(frag_offset << 3), rime_ptr + rime_hdr_len, rime_payload_len);
   
-  /* update processed_ip_in_len if fragment, sicslowpan_len otherwise */
+  /* update the processed length of the packet if fragment, sicslowpan_len otherwise */
 
 #if SICSLOWPAN_CONF_FRAG
-  if(frag_size > 0) {
+  if(ctx != NULL) {
     /* Add the size of the header only for the first fragment. */
-    if(first_fragment != 0) {
-      processed_ip_in_len += uncomp_hdr_len;
+    ctx->processed_len += uncomp_hdr_len + rime_payload_len;
+    /* For the last fragment, we may shave off any extrenous bytes at the
+       end of the packet. We must be liberal in what we accept. */
+    if(ctx->processed_len > ctx->size) {
+      ctx->processed_len = ctx->size;
     }
-    /* For the last fragment, we are OK if there is extrenous bytes at
-       the end of the packet. */
-    if(last_fragment != 0) {
-      processed_ip_in_len = frag_size;
-    } else {
-      processed_ip_in_len += rime_payload_len;
+    PRINTF("processed_len %d, rime_payload_len %d\n", ctx->processed_len, rime_payload_len);
+    sicslowpan_len = ctx->size;
+#if FRAG_FORWARDING
+    if(first_fragment && ctx->processed_len < ctx->size &&
+       switchable(ctx) && forward_first_fragment(ctx)) {
+      sicslowpan_buf = uip_buf;
+      return;
     }
-    PRINTF("processed_ip_in_len %d, rime_payload_len %d\n", processed_ip_in_len, rime_payload_len);
-
+#endif /* FRAG_FORWARDING */
   } else {
 #endif /* SICSLOWPAN_CONF_FRAG */
     sicslowpan_len = rime_payload_len + uncomp_hdr_len;
@@ -1812,15 +2200,15 @@ input(void)
    * If we have a full IP packet in sicslowpan_buf, deliver it to
    * the IP stack
    */
-  PRINTF("sicslowpan_init processed_ip_in_len %d, sicslowpan_len %d\n",
-         processed_ip_in_len, sicslowpan_len);
-  if(processed_ip_in_len == 0 || (processed_ip_in_len == sicslowpan_len)) {
+  if(ctx == NULL || ctx->processed_len == ctx->size) {
     PRINTFI("sicslowpan input: IP packet ready (length %d)\n",
            sicslowpan_len);
-    memcpy((uint8_t *)UIP_IP_BUF, (uint8_t *)SICSLOWPAN_IP_BUF, sicslowpan_len);
+    if(ctx != NULL) {
+      memcpy((uint8_t *)UIP_IP_BUF, (uint8_t *)SICSLOWPAN_IP_BUF, sicslowpan_len);
+    }
     uip_len = sicslowpan_len;
-    sicslowpan_len = 0;
-    processed_ip_in_len = 0;
+    reass_free(ctx);
+    sicslowpan_buf = uip_buf;
 #endif /* SICSLOWPAN_CONF_FRAG */
 
 #if DEBUG
@@ -1860,6 +2248,15 @@ sicslowpan_init(void)
    */
   tcpip_set_outputfunc(output);
 
+#if SICSLOWPAN_CONF_FRAG
+  memb_init(&reass_memb);
+  list_init(reass_list);
+#if FRAG_FORWARDING
+  memb_init(&forward_memb);
+  list_init(forward_list);
+#endif /* FRAG_FORWARDING */
+#endif /* SICSLOWPAN_CONF_FRAG */
+
 #if SICSLOWPAN_COMPRESSION == SICSLOWPAN_COMPRESSION_HC06
 /* Preinitialize any address contexts for better header compression
  * (Saves up to 13 bytes per 6lowpan packet)
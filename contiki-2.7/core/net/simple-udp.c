@@ -43,6 +43,9 @@
 
 #include "contiki-net.h"
 #include "net/simple-udp.h"
+#if UIP_CONF_IPV6 && UIP_CONF_IPV6_RPL
+#include "net/rpl/rpl.h"
+#endif /* UIP_CONF_IPV6 && UIP_CONF_IPV6_RPL */
 
 #include <string.h>
 
@@ -63,6 +66,23 @@ init_simple_udp(void)
   }
 }
 /*---------------------------------------------------------------------------*/
+static void
+send(struct simple_udp_connection *c, const void *data, uint16_t datalen,
+     const uip_ipaddr_t *to, uint16_t port)
+{
+#if UIP_CONF_IPV6 && UIP_CONF_IPV6_RPL
+  /* The packet is sent synchronously, so the RPL instance selected for
+     the connection only applies to it. */
+  if(c->rpl_instance_set) {
+    rpl_set_flow_instance(rpl_get_instance(c->rpl_instance_id));
+  }
+#endif /* UIP_CONF_IPV6 && UIP_CONF_IPV6_RPL */
+  uip_udp_packet_sendto(c->udp_conn, data, datalen, to, UIP_HTONS(port));
+#if UIP_CONF_IPV6 && UIP_CONF_IPV6_RPL
+  rpl_set_flow_instance(NULL);
+#endif /* UIP_CONF_IPV6 && UIP_CONF_IPV6_RPL */
+}
+/*---------------------------------------------------------------------------*/
 /**
  * \brief      Send a UDP packet
  * \param c    A pointer to a struct simple_udp_connection
@@ -81,8 +101,7 @@ simple_udp_send(struct simple_udp_connection *c,
                 const void *data, uint16_t datalen)
 {
   if(c->udp_conn != NULL) {
-    uip_udp_packet_sendto(c->udp_conn, data, datalen,
-                          &c->remote_addr, UIP_HTONS(c->remote_port));
+    send(c, data, datalen, &c->remote_addr, c->remote_port);
   }
   return 0;
 }
@@ -107,8 +126,7 @@ simple_udp_sendto(struct simple_udp_connection *c,
                   const uip_ipaddr_t *to)
 {
   if(c->udp_conn != NULL) {
-    uip_udp_packet_sendto(c->udp_conn, data, datalen,
-                          to, UIP_HTONS(c->remote_port));
+    send(c, data, datalen, to, c->remote_port);
   }
   return 0;
 }
@@ -135,8 +153,7 @@ simple_udp_sendto_port(struct simple_udp_connection *c,
 		       uint16_t port)
 {
   if(c->udp_conn != NULL) {
-    uip_udp_packet_sendto(c->udp_conn, data, datalen,
-                          to, UIP_HTONS(port));
+    send(c, data, datalen, to, port);
   }
   return 0;
 }
@@ -176,6 +193,9 @@ simple_udp_register(struct simple_udp_connection *c,
     uip_ipaddr_copy(&c->remote_addr, remote_addr);
   }
   c->receive_callback = receive_callback;
+#if UIP_CONF_IPV6 && UIP_CONF_IPV6_RPL
+  c->rpl_instance_set = 0;
+#endif /* UIP_CONF_IPV6 && UIP_CONF_IPV6_RPL */
 
   PROCESS_CONTEXT_BEGIN(&simple_udp_process);
   c->udp_conn = udp_new(remote_addr, UIP_HTONS(remote_port), c);
@@ -190,6 +210,29 @@ simple_udp_register(struct simple_udp_connection *c,
   return 1;
 }
 /*---------------------------------------------------------------------------*/
+#if UIP_CONF_IPV6 && UIP_CONF_IPV6_RPL
+/**
+ * \brief      Route the packets of a UDP connection on an RPL instance
+ * \param c    A pointer to a struct simple_udp_connection
+ * \param instance_id The ID of the RPL instance
+ *
+ *             This function binds the packets sent on the connection
+ *             to an RPL instance, so that they are routed upwards
+ *             along the DAG built by the objective function of that
+ *             instance instead of the default instance. Routers along
+ *             the path pick the instance from the RPL option carried
+ *             by the packets.
+ *
+ */
+void
+simple_udp_set_rpl_instance(struct simple_udp_connection *c,
+                            uint8_t instance_id)
+{
+  c->rpl_instance_id = instance_id;
+  c->rpl_instance_set = 1;
+}
+#endif /* UIP_CONF_IPV6 && UIP_CONF_IPV6_RPL */
+/*---------------------------------------------------------------------------*/
 PROCESS_THREAD(simple_udp_process, ev, data)
 {
   struct simple_udp_connection *c;
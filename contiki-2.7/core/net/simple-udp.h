@@ -71,6 +71,10 @@ struct simple_udp_connection {
   simple_udp_callback receive_callback;
   struct uip_udp_conn *udp_conn;
   struct process *client_process;
+#if UIP_CONF_IPV6 && UIP_CONF_IPV6_RPL
+  uint8_t rpl_instance_id;
+  uint8_t rpl_instance_set;
+#endif /* UIP_CONF_IPV6 && UIP_CONF_IPV6_RPL */
 };
 
 int simple_udp_register(struct simple_udp_connection *c,
@@ -90,6 +94,11 @@ int simple_udp_sendto_port(struct simple_udp_connection *c,
 			   const void *data, uint16_t datalen,
 			   const uip_ipaddr_t *to, uint16_t to_port);
 
+#if UIP_CONF_IPV6 && UIP_CONF_IPV6_RPL
+void simple_udp_set_rpl_instance(struct simple_udp_connection *c,
+                                 uint8_t instance_id);
+#endif /* UIP_CONF_IPV6 && UIP_CONF_IPV6_RPL */
+
 void simple_udp_init(void);
 
 #endif /* SIMPLE_UDP_H */
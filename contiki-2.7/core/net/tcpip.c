@@ -541,6 +541,9 @@ tcpip_ipv6_output(void)
 {
   uip_ds6_nbr_t *nbr = NULL;
   uip_ipaddr_t *nexthop;
+#if UIP_CONF_IPV6_RPL
+  uip_ipaddr_t srh_nexthop;
+#endif /* UIP_CONF_IPV6_RPL */
 
   if(uip_len == 0) {
     return;
@@ -562,6 +565,13 @@ tcpip_ipv6_output(void)
     /* Next hop determination */
     nbr = NULL;
 
+#if UIP_CONF_IPV6_RPL
+    /* Packets on a source route of a non-storing RPL DAG, or that get
+       one here at the root, go to the next hop of the route. */
+    if(rpl_srh_get_next_hop(&srh_nexthop)) {
+      nexthop = &srh_nexthop;
+    } else
+#endif /* UIP_CONF_IPV6_RPL */
     /* We first check if the destination address is on our immediate
        link. If so, we simply use the destination address as our
        nexthop address. */
@@ -575,7 +585,16 @@ tcpip_ipv6_output(void)
       /* No route was found - we send to the default route instead. */
       if(route == NULL) {
         PRINTF("tcpip_ipv6_output: no route found, using default route\n");
+#if UIP_CONF_IPV6_RPL
+        /* Packets go to the preferred parent of their RPL instance,
+           or of the default instance if they carry no RPL option. */
+        nexthop = rpl_get_flow_nexthop();
+        if(nexthop == NULL) {
+          nexthop = uip_ds6_defrt_choose();
+        }
+#else /* UIP_CONF_IPV6_RPL */
         nexthop = uip_ds6_defrt_choose();
+#endif /* UIP_CONF_IPV6_RPL */
         if(nexthop == NULL) {
 #ifdef UIP_FALLBACK_INTERFACE
 	  PRINTF("FALLBACK: removing ext hdrs & setting proto %d %d\n", 
@@ -63,6 +63,23 @@ MEMB(defaultroutermemb, uip_ds6_defrt_t, UIP_DS6_DEFRT_NB);
 LIST(notificationlist);
 #endif
 
+#if UIP_DS6_ROUTE_HASH
+/* The /128 routes are also held in the buckets of route_hash and the
+   other routes on the prefix_routes list, both linked through the
+   hash_next field of the routes. */
+static uip_ds6_route_t *route_hash[UIP_DS6_ROUTE_HASH_SIZE];
+static uip_ds6_route_t *prefix_routes;
+#endif /* UIP_DS6_ROUTE_HASH */
+
+#if UIP_DS6_ROUTE_COMPACT
+/* The upper halves of the route destinations, each stored once and
+   referenced by the routes through their prefix field. */
+static struct {
+  uint8_t prefix[8];
+  uint8_t refs;
+} route_prefixes[UIP_DS6_ROUTE_PREFIX_NB];
+#endif /* UIP_DS6_ROUTE_COMPACT */
+
 static int num_routes = 0;
 
 #undef DEBUG
@@ -136,10 +153,110 @@ uip_ds6_notification_rm(struct uip_ds6_notification *n)
 }
 #endif
 /*---------------------------------------------------------------------------*/
+#if UIP_DS6_ROUTE_COMPACT
+static int
+prefix_find(uip_ipaddr_t *ipaddr)
+{
+  int i;
+
+  for(i = 0; i < UIP_DS6_ROUTE_PREFIX_NB; i++) {
+    if(route_prefixes[i].refs > 0 &&
+       memcmp(route_prefixes[i].prefix, ipaddr->u8, 8) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+/*---------------------------------------------------------------------------*/
+static int
+prefix_ref(uip_ipaddr_t *ipaddr)
+{
+  int i;
+
+  i = prefix_find(ipaddr);
+  if(i < 0) {
+    for(i = 0; i < UIP_DS6_ROUTE_PREFIX_NB; i++) {
+      if(route_prefixes[i].refs == 0) {
+        memcpy(route_prefixes[i].prefix, ipaddr->u8, 8);
+        break;
+      }
+    }
+    if(i == UIP_DS6_ROUTE_PREFIX_NB) {
+      return -1;
+    }
+  }
+  route_prefixes[i].refs++;
+  return i;
+}
+/*---------------------------------------------------------------------------*/
+static void
+prefix_unref(int i)
+{
+  if(route_prefixes[i].refs > 0) {
+    route_prefixes[i].refs--;
+  }
+}
+#endif /* UIP_DS6_ROUTE_COMPACT */
+/*---------------------------------------------------------------------------*/
+#if UIP_DS6_ROUTE_HASH
+static uip_ds6_route_t **
+hash_head(uip_ds6_route_t *r)
+{
+  const uint8_t *iid;
+  uint16_t h;
+  int i;
+
+  if(r->length != 128) {
+    return &prefix_routes;
+  }
+#if UIP_DS6_ROUTE_COMPACT
+  iid = r->iid;
+#else
+  iid = &r->ipaddr.u8[8];
+#endif
+  /* Host routes below one prefix only differ in their IID. */
+  h = 0;
+  for(i = 0; i < 8; i++) {
+    h = (h << 5) + h + iid[i];
+  }
+  return &route_hash[h & (UIP_DS6_ROUTE_HASH_SIZE - 1)];
+}
+/*---------------------------------------------------------------------------*/
+static void
+hash_add(uip_ds6_route_t *r)
+{
+  uip_ds6_route_t **head;
+
+  head = hash_head(r);
+  r->hash_next = *head;
+  *head = r;
+}
+/*---------------------------------------------------------------------------*/
+static void
+hash_remove(uip_ds6_route_t *r)
+{
+  uip_ds6_route_t **p;
+
+  for(p = hash_head(r); *p != NULL; p = &(*p)->hash_next) {
+    if(*p == r) {
+      *p = r->hash_next;
+      return;
+    }
+  }
+}
+#endif /* UIP_DS6_ROUTE_HASH */
+/*---------------------------------------------------------------------------*/
 void
 uip_ds6_route_init(void)
 {
   memb_init(&routememb);
+#if UIP_DS6_ROUTE_HASH
+  memset(route_hash, 0, sizeof(route_hash));
+  prefix_routes = NULL;
+#endif /* UIP_DS6_ROUTE_HASH */
+#if UIP_DS6_ROUTE_COMPACT
+  memset(route_prefixes, 0, sizeof(route_prefixes));
+#endif /* UIP_DS6_ROUTE_COMPACT */
   nbr_table_register(nbr_routes,
                      (nbr_table_callback *)rm_routelist_callback);
 
@@ -171,6 +288,30 @@ uip_ds6_route_nexthop(uip_ds6_route_t *route)
   }
 }
 /*---------------------------------------------------------------------------*/
+void
+uip_ds6_route_ipaddr(uip_ds6_route_t *route, uip_ipaddr_t *ipaddr)
+{
+#if UIP_DS6_ROUTE_COMPACT
+  memcpy(ipaddr->u8, route_prefixes[route->prefix].prefix, 8);
+  memcpy(&ipaddr->u8[8], route->iid, 8);
+#else
+  uip_ipaddr_copy(ipaddr, &route->ipaddr);
+#endif /* UIP_DS6_ROUTE_COMPACT */
+}
+/*---------------------------------------------------------------------------*/
+static int
+route_prefixcmp(uip_ds6_route_t *r, uip_ipaddr_t *addr)
+{
+#if UIP_DS6_ROUTE_COMPACT
+  uip_ipaddr_t ipaddr;
+
+  uip_ds6_route_ipaddr(r, &ipaddr);
+  return uip_ipaddr_prefixcmp(addr, &ipaddr, r->length);
+#else
+  return uip_ipaddr_prefixcmp(addr, &r->ipaddr, r->length);
+#endif /* UIP_DS6_ROUTE_COMPACT */
+}
+/*---------------------------------------------------------------------------*/
 uip_ds6_route_t *
 uip_ds6_route_head(void)
 {
@@ -219,6 +360,12 @@ uip_ds6_route_lookup(uip_ipaddr_t *addr)
   uip_ds6_route_t *r;
   uip_ds6_route_t *found_route;
   uint8_t longestmatch;
+#if UIP_DS6_ROUTE_HASH
+  uip_ds6_route_t key;
+#if UIP_DS6_ROUTE_COMPACT
+  int prefix;
+#endif /* UIP_DS6_ROUTE_COMPACT */
+#endif /* UIP_DS6_ROUTE_HASH */
 
   PRINTF("uip-ds6-route: Looking up route for ");
   PRINT6ADDR(addr);
@@ -227,11 +374,38 @@ uip_ds6_route_lookup(uip_ipaddr_t *addr)
 
   found_route = NULL;
   longestmatch = 0;
+#if UIP_DS6_ROUTE_HASH
+  /* A /128 route is the longest possible match: look for one in its
+     hash bucket first, and only then scan the prefix routes. */
+  key.length = 128;
+#if UIP_DS6_ROUTE_COMPACT
+  memcpy(key.iid, &addr->u8[8], 8);
+  prefix = prefix_find(addr);
+  for(r = prefix < 0 ? NULL : *hash_head(&key); r != NULL; r = r->hash_next) {
+    if(r->prefix == prefix && memcmp(r->iid, key.iid, 8) == 0) {
+      found_route = r;
+      break;
+    }
+  }
+#else /* UIP_DS6_ROUTE_COMPACT */
+  uip_ipaddr_copy(&key.ipaddr, addr);
+  for(r = *hash_head(&key); r != NULL; r = r->hash_next) {
+    if(uip_ipaddr_cmp(&r->ipaddr, addr)) {
+      found_route = r;
+      break;
+    }
+  }
+#endif /* UIP_DS6_ROUTE_COMPACT */
+  for(r = found_route == NULL ? prefix_routes : NULL;
+      r != NULL;
+      r = r->hash_next) {
+#else /* UIP_DS6_ROUTE_HASH */
   for(r = uip_ds6_route_head();
       r != NULL;
       r = uip_ds6_route_next(r)) {
+#endif /* UIP_DS6_ROUTE_HASH */
     if(r->length >= longestmatch &&
-       uip_ipaddr_prefixcmp(addr, &r->ipaddr, r->length)) {
+       route_prefixcmp(r, addr)) {
       longestmatch = r->length;
       found_route = r;
     }
@@ -255,13 +429,17 @@ uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length,
 		  uip_ipaddr_t *nexthop)
 {
   uip_ds6_route_t *r;
+  uip_lladdr_t *nexthop_lladdr;
+#if UIP_DS6_ROUTE_COMPACT
+  int prefix;
+#endif /* UIP_DS6_ROUTE_COMPACT */
 
 #if DEBUG != DEBUG_NONE
   assert_nbr_routes_list_sane();
 #endif /* DEBUG != DEBUG_NONE */
 
   /* Get link-layer address of next hop, make sure it is in neighbor table */
-  uip_lladdr_t *nexthop_lladdr = uip_ds6_nbr_lladdr_from_ipaddr(nexthop);
+  nexthop_lladdr = uip_ds6_nbr_lladdr_from_ipaddr(nexthop);
   if(nexthop_lladdr == NULL) {
     PRINTF("uip_ds6_route_add: neighbor link-local address unknown ");
     PRINT6ADDR(ipaddr);
@@ -269,6 +447,17 @@ uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length,
     return NULL;
   }
 
+#if UIP_DS6_ROUTE_COMPACT
+  /* Make sure that the upper half of the destination can be stored. */
+  prefix = prefix_ref(ipaddr);
+  if(prefix < 0) {
+    PRINTF("uip_ds6_route_add: prefix table full, dropping route to ");
+    PRINT6ADDR(ipaddr);
+    PRINTF("\n");
+    return NULL;
+  }
+#endif /* UIP_DS6_ROUTE_COMPACT */
+
   /* First make sure that we don't add a route twice. If we find an
      existing route for our destination, we'll just update the old
      one. */
@@ -277,6 +466,12 @@ uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length,
     PRINTF("uip_ds6_route_add: old route already found, updating this one instead: ");
     PRINT6ADDR(ipaddr);
     PRINTF("\n");
+#if UIP_DS6_ROUTE_HASH
+    hash_remove(r);
+#endif /* UIP_DS6_ROUTE_HASH */
+#if UIP_DS6_ROUTE_COMPACT
+    prefix_unref(r->prefix);
+#endif /* UIP_DS6_ROUTE_COMPACT */
   } else {
     struct uip_ds6_route_neighbor_routes *routes;
     /* If there is no routing entry, create one */
@@ -304,6 +499,9 @@ uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length,
         PRINTF("uip_ds6_route_add: could not allocate a neighbor table entri for new route to ");
         PRINT6ADDR(ipaddr);
         PRINTF(", dropping it\n");
+#if UIP_DS6_ROUTE_COMPACT
+        prefix_unref(prefix);
+#endif /* UIP_DS6_ROUTE_COMPACT */
         return NULL;
       }
       LIST_STRUCT_INIT(routes, route_list);
@@ -316,6 +514,9 @@ uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length,
       PRINTF("uip_ds6_route_add: could not allocate memory for new route to ");
       PRINT6ADDR(ipaddr);
       PRINTF(", dropping it\n");
+#if UIP_DS6_ROUTE_COMPACT
+      prefix_unref(prefix);
+#endif /* UIP_DS6_ROUTE_COMPACT */
       return NULL;
     }
 
@@ -328,8 +529,16 @@ uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length,
     r->routes = routes;
   }
 
+#if UIP_DS6_ROUTE_COMPACT
+  r->prefix = prefix;
+  memcpy(r->iid, &ipaddr->u8[8], 8);
+#else /* UIP_DS6_ROUTE_COMPACT */
   uip_ipaddr_copy(&(r->ipaddr), ipaddr);
+#endif /* UIP_DS6_ROUTE_COMPACT */
   r->length = length;
+#if UIP_DS6_ROUTE_HASH
+  hash_add(r);
+#endif /* UIP_DS6_ROUTE_HASH */
 
 #ifdef UIP_DS6_ROUTE_STATE_TYPE
   memset(&r->state, 0, sizeof(UIP_DS6_ROUTE_STATE_TYPE));
@@ -356,15 +565,32 @@ uip_ds6_route_add(uip_ipaddr_t *ipaddr, uint8_t length,
 void
 uip_ds6_route_rm(uip_ds6_route_t *route)
 {
+  uip_ipaddr_t ipaddr;
+#if UIP_DS6_NOTIFICATIONS
+  uip_ipaddr_t *nexthop;
+#endif
+
 #if DEBUG != DEBUG_NONE
   assert_nbr_routes_list_sane();
 #endif /* DEBUG != DEBUG_NONE */
   if(route != NULL && route->routes != NULL) {
 
+    uip_ds6_route_ipaddr(route, &ipaddr);
     PRINTF("uip_ds6_route_rm: removing route: ");
-    PRINT6ADDR(&route->ipaddr);
+    PRINT6ADDR(&ipaddr);
     PRINTF("\n");
 
+#if UIP_DS6_NOTIFICATIONS
+    /* The next hop is not known any more once the neighbor is gone. */
+    nexthop = uip_ds6_route_nexthop(route);
+#endif
+
+#if UIP_DS6_ROUTE_HASH
+    hash_remove(route);
+#endif /* UIP_DS6_ROUTE_HASH */
+#if UIP_DS6_ROUTE_COMPACT
+    prefix_unref(route->prefix);
+#endif /* UIP_DS6_ROUTE_COMPACT */
     list_remove(route->routes->route_list, route);
     if(list_head(route->routes->route_list) == NULL) {
       /* If this was the only route using this neighbor, remove the
@@ -379,8 +605,7 @@ uip_ds6_route_rm(uip_ds6_route_t *route)
     PRINTF("uip_ds6_route_rm num %d\n", num_routes);
 
 #if UIP_DS6_NOTIFICATIONS
-    call_route_callback(UIP_DS6_NOTIFICATION_ROUTE_RM,
-        &route->ipaddr, uip_ds6_route_nexthop(route));
+    call_route_callback(UIP_DS6_NOTIFICATION_ROUTE_RM, &ipaddr, nexthop);
 #endif
 #if 0 //(DEBUG & DEBUG_ANNOTATE) == DEBUG_ANNOTATE
     /* we need to check if this was the last route towards "nexthop" */
@@ -80,6 +80,40 @@ void uip_ds6_notification_rm(struct uip_ds6_notification *n);
 #define UIP_DS6_ROUTE_NB UIP_CONF_MAX_ROUTES
 #endif /* UIP_CONF_MAX_ROUTES */
 
+/** \brief When set, /128 routes are kept in a hash table so that
+ *  uip_ds6_route_lookup() finds host routes in constant time. Only
+ *  the routes with a shorter prefix are scanned for the longest
+ *  prefix match. Meant for border routers holding many routes. */
+#ifdef UIP_CONF_DS6_ROUTE_HASH
+#define UIP_DS6_ROUTE_HASH UIP_CONF_DS6_ROUTE_HASH
+#else
+#define UIP_DS6_ROUTE_HASH 0
+#endif /* UIP_CONF_DS6_ROUTE_HASH */
+
+/** \brief Number of buckets of the route hash table, a power of two */
+#ifdef UIP_CONF_DS6_ROUTE_HASH_SIZE
+#define UIP_DS6_ROUTE_HASH_SIZE UIP_CONF_DS6_ROUTE_HASH_SIZE
+#else
+#define UIP_DS6_ROUTE_HASH_SIZE 64
+#endif /* UIP_CONF_DS6_ROUTE_HASH_SIZE */
+
+/** \brief When set, route entries only hold the lower 64 bits of
+ *  their destination. The upper 64 bits (typically the DAG prefix) are
+ *  stored once in a table of UIP_DS6_ROUTE_PREFIX_NB prefixes shared
+ *  by all routes. The ipaddr field is then absent: use
+ *  uip_ds6_route_ipaddr() to get the destination of a route. */
+#ifdef UIP_CONF_DS6_ROUTE_COMPACT
+#define UIP_DS6_ROUTE_COMPACT UIP_CONF_DS6_ROUTE_COMPACT
+#else
+#define UIP_DS6_ROUTE_COMPACT 0
+#endif /* UIP_CONF_DS6_ROUTE_COMPACT */
+
+#ifdef UIP_CONF_DS6_ROUTE_PREFIX_NB
+#define UIP_DS6_ROUTE_PREFIX_NB UIP_CONF_DS6_ROUTE_PREFIX_NB
+#else
+#define UIP_DS6_ROUTE_PREFIX_NB 2
+#endif /* UIP_CONF_DS6_ROUTE_PREFIX_NB */
+
 /** \brief define some additional RPL related route state and
  *  neighbor callback for RPL - if not a DS6_ROUTE_STATE is already set */
 #ifndef UIP_DS6_ROUTE_STATE_TYPE
@@ -108,11 +142,25 @@ typedef struct uip_ds6_route {
      belong to the neighbor table entry that this routing table entry
      uses. */
   struct uip_ds6_route_neighbor_routes *routes;
+#if UIP_DS6_ROUTE_HASH
+  /* Next route in the same hash bucket (/128 routes) or in the list
+     of prefix routes (all others). */
+  struct uip_ds6_route *hash_next;
+#endif /* UIP_DS6_ROUTE_HASH */
+#if UIP_DS6_ROUTE_COMPACT
+  /* Lower half of the destination. */
+  uint8_t iid[8];
+#else /* UIP_DS6_ROUTE_COMPACT */
   uip_ipaddr_t ipaddr;
+#endif /* UIP_DS6_ROUTE_COMPACT */
 #ifdef UIP_DS6_ROUTE_STATE_TYPE
   UIP_DS6_ROUTE_STATE_TYPE state;
 #endif
   uint8_t length;
+#if UIP_DS6_ROUTE_COMPACT
+  /* Index of the upper half of the destination in the prefix table. */
+  uint8_t prefix;
+#endif /* UIP_DS6_ROUTE_COMPACT */
 } uip_ds6_route_t;
 
 
@@ -146,6 +194,7 @@ void uip_ds6_route_rm(uip_ds6_route_t *route);
 void uip_ds6_route_rm_by_nexthop(uip_ipaddr_t *nexthop);
 
 uip_ipaddr_t *uip_ds6_route_nexthop(uip_ds6_route_t *);
+void uip_ds6_route_ipaddr(uip_ds6_route_t *route, uip_ipaddr_t *ipaddr);
 int uip_ds6_route_num_routes(void);
 uip_ds6_route_t *uip_ds6_route_head(void);
 uip_ds6_route_t *uip_ds6_route_next(uip_ds6_route_t *);
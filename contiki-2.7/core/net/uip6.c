@@ -1308,6 +1308,32 @@ uip_process(uint8_t flag)
          */
 
         PRINTF("Processing Routing header\n");
+#if UIP_CONF_ROUTER && UIP_CONF_IPV6_RPL
+        /* RPL source routing header (RFC 6554): swap the next address
+           in and forward the packet towards it. */
+        if(UIP_ROUTING_BUF->seg_left > 0 &&
+           UIP_ROUTING_BUF->routing_type == RPL_RH_TYPE_SRH) {
+          if(!rpl_process_srh_header()) {
+            UIP_STAT(++uip_stat.ip.drop);
+            UIP_LOG("ip6: bad source routing header");
+            goto drop;
+          }
+          if(UIP_IP_BUF->ttl <= 1) {
+            uip_icmp6_error_output(ICMP6_TIME_EXCEEDED,
+                                   ICMP6_TIME_EXCEED_TRANSIT, 0);
+            UIP_STAT(++uip_stat.ip.drop);
+            goto send;
+          }
+          uip_ext_len = 0;
+          rpl_update_header_empty();
+          UIP_IP_BUF->ttl = UIP_IP_BUF->ttl - 1;
+          PRINTF("Forwarding packet to next hop ");
+          PRINT6ADDR(&UIP_IP_BUF->destipaddr);
+          PRINTF("\n");
+          UIP_STAT(++uip_stat.ip.forwarded);
+          goto send;
+        }
+#endif /* UIP_CONF_ROUTER && UIP_CONF_IPV6_RPL */
         if(UIP_ROUTING_BUF->seg_left > 0) {
           uip_icmp6_error_output(ICMP6_PARAM_PROB, ICMP6_PARAMPROB_HEADER, UIP_IPH_LEN + uip_ext_len + 2);
           UIP_STAT(++uip_stat.ip.drop);
@@ -468,6 +468,38 @@
 #define SICSLOWPAN_REASS_MAXAGE 20
 #endif
 
+/**
+ * How many fragmented packets can be reassembled at the same time.
+ * Each of them takes a buffer of UIP_BUFSIZE bytes.
+ */
+#ifdef SICSLOWPAN_CONF_REASS_CONTEXTS
+#define SICSLOWPAN_REASS_CONTEXTS (SICSLOWPAN_CONF_REASS_CONTEXTS)
+#else
+#define SICSLOWPAN_REASS_CONTEXTS 1
+#endif
+
+/**
+ * Do routers forward the fragments of a packet as they arrive instead
+ * of reassembling it first (default: no). The first fragment is routed
+ * and the following ones are sent to the same next hop with a new tag,
+ * so all the nodes of the network should use the same setting. Needs
+ * UIP_CONF_IPV6_QUEUE_PKT 0.
+ */
+#ifdef SICSLOWPAN_CONF_FRAG_FORWARDING
+#define SICSLOWPAN_FRAG_FORWARDING (SICSLOWPAN_CONF_FRAG_FORWARDING)
+#else
+#define SICSLOWPAN_FRAG_FORWARDING 0
+#endif
+
+/**
+ * How many fragmented packets a router can forward at the same time
+ */
+#ifdef SICSLOWPAN_CONF_FRAG_FORWARD_ENTRIES
+#define SICSLOWPAN_FRAG_FORWARD_ENTRIES (SICSLOWPAN_CONF_FRAG_FORWARD_ENTRIES)
+#else
+#define SICSLOWPAN_FRAG_FORWARD_ENTRIES 4
+#endif
+
 /**
  * Do we compress the IP header or not (default: no)
  */
@@ -0,0 +1,8 @@
+#undef QUEUEBUF_CONF_NUM
+#define QUEUEBUF_CONF_NUM	4
+
+#undef NETSTACK_CONF_RDC
+#define NETSTACK_CONF_RDC       nullrdc_driver
+
+#undef DB_FEATURE_JOIN
+#define DB_FEATURE_JOIN		0
@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2010, Swedish Institute of Computer Science
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the Institute nor the names of its contributors
+ *    may be used to endorse or promote products derived from this software
+ *    without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE INSTITUTE AND CONTRIBUTORS ``AS IS'' AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED.  IN NO EVENT SHALL THE INSTITUTE OR CONTRIBUTORS BE LIABLE
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+ * LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+ * OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ *
+ * This file is part of the Contiki operating system.
+ *
+ */
+
+/**
+ * \file
+ *	A test of the B+-tree index of Antelope over a reboot. The first
+ *	boot creates an indexed relation and reboots the node. The second
+ *	boot loads the index from flash and runs a range query with it.
+ */
+
+#include <stdio.h>
+
+#include "contiki.h"
+#include "cfs/cfs.h"
+#include "cfs/cfs-coffee.h"
+#include "dev/watchdog.h"
+
+#include "antelope.h"
+
+PROCESS(test_bplustree_process, "B+-tree index test");
+AUTOSTART_PROCESSES(&test_bplustree_process);
+
+#define TUPLES		200
+#define RANGE_MIN	50
+#define RANGE_MAX	149
+
+/*---------------------------------------------------------------------------*/
+/* Insert the keys out of order, so that nodes are split both at their
+   end and in the middle. */
+static long
+key(unsigned i)
+{
+  return (i * 73L) % TUPLES;
+}
+/*---------------------------------------------------------------------------*/
+static int
+create_relation(void)
+{
+  unsigned i;
+
+  if(DB_ERROR(db_query(NULL, "CREATE RELATION samples;")) ||
+     DB_ERROR(db_query(NULL, "CREATE ATTRIBUTE time DOMAIN LONG IN samples;")) ||
+     DB_ERROR(db_query(NULL, "CREATE ATTRIBUTE value DOMAIN INT IN samples;")) ||
+     DB_ERROR(db_query(NULL, "CREATE INDEX samples.time TYPE BPLUSTREE;"))) {
+    return 1;
+  }
+
+  for(i = 0; i < TUPLES; i++) {
+    if(DB_ERROR(db_query(NULL, "INSERT (%ld, %u) INTO samples;", key(i), i))) {
+      return 2;
+    }
+  }
+
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(test_bplustree_process, ev, data)
+{
+  static db_handle_t handle;
+  static long count, last;
+  attribute_value_t value;
+  db_result_t result;
+  long time;
+  int fd;
+
+  PROCESS_BEGIN();
+
+  db_init();
+
+  fd = cfs_open("samples", CFS_READ);
+  if(fd < 0) {
+    printf("Creating the relation\n");
+    cfs_coffee_format();
+    result = create_relation();
+    if(result != 0) {
+      printf("B+-tree test: ERROR (creation %d)\n", result);
+      PROCESS_EXIT();
+    }
+    printf("Rebooting\n");
+    watchdog_reboot();
+  }
+  cfs_close(fd);
+
+  /* The index returns the keys of the range in order. */
+  result = db_query(&handle,
+                    "SELECT time FROM samples WHERE time >= %d AND time <= %d;",
+                    RANGE_MIN, RANGE_MAX);
+  if(DB_ERROR(result)) {
+    printf("B+-tree test: ERROR (query: %s)\n", db_get_result_message(result));
+    PROCESS_EXIT();
+  }
+
+  count = 0;
+  last = RANGE_MIN - 1;
+  while(db_processing(&handle)) {
+    PROCESS_PAUSE();
+    result = db_process(&handle);
+    if(result == DB_GOT_ROW) {
+      if(DB_ERROR(db_get_value(&value, &handle, 0))) {
+        break;
+      }
+      time = db_value_to_long(&value);
+      if(time != last + 1) {
+        printf("B+-tree test: ERROR (got %ld after %ld)\n", time, last);
+        break;
+      }
+      last = time;
+      count++;
+    } else if(result != DB_OK) {
+      break;
+    }
+  }
+  db_free(&handle);
+
+  if(count == RANGE_MAX - RANGE_MIN + 1) {
+    printf("B+-tree test: OK\n");
+  } else {
+    printf("B+-tree test: ERROR (%ld tuples)\n", count);
+  }
+
+  /* Start over if the node is rebooted again. */
+  db_query(NULL, "REMOVE RELATION samples;");
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -147,6 +147,7 @@ PT_THREAD(generate_routes(struct httpd_state *s))
 {
   static int i;
   static uip_ds6_route_t *r;
+  static uip_ipaddr_t route_ipaddr;
   static uip_ds6_nbr_t *nbr;
 
   PSOCK_BEGIN(&s->sout);
@@ -172,7 +173,8 @@ PT_THREAD(generate_routes(struct httpd_state *s))
   for(r = uip_ds6_route_head();
       r != NULL;
       r = uip_ds6_route_next(r)) {
-    ipaddr_add(&r->ipaddr);
+    uip_ds6_route_ipaddr(r, &route_ipaddr);
+    ipaddr_add(&route_ipaddr);
     ADD("/%u (via ", r->length);
     ipaddr_add(uip_ds6_route_nexthop(r));
     if(r->state.lifetime < 600) {
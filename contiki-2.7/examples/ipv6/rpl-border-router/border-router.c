@@ -147,6 +147,7 @@ PT_THREAD(generate_routes(struct httpd_state *s))
 {
   static int i;
   static uip_ds6_route_t *r;
+  static uip_ipaddr_t route_ipaddr;
   static uip_ds6_nbr_t *nbr;
 #if BUF_USES_STACK
   char buf[256];
@@ -223,27 +224,28 @@ PT_THREAD(generate_routes(struct httpd_state *s))
 
   for(r = uip_ds6_route_head(); r != NULL; r = uip_ds6_route_next(r)) {
 
+    uip_ds6_route_ipaddr(r, &route_ipaddr);
 #if BUF_USES_STACK
 #if WEBSERVER_CONF_ROUTE_LINKS
     ADD("<a href=http://[");
-    ipaddr_add(&r->ipaddr);
+    ipaddr_add(&route_ipaddr);
     ADD("]/status.shtml>");
-    ipaddr_add(&r->ipaddr);
+    ipaddr_add(&route_ipaddr);
     ADD("</a>");
 #else
-    ipaddr_add(&r->ipaddr);
+    ipaddr_add(&route_ipaddr);
 #endif
 #else
 #if WEBSERVER_CONF_ROUTE_LINKS
     ADD("<a href=http://[");
-    ipaddr_add(&r->ipaddr);
+    ipaddr_add(&route_ipaddr);
     ADD("]/status.shtml>");
     SEND_STRING(&s->sout, buf); //TODO: why tunslip6 needs an output here, wpcapslip does not
     blen = 0;
-    ipaddr_add(&r->ipaddr);
+    ipaddr_add(&route_ipaddr);
     ADD("</a>");
 #else
-    ipaddr_add(&r->ipaddr);
+    ipaddr_add(&route_ipaddr);
 #endif
 #endif
     ADD("/%u (via ", r->length);
@@ -43,6 +43,12 @@
 #define UIP_CONF_BUFFER_SIZE    140
 #endif
 
+/* Fragments from different nodes of the DAG arrive interleaved at the
+   border router: reassemble two packets at the same time. */
+#ifndef SICSLOWPAN_CONF_REASS_CONTEXTS
+#define SICSLOWPAN_CONF_REASS_CONTEXTS 2
+#endif
+
 #ifndef UIP_CONF_RECEIVE_WINDOW
 #define UIP_CONF_RECEIVE_WINDOW  60
 #endif
@@ -51,4 +57,17 @@
 #define WEBSERVER_CONF_CFS_CONNS 2
 #endif
 
+#ifdef CONTIKI_TARGET_NATIVE
+/* A native border router holds a route to every node of the DAG:
+   find them through the route hash table and store the DAG prefix
+   of the host routes only once. */
+#ifndef UIP_CONF_DS6_ROUTE_HASH
+#define UIP_CONF_DS6_ROUTE_HASH    1
+#endif
+
+#ifndef UIP_CONF_DS6_ROUTE_COMPACT
+#define UIP_CONF_DS6_ROUTE_COMPACT 1
+#endif
+#endif /* CONTIKI_TARGET_NATIVE */
+
 #endif /* __PROJECT_ROUTER_CONF_H__ */
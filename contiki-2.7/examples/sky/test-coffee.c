@@ -53,6 +53,18 @@ AUTOSTART_PROCESSES(&testcoffee_process);
 
 #define FILE_SIZE	4096
 
+/*---------------------------------------------------------------------------*/
+static void
+coffee_reboot(void)
+{
+  void *mem;
+  unsigned size;
+
+  /* Forget the file system state in RAM, as a reboot would. */
+  cfs_coffee_flush();
+  mem = cfs_coffee_get_protected_mem(&size);
+  memset(mem, 0, size);
+}
 /*---------------------------------------------------------------------------*/
 static int
 coffee_test_basic(void)
@@ -220,6 +232,9 @@ coffee_test_append(void)
     cfs_close(afd);
   }
 
+  /* The file must be found again when nothing about it is kept in RAM. */
+  coffee_reboot();
+
   /* Test 3-6: Read back the data written previously and verify that it 
      is correct. */
   afd = cfs_open("T3", CFS_READ);
@@ -313,6 +328,177 @@ end:
   return error;
 }
 /*---------------------------------------------------------------------------*/
+#define LOG_RECORD_SIZE	64
+/* Modify enough regions to fill 75% of the micro log of T4. */
+#define LOG_REGIONS	24
+#define LOG_WRITE_SIZE	8
+
+static unsigned char
+log_byte(unsigned offset)
+{
+  if(offset < LOG_REGIONS * LOG_RECORD_SIZE) {
+    return ~offset & 0xff;
+  }
+  return offset & 0xff;
+}
+/*---------------------------------------------------------------------------*/
+static int
+coffee_check_log(void)
+{
+  int error;
+  int fd;
+  unsigned char buf[256];
+  unsigned offset;
+  int r, i;
+
+  /* Test 1-3: Read the whole file T4 and verify that it is correct. */
+  fd = cfs_open("T4", CFS_READ);
+  if(fd < 0) {
+    FAIL(1);
+  }
+  for(offset = 0; offset < FILE_SIZE; offset += r) {
+    r = cfs_read(fd, buf, sizeof(buf));
+    if(r != sizeof(buf)) {
+      FAIL(2);
+    }
+    for(i = 0; i < r; i++) {
+      if(buf[i] != log_byte(offset + i)) {
+        printf("offset=%u\n", offset + i);
+        FAIL(3);
+      }
+    }
+  }
+
+  error = 0;
+end:
+  cfs_close(fd);
+  return error;
+}
+/*---------------------------------------------------------------------------*/
+static int
+coffee_test_log(void)
+{
+  int error;
+  int fd;
+  unsigned char buf[256];
+  unsigned offset;
+  int i;
+
+  cfs_remove("T4");
+  fd = -1;
+
+  /* Test 1 and 2: Reserve a file with small log records. */
+  if(cfs_coffee_reserve("T4", FILE_SIZE) < 0) {
+    FAIL(1);
+  }
+  if(cfs_coffee_configure_log("T4", FILE_SIZE / 2, LOG_RECORD_SIZE) < 0) {
+    FAIL(2);
+  }
+
+  /* Test 3 and 4: Write the original data. */
+  fd = cfs_open("T4", CFS_WRITE);
+  if(fd < 0) {
+    FAIL(3);
+  }
+  for(offset = 0; offset < FILE_SIZE; offset += sizeof(buf)) {
+    for(i = 0; i < sizeof(buf); i++) {
+      buf[i] = offset + i;
+    }
+    if(cfs_write(fd, buf, sizeof(buf)) != sizeof(buf)) {
+      FAIL(4);
+    }
+  }
+
+  /* Test 5 and 6: Modify the first regions in small pieces. */
+  if(cfs_seek(fd, 0, CFS_SEEK_SET) != 0) {
+    FAIL(5);
+  }
+  for(offset = 0; offset < LOG_REGIONS * LOG_RECORD_SIZE;
+      offset += LOG_WRITE_SIZE) {
+    for(i = 0; i < LOG_WRITE_SIZE; i++) {
+      buf[i] = log_byte(offset + i);
+    }
+    if(cfs_write(fd, buf, LOG_WRITE_SIZE) != LOG_WRITE_SIZE) {
+      FAIL(6);
+    }
+  }
+  cfs_close(fd);
+  fd = -1;
+
+  /* Test 7-9: Read back the modified file. */
+  error = coffee_check_log();
+  if(error != 0) {
+    FAIL(6 + error);
+  }
+
+  error = 0;
+end:
+  cfs_close(fd);
+  return error;
+}
+/*---------------------------------------------------------------------------*/
+static int
+coffee_test_log_end(void)
+{
+  int error;
+  int fd;
+  unsigned char buf[100];
+  int r;
+
+  cfs_remove("T5");
+
+  for(r = 0; r < sizeof(buf); r++) {
+    buf[r] = r + 1;
+  }
+
+  /* Test 1 and 2: Write a file and modify its beginning in the log. */
+  fd = cfs_open("T5", CFS_WRITE);
+  if(fd < 0) {
+    FAIL(1);
+  }
+  if(cfs_write(fd, buf, sizeof(buf)) != sizeof(buf) ||
+     cfs_seek(fd, 0, CFS_SEEK_SET) != 0 ||
+     cfs_write(fd, buf, 10) != 10) {
+    FAIL(2);
+  }
+
+  /* Test 3: Append to the modified file, which also uses the log. */
+  if(cfs_seek(fd, 0, CFS_SEEK_END) != sizeof(buf) ||
+     cfs_write(fd, buf, 50) != 50) {
+    FAIL(3);
+  }
+  cfs_close(fd);
+
+  /* Test 4 and 5: The end of the file is found after a reboot. */
+  coffee_reboot();
+  fd = cfs_open("T5", CFS_READ);
+  if(fd < 0) {
+    FAIL(4);
+  }
+  r = cfs_seek(fd, 0, CFS_SEEK_END);
+  if(r != sizeof(buf) + 50) {
+    printf("end=%d\n", r);
+    FAIL(5);
+  }
+
+  /* Test 6 and 7: The appended data can be read. */
+  memset(buf, 0, sizeof(buf));
+  if(cfs_seek(fd, sizeof(buf), CFS_SEEK_SET) != sizeof(buf) ||
+     cfs_read(fd, buf, 50) != 50) {
+    FAIL(6);
+  }
+  for(r = 0; r < 50; r++) {
+    if(buf[r] != r + 1) {
+      FAIL(7);
+    }
+  }
+
+  error = 0;
+end:
+  cfs_close(fd);
+  return error;
+}
+/*---------------------------------------------------------------------------*/
 static int
 coffee_test_gc(void)
 {
@@ -339,6 +525,154 @@ coffee_test_gc(void)
   return 0;
 }
 /*---------------------------------------------------------------------------*/
+#if COFFEE_RING_FILES
+#define RING_SIZE	1000
+/* More than the two 64 kB sectors that a ring file of RING_SIZE uses. */
+#define RING_BYTES	150000UL
+
+static unsigned char
+ring_byte(unsigned long offset)
+{
+  return (offset ^ (offset >> 8)) & 0xff;
+}
+/*---------------------------------------------------------------------------*/
+static int
+ring_append(unsigned long start, unsigned long end)
+{
+  unsigned char buf[256];
+  unsigned i, n;
+  int fd;
+
+  fd = cfs_open("R1", CFS_WRITE | CFS_APPEND);
+  if(fd < 0) {
+    return -1;
+  }
+
+  for(; start < end; start += n) {
+    n = end - start > sizeof(buf) ? sizeof(buf) : end - start;
+    for(i = 0; i < n; i++) {
+      buf[i] = ring_byte(start + i);
+    }
+    if(cfs_write(fd, buf, n) != n) {
+      cfs_close(fd);
+      return -1;
+    }
+  }
+
+  cfs_close(fd);
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static int
+coffee_test_ring(void)
+{
+  int error;
+  int fd;
+  unsigned char buf[256];
+  cfs_offset_t size, offset;
+  int r, i;
+
+  cfs_remove("R1");
+  fd = -1;
+
+  /* Test 1: Reserve a ring file. */
+  if(cfs_coffee_reserve_ring("R1", RING_SIZE) < 0) {
+    FAIL(1);
+  }
+
+  /* Test 2 and 3: Data written before a reboot remains. */
+  if(ring_append(0, RING_SIZE) < 0) {
+    FAIL(2);
+  }
+  coffee_reboot();
+  fd = cfs_open("R1", CFS_READ);
+  if(fd < 0 || cfs_seek(fd, 0, CFS_SEEK_END) != RING_SIZE) {
+    FAIL(3);
+  }
+  cfs_close(fd);
+
+  /* Test 4: Append after the reboot until the file has wrapped around. */
+  if(ring_append(RING_SIZE, RING_BYTES) < 0) {
+    FAIL(4);
+  }
+  coffee_reboot();
+
+  /* Test 5 and 6: The file keeps at least RING_SIZE bytes, but not all. */
+  fd = cfs_open("R1", CFS_READ);
+  if(fd < 0) {
+    FAIL(5);
+  }
+  size = cfs_seek(fd, 0, CFS_SEEK_END);
+  if(size < RING_SIZE || size >= RING_BYTES) {
+    printf("size=%ld\n", (long)size);
+    FAIL(6);
+  }
+
+  /* Test 7 and 8: Reads start from the oldest data that remains. */
+  cfs_seek(fd, 0, CFS_SEEK_SET);
+  for(offset = 0; offset < size; offset += r) {
+    r = cfs_read(fd, buf, sizeof(buf));
+    if(r <= 0) {
+      FAIL(7);
+    }
+    for(i = 0; i < r; i++) {
+      if(buf[i] != ring_byte(RING_BYTES - size + offset + i)) {
+        printf("offset=%ld\n", (long)(offset + i));
+        FAIL(8);
+      }
+    }
+  }
+
+  /* Test 9: Nothing can be read after the newest data. */
+  if(cfs_read(fd, buf, sizeof(buf)) > 0) {
+    FAIL(9);
+  }
+
+  error = 0;
+end:
+  cfs_close(fd);
+  return error;
+}
+#endif /* COFFEE_RING_FILES */
+/*---------------------------------------------------------------------------*/
+#if COFFEE_ERASE_COUNTERS
+static int
+coffee_test_wear(void)
+{
+  struct cfs_coffee_stats before, after;
+
+  /* Test 1: The tests above have erased sectors. */
+  cfs_coffee_stats(&before);
+  if(before.max_sector_erases == 0 ||
+     before.min_sector_erases > before.max_sector_erases) {
+    return 1;
+  }
+
+  /* Test 2: The erase counters are kept over a reboot. */
+  coffee_reboot();
+  cfs_coffee_stats(&after);
+  if(after.min_sector_erases != before.min_sector_erases ||
+     after.max_sector_erases != before.max_sector_erases) {
+    return 2;
+  }
+
+  /* Test 3 and 4: Formatting erases every sector once. */
+  cfs_coffee_format();
+  cfs_coffee_stats(&after);
+  if(after.min_sector_erases != before.min_sector_erases + 1 ||
+     after.max_sector_erases != before.max_sector_erases + 1) {
+    return 3;
+  }
+#if COFFEE_STATS
+  if(after.erases <= before.erases) {
+    return 4;
+  }
+#endif
+
+  return 0;
+}
+#endif /* COFFEE_ERASE_COUNTERS */
+/*---------------------------------------------------------------------------*/
 static void
 print_result(const char *test_name, int result)
 {
@@ -352,8 +686,11 @@ print_result(const char *test_name, int result)
 /*---------------------------------------------------------------------------*/
 PROCESS_THREAD(testcoffee_process, ev, data)
 {
-  int start;
+  static int start;
   int result;
+#if COFFEE_LOG_COMPACTION
+  static struct etimer et;
+#endif
 
   PROCESS_BEGIN();
 
@@ -373,9 +710,36 @@ PROCESS_THREAD(testcoffee_process, ev, data)
   result = coffee_test_modify();
   print_result("File modification", result);
 
+  result = coffee_test_log();
+  print_result("Micro logs", result);
+
+#if COFFEE_LOG_COMPACTION
+  /* Let the compaction process merge the log of T4, which it does
+     every ten seconds by default. */
+  etimer_set(&et, 15 * CLOCK_SECOND);
+  PROCESS_WAIT_UNTIL(etimer_expired(&et));
+#endif
+
+  coffee_reboot();
+  result = coffee_check_log();
+  print_result("Micro logs after a reboot", result);
+
+  result = coffee_test_log_end();
+  print_result("File end after a reboot", result);
+
+#if COFFEE_RING_FILES
+  result = coffee_test_ring();
+  print_result("Ring files", result);
+#endif
+
   result = coffee_test_gc();
   print_result("Garbage collection", result);
 
+#if COFFEE_ERASE_COUNTERS
+  result = coffee_test_wear();
+  print_result("Erase counters", result);
+#endif
+
   printf("Coffee test finished. Duration: %d seconds\n", 
          (int)(clock_seconds() - start));
 
@@ -54,9 +54,18 @@
 #define COFFEE_LOG_DIVISOR		4
 #define COFFEE_LOG_SIZE			8192
 #define COFFEE_LOG_TABLE_LIMIT		256
-#define COFFEE_MICRO_LOGS		0
+#define COFFEE_MICRO_LOGS		1
 #define COFFEE_IO_SEMANTICS		1
 
+/* The native xmem emulates flash memory, so Coffee can be benchmarked
+   on a host before it runs on the motes. */
+#ifndef COFFEE_STATS
+#define COFFEE_STATS			1
+#endif
+#ifndef COFFEE_ERASE_COUNTERS
+#define COFFEE_ERASE_COUNTERS		1
+#endif
+
 #define COFFEE_WRITE(buf, size, offset)				\
 		xmem_pwrite((char *)(buf), (size), COFFEE_START + (offset))
 
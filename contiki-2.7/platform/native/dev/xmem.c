@@ -59,7 +59,16 @@ xmem_pwrite(const void *buf, int size, unsigned long offset)
 
   /*  printf("xmem_write(offset 0x%02x, buf %p, size %l);\n", offset, buf, size);*/
 
-  memcpy(&xmem[offset], buf, size);
+  const unsigned char *p = buf;
+  int i;
+
+  /*
+   * Behave like the external flash of the motes: programming can only
+   * set bits, and only an erasure clears them again.
+   */
+  for(i = 0; i < size; i++) {
+    xmem[offset + i] |= p[i];
+  }
   return size;
 }
 /*---------------------------------------------------------------------------*/
@@ -0,0 +1,30 @@
+/**
+ * \file
+ *         Packets sent by the nodes of the RDC benchmark.
+ *
+ *         Every source prints "bench send <seqno>" when it hands a
+ *         packet to UDP, and the sink prints "bench recv <source>
+ *         <seqno> <hops>" when it gets it. The simulation script
+ *         matches the two lines to compute the latency.
+ */
+
+#ifndef BENCH_COMMON_H
+#define BENCH_COMMON_H
+
+#define UDP_PORT 1234
+
+#ifndef PERIOD
+#define PERIOD 30
+#endif
+
+#define SEND_INTERVAL (PERIOD * CLOCK_SECOND)
+
+/* Interval of the powertrace duty cycle reports. */
+#define POWERTRACE_INTERVAL (60 * CLOCK_SECOND)
+
+struct bench_msg {
+  uint16_t source;
+  uint16_t seqno;
+};
+
+#endif /* BENCH_COMMON_H */
@@ -0,0 +1,83 @@
+/**
+ * \file
+ *         RPL root and UDP sink of the RDC benchmark.
+ */
+
+#include "contiki.h"
+#include "net/uip.h"
+#include "net/uip-ds6.h"
+#include "net/uip-debug.h"
+#include "net/rpl/rpl.h"
+#include "powertrace.h"
+
+#include "simple-udp.h"
+#include "bench-common.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define UIP_IP_BUF ((struct uip_ip_hdr *)&uip_buf[UIP_LLH_LEN])
+
+static struct simple_udp_connection sink_connection;
+
+/*---------------------------------------------------------------------------*/
+PROCESS(bench_sink_process, "RDC benchmark sink");
+AUTOSTART_PROCESSES(&bench_sink_process);
+/*---------------------------------------------------------------------------*/
+static void
+receiver(struct simple_udp_connection *c,
+         const uip_ipaddr_t *sender_addr,
+         uint16_t sender_port,
+         const uip_ipaddr_t *receiver_addr,
+         uint16_t receiver_port,
+         const uint8_t *data,
+         uint16_t datalen)
+{
+  struct bench_msg msg;
+
+  if(datalen != sizeof(msg)) {
+    return;
+  }
+  memcpy(&msg, data, sizeof(msg));
+  /* The packet is still in uip_buf: its hop limit tells how many
+     times it was forwarded. */
+  printf("bench recv %u %u %u\n", msg.source, msg.seqno,
+         uip_ds6_if.cur_hop_limit - UIP_IP_BUF->ttl + 1);
+}
+/*---------------------------------------------------------------------------*/
+static void
+create_rpl_dag(void)
+{
+  uip_ipaddr_t ipaddr;
+  rpl_dag_t *dag;
+
+  uip_ip6addr(&ipaddr, 0xaaaa, 0, 0, 0, 0, 0, 0, 0);
+  uip_ds6_set_addr_iid(&ipaddr, &uip_lladdr);
+  uip_ds6_addr_add(&ipaddr, 0, ADDR_AUTOCONF);
+
+  rpl_set_root(RPL_DEFAULT_INSTANCE, &ipaddr);
+  dag = rpl_get_any_dag();
+  if(dag != NULL) {
+    uip_ip6addr(&ipaddr, 0xaaaa, 0, 0, 0, 0, 0, 0, 0);
+    rpl_set_prefix(dag, &ipaddr, 64);
+  }
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(bench_sink_process, ev, data)
+{
+  PROCESS_BEGIN();
+
+  create_rpl_dag();
+  simple_udp_register(&sink_connection, UDP_PORT,
+                      NULL, UDP_PORT, receiver);
+  powertrace_start(POWERTRACE_INTERVAL);
+
+  printf("bench sink %s\n", NETSTACK_RDC.name);
+
+  while(1) {
+    PROCESS_WAIT_EVENT();
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
@@ -0,0 +1,72 @@
+/**
+ * \file
+ *         UDP source of the RDC benchmark. Sends a packet to the RPL
+ *         root every PERIOD seconds, at a random time in the period.
+ */
+
+#include "contiki.h"
+#include "lib/random.h"
+#include "net/uip.h"
+#include "net/uip-ds6.h"
+#include "net/rpl/rpl.h"
+#include "sys/node-id.h"
+#include "powertrace.h"
+
+#include "simple-udp.h"
+#include "bench-common.h"
+
+#include <stdio.h>
+
+static struct simple_udp_connection source_connection;
+
+/*---------------------------------------------------------------------------*/
+PROCESS(bench_source_process, "RDC benchmark source");
+AUTOSTART_PROCESSES(&bench_source_process);
+/*---------------------------------------------------------------------------*/
+static void
+set_global_address(void)
+{
+  uip_ipaddr_t ipaddr;
+
+  uip_ip6addr(&ipaddr, 0xaaaa, 0, 0, 0, 0, 0, 0, 0);
+  uip_ds6_set_addr_iid(&ipaddr, &uip_lladdr);
+  uip_ds6_addr_add(&ipaddr, 0, ADDR_AUTOCONF);
+}
+/*---------------------------------------------------------------------------*/
+PROCESS_THREAD(bench_source_process, ev, data)
+{
+  static struct etimer periodic_timer;
+  static struct etimer send_timer;
+  static uint16_t seqno;
+  struct bench_msg msg;
+  rpl_dag_t *dag;
+
+  PROCESS_BEGIN();
+
+  set_global_address();
+  simple_udp_register(&source_connection, UDP_PORT,
+                      NULL, UDP_PORT, NULL);
+  powertrace_start(POWERTRACE_INTERVAL);
+
+  etimer_set(&periodic_timer, SEND_INTERVAL);
+  while(1) {
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&periodic_timer));
+    etimer_reset(&periodic_timer);
+    etimer_set(&send_timer, random_rand() % SEND_INTERVAL);
+    PROCESS_WAIT_EVENT_UNTIL(etimer_expired(&send_timer));
+
+    /* Packets are only counted once the node has joined the DAG. */
+    dag = rpl_get_any_dag();
+    if(dag == NULL || dag->preferred_parent == NULL) {
+      continue;
+    }
+
+    msg.source = node_id;
+    msg.seqno = ++seqno;
+    printf("bench send %u\n", msg.seqno);
+    simple_udp_sendto(&source_connection, &msg, sizeof(msg), &dag->dag_id);
+  }
+
+  PROCESS_END();
+}
+/*---------------------------------------------------------------------------*/
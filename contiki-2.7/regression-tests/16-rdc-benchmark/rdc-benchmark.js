@@ -0,0 +1,62 @@
+/*
+ * Collects the results of an RDC benchmark run. The RDC and the check
+ * rate are taken from the simulation title, "RDC benchmark <rdc> <rate>".
+ *
+ * Logs one "packet,<rdc>,<rate>,<source>,<hops>,<seqno>,<latency ms>"
+ * line per packet received by the sink, and when the simulation ends
+ * one "node,<rdc>,<rate>,<node>,<sent>,<received>,<radio %>,<tx %>,
+ * <listen %>" line per node, with the duty cycle of its last powertrace
+ * report. parse-rdc-benchmark turns them into CSV files.
+ */
+TIMEOUT(1900000);
+GENERATE_MSG(1800000, "report");
+
+title = sim.getTitle().split(" ");
+rdc = title[2];
+rate = title[3];
+
+sent = new Object();
+received = new Object();
+sentCount = new Object();
+receivedCount = new Object();
+power = new Object();
+
+function percent(part, total) {
+  return total > 0 ? (100 * part / total).toFixed(2) : "";
+}
+
+while(true) {
+  YIELD();
+
+  if(msg.equals("report")) {
+    for(node in power) {
+      p = power[node];
+      total = p[0] + p[1];
+      log.log("node," + rdc + "," + rate + "," + node + "," +
+              (sentCount[node] || 0) + "," + (receivedCount[node] || 0) + "," +
+              percent(p[2] + p[3], total) + "," + percent(p[2], total) + "," +
+              percent(p[3], total) + "\n");
+    }
+    log.testOK();
+  } else if(msg.startsWith("bench send ")) {
+    sent[id + " " + msg.split(" ")[2]] = time;
+    sentCount[id] = (sentCount[id] || 0) + 1;
+  } else if(msg.startsWith("bench recv ")) {
+    f = msg.split(" ");
+    key = f[2] + " " + f[3];
+    if(sent[key] != undefined && received[key] == undefined) {
+      received[key] = time;
+      receivedCount[f[2]] = (receivedCount[f[2]] || 0) + 1;
+      log.log("packet," + rdc + "," + rate + "," + f[2] + "," + f[4] + "," +
+              f[3] + "," + ((time - sent[key]) / 1000).toFixed(1) + "\n");
+    }
+  } else {
+    /* Cumulative energest times of the powertrace report: cpu, lpm,
+       transmit and listen. */
+    m = /P \d+\.\d+ \d+ (\d+) (\d+) (\d+) (\d+)/.exec(msg);
+    if(m) {
+      power[id] = [parseInt(m[1]), parseInt(m[2]),
+                   parseInt(m[3]), parseInt(m[4])];
+    }
+  }
+}
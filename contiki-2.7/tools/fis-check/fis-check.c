@@ -0,0 +1,414 @@
+/*
+ * Host-side conformance checks and microbenchmarks for the fuzzy RPL
+ * objective function (core/net/rpl/FIS.c and rpl-Fuzzyof.c), built
+ * against the headers of platform/native.
+ *
+ * The conformance part sweeps the whole input space of qos() (ETX,
+ * delay, hop count) and quality() (QoS, energy) and checks that
+ *
+ *  - the membership functions cover every input, i.e. no output is 0,
+ *  - qos() never increases with ETX, delay or hop count and quality()
+ *    never decreases with QoS or energy, up to the given slack,
+ *  - the compiled-in lookup tables of fis-lut-data.c agree with the
+ *    inference engine within the given bound,
+ *  - the objective function ranks parents consistently: best_parent()
+ *    does not depend on the argument order, picks the parent with the
+ *    lower rank, keeps the preferred parent unless the other one is
+ *    strictly better, and the cached quality follows metric updates.
+ *
+ * Since the output of qos() is an input of quality(), sweeping the two
+ * systems separately covers the whole (ETX, delay, hop count, energy)
+ * space of the objective function.
+ *
+ * With -B, the time per qos()/quality() call, per LUT lookup and per
+ * best_parent() decision is measured as well.
+ *
+ * Usage: fis-check [-b bound] [-s slack] [-B] [-n iterations]
+ *
+ * The program exits with a non-zero status if a check fails.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_CYCLES 1
+#endif
+
+#include "net/rpl/rpl-private.h"
+#include "net/rpl/FIS.h"
+#include "net/rpl/fis-lut.h"
+
+/* Upper bounds of the input sweeps. */
+#define CHECK_ETX_MAX     (FIS_ETX_B4 + 4)
+#define CHECK_DELAY_MAX   3000
+#define CHECK_HC_MAX      (FIS_HC_B4 + 4)
+#define CHECK_QOS_MAX     FIS_OUT_MAX
+#define CHECK_ENERGY_MAX  255
+
+/* Grid of the parent sweep used for the objective function checks. */
+#define PARENT_DELAY_STEP   100
+#define PARENT_ENERGY_STEP  17
+
+/* Number of failures reported per check before staying quiet. */
+#define REPORT_MAX        5
+
+extern rpl_of_t rpl_fuzzyof;
+
+static rpl_instance_t instance;
+static rpl_dag_t dag;
+
+static unsigned slack = 1;
+static unsigned failures;
+
+/*---------------------------------------------------------------------------*/
+/* Stubs for the parts of the stack that the objective function uses. */
+uint8_t battery_charge_value;
+
+const struct delay_sample *
+neighbor_info_delay_sample(void)
+{
+  return NULL;
+}
+
+int
+neighbor_info_packet_delay(delay_t *delay)
+{
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
+static void
+fail(unsigned *count, const char *check, const char *fmt, ...)
+{
+  va_list ap;
+
+  if(++*count <= REPORT_MAX) {
+    printf("  FAIL %s: ", check);
+    va_start(ap, fmt);
+    vprintf(fmt, ap);
+    va_end(ap);
+    printf("\n");
+  }
+}
+/*---------------------------------------------------------------------------*/
+static void
+report(const char *check, unsigned count)
+{
+  printf("%-28s %s", check, count == 0 ? "ok" : "FAILED");
+  if(count > 0) {
+    printf(" (%u)", count);
+  }
+  printf("\n");
+  failures += count;
+}
+/*---------------------------------------------------------------------------*/
+static int
+diff(int a, int b)
+{
+  return a > b ? a - b : b - a;
+}
+/*---------------------------------------------------------------------------*/
+static void
+check_qos(void)
+{
+  unsigned etx, delay, hc, q;
+  unsigned coverage = 0, mono = 0;
+
+  for(etx = 0; etx <= CHECK_ETX_MAX; etx++) {
+    for(delay = 0; delay <= CHECK_DELAY_MAX; delay++) {
+      for(hc = 0; hc <= CHECK_HC_MAX; hc++) {
+        q = qos(etx, delay, hc);
+        if(q == 0 || q > FIS_GRADE_MAX) {
+          fail(&coverage, "qos range", "qos(%u, %u, %u) = %u",
+               etx, delay, hc, q);
+        }
+        if(etx > 0 && q > qos(etx - 1, delay, hc) + slack) {
+          fail(&mono, "qos/etx", "qos(%u, %u, %u) = %u",
+               etx, delay, hc, q);
+        }
+        if(delay > 0 && q > qos(etx, delay - 1, hc) + slack) {
+          fail(&mono, "qos/delay", "qos(%u, %u, %u) = %u",
+               etx, delay, hc, q);
+        }
+        if(hc > 0 && q > qos(etx, delay, hc - 1) + slack) {
+          fail(&mono, "qos/hc", "qos(%u, %u, %u) = %u",
+               etx, delay, hc, q);
+        }
+      }
+    }
+  }
+  report("qos coverage", coverage);
+  report("qos monotonicity", mono);
+}
+/*---------------------------------------------------------------------------*/
+static void
+check_quality(void)
+{
+  unsigned q, e, v;
+  unsigned coverage = 0, mono = 0;
+
+  for(q = 0; q <= CHECK_QOS_MAX; q++) {
+    for(e = 0; e <= CHECK_ENERGY_MAX; e++) {
+      v = quality(q, e);
+      if(v == 0 || v > FIS_GRADE_MAX) {
+        fail(&coverage, "quality range", "quality(%u, %u) = %u",
+             q, e, v);
+      }
+      if(q > 0 && v + slack < quality(q - 1, e)) {
+        fail(&mono, "quality/qos", "quality(%u, %u) = %u", q, e, v);
+      }
+      if(e > 0 && v + slack < quality(q, e - 1)) {
+        fail(&mono, "quality/energy", "quality(%u, %u) = %u",
+             q, e, v);
+      }
+    }
+  }
+  report("quality coverage", coverage);
+  report("quality monotonicity", mono);
+}
+/*---------------------------------------------------------------------------*/
+static void
+check_lut(unsigned bound)
+{
+  unsigned etx, delay, hc, q, e;
+  unsigned count = 0;
+
+  for(etx = 0; etx <= CHECK_ETX_MAX; etx++) {
+    for(delay = 0; delay <= CHECK_DELAY_MAX; delay++) {
+      for(hc = 0; hc <= CHECK_HC_MAX; hc++) {
+        if(diff(qos_lut(etx, delay, hc), qos(etx, delay, hc)) > bound) {
+          fail(&count, "qos lut", "qos_lut(%u, %u, %u) = %u",
+               etx, delay, hc, qos_lut(etx, delay, hc));
+        }
+      }
+    }
+  }
+  for(q = 0; q <= CHECK_QOS_MAX; q++) {
+    for(e = 0; e <= CHECK_ENERGY_MAX; e++) {
+      if(diff(quality_lut(q, e), quality(q, e)) > bound) {
+        fail(&count, "quality lut", "quality_lut(%u, %u) = %u",
+             q, e, quality_lut(q, e));
+      }
+    }
+  }
+  report("lut error bound", count);
+}
+/*---------------------------------------------------------------------------*/
+static void
+init_dag(void)
+{
+  memset(&instance, 0, sizeof(instance));
+  memset(&dag, 0, sizeof(dag));
+  instance.of = &rpl_fuzzyof;
+  instance.min_hoprankinc = RPL_MIN_HOPRANKINC;
+  instance.current_dag = &dag;
+  dag.instance = &instance;
+  dag.joined = 1;
+}
+/*---------------------------------------------------------------------------*/
+static void
+set_parent(rpl_parent_t *p, unsigned etx, unsigned delay, unsigned hc,
+           unsigned energy)
+{
+  p->dag = &dag;
+  p->rank = ROOT_RANK(&instance);
+  p->mc.obj.etx = etx * RPL_DAG_MC_ETX_DIVISOR;
+  p->mc.obj.latency = delay;
+  p->mc.obj.hopcount = hc;
+  p->mc.obj.energy.energy_est = energy;
+  RPL_PARENT_INVALIDATE_QUALITY(p);
+}
+/*---------------------------------------------------------------------------*/
+static rpl_rank_t
+rank_of(rpl_parent_t *p)
+{
+  return rpl_fuzzyof.calculate_rank(p, 0);
+}
+/*---------------------------------------------------------------------------*/
+static unsigned
+expected_quality(unsigned etx, unsigned delay, unsigned hc, unsigned energy)
+{
+#if RPL_FUZZY_LUT
+  return quality_lut(qos_lut(etx, delay, hc), energy) << FIS_OUT_FRAC_BITS;
+#else
+  return quality_fine(qos_fine(etx, delay, hc), energy);
+#endif
+}
+/*---------------------------------------------------------------------------*/
+static void
+check_ranking(void)
+{
+  static rpl_parent_t a, b;
+  unsigned etx, delay, hc, e, qa, qb;
+  unsigned order = 0, consistency = 0, hysteresis = 0, cache = 0;
+  uint32_t seed = 1;
+  rpl_parent_t *best;
+
+  init_dag();
+  for(etx = 0; etx <= CHECK_ETX_MAX; etx++) {
+    for(delay = 0; delay <= CHECK_DELAY_MAX; delay += PARENT_DELAY_STEP) {
+      for(hc = 0; hc <= CHECK_HC_MAX; hc++) {
+        for(e = 0; e <= CHECK_ENERGY_MAX; e += PARENT_ENERGY_STEP) {
+          /* Compare with a pseudo-random other point of the grid. */
+          seed = seed * 1103515245 + 12345;
+          set_parent(&a, etx, delay, hc, e);
+          set_parent(&b, (seed >> 8) % (CHECK_ETX_MAX + 1),
+                     (seed >> 12) % (CHECK_DELAY_MAX + 1),
+                     (seed >> 20) % (CHECK_HC_MAX + 1),
+                     (seed >> 24) % (CHECK_ENERGY_MAX + 1));
+          qa = expected_quality(etx, delay, hc, e);
+          qb = expected_quality(b.mc.obj.etx / RPL_DAG_MC_ETX_DIVISOR,
+                                b.mc.obj.latency, b.mc.obj.hopcount,
+                                b.mc.obj.energy.energy_est);
+
+          dag.preferred_parent = NULL;
+          best = rpl_fuzzyof.best_parent(&a, &b);
+          if(qa != qb && best != rpl_fuzzyof.best_parent(&b, &a)) {
+            fail(&order, "order", "etx %u delay %u hc %u energy %u",
+                 etx, delay, hc, e);
+          }
+          if(rank_of(best) > rank_of(best == &a ? &b : &a)) {
+            fail(&consistency, "rank", "etx %u delay %u hc %u energy %u",
+                 etx, delay, hc, e);
+          }
+
+          /* Only a strictly better parent may replace the preferred one. */
+          dag.preferred_parent = &a;
+          best = rpl_fuzzyof.best_parent(&a, &b);
+          if(best != &a && qb <= qa) {
+            fail(&hysteresis, "hysteresis",
+                 "etx %u delay %u hc %u energy %u", etx, delay, hc, e);
+          }
+
+          /* The cached quality must be the one of the current metrics. */
+          if(rank_of(&a) != rank_of(&a) || a.quality != qa) {
+            fail(&cache, "cache", "etx %u delay %u hc %u energy %u",
+                 etx, delay, hc, e);
+          }
+        }
+      }
+    }
+  }
+  report("best_parent order", order);
+  report("best_parent rank", consistency);
+  report("best_parent hysteresis", hysteresis);
+  report("quality cache", cache);
+}
+/*---------------------------------------------------------------------------*/
+static double
+now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+/*---------------------------------------------------------------------------*/
+static unsigned long long
+now_cycles(void)
+{
+#if HAVE_CYCLES
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+/*---------------------------------------------------------------------------*/
+#define BENCH(name, calls, body) do {                                   \
+    double t0;                                                          \
+    unsigned long long c0;                                              \
+    unsigned long i_;                                                   \
+    t0 = now_ns();                                                      \
+    c0 = now_cycles();                                                  \
+    for(i_ = 0; i_ < (calls); i_++) {                                   \
+      body;                                                             \
+    }                                                                   \
+    print_bench(name, calls, now_ns() - t0, now_cycles() - c0);         \
+  } while(0)
+
+static void
+print_bench(const char *name, unsigned long calls, double ns,
+            unsigned long long cycles)
+{
+  printf("%-28s %8.1f ns", name, ns / calls);
+  if(HAVE_CYCLES) {
+    printf(" %8.1f cycles", (double)cycles / calls);
+  }
+  printf("\n");
+}
+/*---------------------------------------------------------------------------*/
+static void
+bench(unsigned long iterations)
+{
+  static rpl_parent_t a, b;
+  volatile unsigned sink = 0;
+  unsigned long n;
+
+  /* Walk the input space so that every code path is exercised. */
+#define ETX(i)     ((i) % (CHECK_ETX_MAX + 1))
+#define DELAY(i)   (((i) * 7) % (CHECK_DELAY_MAX + 1))
+#define HC(i)      (((i) / 3) % (CHECK_HC_MAX + 1))
+#define QOS(i)     ((i) % (CHECK_QOS_MAX + 1))
+#define ENERGY(i)  (((i) * 13) % (CHECK_ENERGY_MAX + 1))
+
+  n = iterations;
+  BENCH("qos()", n, sink += qos(ETX(i_), DELAY(i_), HC(i_)));
+  BENCH("quality()", n, sink += quality(QOS(i_), ENERGY(i_)));
+  BENCH("qos_lut()", n, sink += qos_lut(ETX(i_), DELAY(i_), HC(i_)));
+  BENCH("quality_lut()", n, sink += quality_lut(QOS(i_), ENERGY(i_)));
+
+  init_dag();
+  set_parent(&a, 2, 400, 2, 200);
+  set_parent(&b, 5, 900, 3, 120);
+  BENCH("best_parent() cached", n,
+        sink += rpl_fuzzyof.best_parent(&a, &b) == &a);
+  BENCH("best_parent() uncached", n,
+        set_parent(&a, ETX(i_), DELAY(i_), HC(i_), ENERGY(i_));
+        set_parent(&b, ETX(i_ + 5), DELAY(i_ + 5), HC(i_ + 5),
+                   ENERGY(i_ + 5));
+        sink += rpl_fuzzyof.best_parent(&a, &b) == &a);
+  (void)sink;
+}
+/*---------------------------------------------------------------------------*/
+int
+main(int argc, char *argv[])
+{
+  unsigned bound = 4;
+  unsigned long iterations = 1000000;
+  int benchmark = 0;
+  int c;
+
+  while((c = getopt(argc, argv, "b:s:Bn:")) != -1) {
+    switch(c) {
+    case 'b': bound = atoi(optarg); break;
+    case 's': slack = atoi(optarg); break;
+    case 'B': benchmark = 1; break;
+    case 'n': iterations = strtoul(optarg, NULL, 10); break;
+    default:
+      fprintf(stderr, "usage: %s [-b bound] [-s slack] [-B] "
+              "[-n iterations]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  check_qos();
+  check_quality();
+  check_lut(bound);
+  check_ranking();
+
+  if(benchmark && iterations > 0) {
+    printf("\n");
+    bench(iterations);
+  }
+
+  if(failures > 0) {
+    printf("\nfis-check: %u failures\n", failures);
+    return 1;
+  }
+  return 0;
+}
+/*---------------------------------------------------------------------------*/
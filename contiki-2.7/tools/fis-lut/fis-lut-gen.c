@@ -0,0 +1,208 @@
+/*
+ * Host-side generator for the fuzzy QoS/Quality lookup tables used by
+ * the RPL fuzzy objective function when RPL_CONF_FUZZY_LUT is set.
+ *
+ * The tool samples the reference fuzzy system of core/net/rpl/FIS.c on
+ * a grid with power-of-two steps, writes the tables as C source on
+ * standard output, and then checks the interpolated LUT output against
+ * the reference FIS over the whole input space. It exits with a non-zero
+ * status if the error exceeds the given bound.
+ *
+ * Usage: fis-lut-gen [-t etx] [-d delay] [-n hc] [-q qos] [-e energy]
+ *                    [-b bound] > fis-lut-data.c
+ *
+ * where etx, delay, hc, qos and energy are the log2 of the
+ * quantization step of each input and bound is the maximum accepted
+ * absolute error of quality(qos(etx, delay, hc), energy).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "FIS.h"
+#include "fis-lut.h"
+
+/* Upper bounds of the sweep used for the error check. */
+#define CHECK_ETX_MAX     (FIS_ETX_B4 + 4)
+#define CHECK_DELAY_MAX   3000
+#define CHECK_HC_MAX      (FIS_HC_B4 + 4)
+#define CHECK_QOS_MAX     100
+#define CHECK_ENERGY_MAX  255
+
+#define TABLE_MAX         8192
+
+static struct fis_lut_axis qos_axis[3];
+static struct fis_lut_axis quality_axis[2];
+static uint8_t qos_table[TABLE_MAX];
+static uint8_t quality_table[TABLE_MAX];
+
+const struct fis_lut fis_lut_qos = { qos_axis, qos_table, 3 };
+const struct fis_lut fis_lut_quality = { quality_axis, quality_table, 2 };
+
+/*---------------------------------------------------------------------------*/
+static void
+set_axis(struct fis_lut_axis *axis, unsigned shift, unsigned max)
+{
+  unsigned points;
+
+  /* Sample up to the first grid point at or beyond the last breakpoint. */
+  points = ((max + (1 << shift) - 1) >> shift) + 1;
+  if(shift > 15 || points > 255 || ((points - 1) << shift) > 0xffff) {
+    fprintf(stderr, "fis-lut-gen: step 2^%u does not fit the LUT axis\n",
+            shift);
+    exit(2);
+  }
+  axis->shift = shift;
+  axis->points = points;
+}
+/*---------------------------------------------------------------------------*/
+static unsigned
+fill(const struct fis_lut_axis *axis, int inputs, uint8_t *table)
+{
+  uint16_t x[FIS_MAX_INPUTS];
+  unsigned size, n, rest;
+  int i, shift;
+
+  size = 1;
+  shift = 0;
+  for(i = 0; i < inputs; i++) {
+    size *= axis[i].points;
+    shift += axis[i].shift;
+  }
+  if(size > TABLE_MAX || shift > 23) {
+    fprintf(stderr, "fis-lut-gen: LUT too large (%u entries)\n", size);
+    exit(2);
+  }
+
+  for(n = 0; n < size; n++) {
+    rest = n;
+    for(i = inputs - 1; i >= 0; i--) {
+      x[i] = (rest % axis[i].points) << axis[i].shift;
+      rest /= axis[i].points;
+    }
+    table[n] = inputs == 3 ? qos(x[0], x[1], x[2]) : quality(x[0], x[1]);
+  }
+  return size;
+}
+/*---------------------------------------------------------------------------*/
+static void
+print_lut(const char *name, const struct fis_lut_axis *axis, int inputs,
+          const uint8_t *table, unsigned size)
+{
+  unsigned n;
+  int i;
+
+  printf("static const struct fis_lut_axis %s_axis[] = {\n", name);
+  for(i = 0; i < inputs; i++) {
+    printf("  { %u, %u }%s\n", axis[i].shift, axis[i].points,
+           i < inputs - 1 ? "," : "");
+  }
+  printf("};\n\n");
+
+  printf("static const uint8_t %s_table[%u] = {", name, size);
+  for(n = 0; n < size; n++) {
+    printf("%s%3u", n == 0 ? "\n  " : (n % 12 == 0 ? ",\n  " : ", "),
+           table[n]);
+  }
+  printf("\n};\n\n");
+
+  printf("const struct fis_lut fis_lut_%s = { %s_axis, %s_table, %d };\n",
+         name, name, name, inputs);
+}
+/*---------------------------------------------------------------------------*/
+static int
+diff(int a, int b)
+{
+  return a > b ? a - b : b - a;
+}
+/*---------------------------------------------------------------------------*/
+int
+main(int argc, char *argv[])
+{
+  unsigned etx_shift = 0, delay_shift = 7, hc_shift = 0;
+  unsigned qos_shift = 2, energy_shift = 3;
+  unsigned bound = 4;
+  unsigned etx, delay, hc, q, e, qos_size, quality_size;
+  int err, err_qos, err_quality, err_total;
+  int c;
+
+  while((c = getopt(argc, argv, "t:d:n:q:e:b:")) != -1) {
+    switch(c) {
+    case 't': etx_shift = atoi(optarg); break;
+    case 'd': delay_shift = atoi(optarg); break;
+    case 'n': hc_shift = atoi(optarg); break;
+    case 'q': qos_shift = atoi(optarg); break;
+    case 'e': energy_shift = atoi(optarg); break;
+    case 'b': bound = atoi(optarg); break;
+    default:
+      fprintf(stderr, "usage: %s [-t etx] [-d delay] [-n hc] [-q qos] "
+              "[-e energy] [-b bound]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  set_axis(&qos_axis[0], etx_shift, FIS_ETX_B4);
+  set_axis(&qos_axis[1], delay_shift, FIS_DLY_B4);
+  set_axis(&qos_axis[2], hc_shift, FIS_HC_B4);
+  set_axis(&quality_axis[0], qos_shift, QoS_B8);
+  set_axis(&quality_axis[1], energy_shift, FIS_ENERGY_B4);
+
+  qos_size = fill(qos_axis, 3, qos_table);
+  quality_size = fill(quality_axis, 2, quality_table);
+
+  printf("/*\n * Fuzzy QoS and Quality lookup tables.\n *\n");
+  printf(" * Generated by tools/fis-lut/fis-lut-gen -t %u -d %u -n %u "
+         "-q %u -e %u\n", etx_shift, delay_shift, hc_shift, qos_shift,
+         energy_shift);
+  printf(" * from the breakpoints in core/net/rpl/FIS.h. Do not edit.\n */\n\n");
+  printf("#include \"fis-lut.h\"\n\n");
+  print_lut("qos", qos_axis, 3, qos_table, qos_size);
+  printf("\n");
+  print_lut("quality", quality_axis, 2, quality_table, quality_size);
+
+  /* Bounded-error check against the reference fuzzy system. */
+  err_qos = 0;
+  for(etx = 0; etx <= CHECK_ETX_MAX; etx++) {
+    for(delay = 0; delay <= CHECK_DELAY_MAX; delay++) {
+      for(hc = 0; hc <= CHECK_HC_MAX; hc++) {
+        err = diff(qos_lut(etx, delay, hc), qos(etx, delay, hc));
+        if(err > err_qos) {
+          err_qos = err;
+        }
+      }
+    }
+  }
+
+  err_quality = 0;
+  for(q = 0; q <= CHECK_QOS_MAX; q++) {
+    for(e = 0; e <= CHECK_ENERGY_MAX; e++) {
+      err = diff(quality_lut(q, e), quality(q, e));
+      if(err > err_quality) {
+        err_quality = err;
+      }
+    }
+  }
+
+  err_total = 0;
+  for(etx = 0; etx <= CHECK_ETX_MAX; etx++) {
+    for(delay = 0; delay <= CHECK_DELAY_MAX; delay += 5) {
+      for(hc = 0; hc <= CHECK_HC_MAX; hc++) {
+        for(e = 0; e <= CHECK_ENERGY_MAX; e += 3) {
+          err = diff(quality_lut(qos_lut(etx, delay, hc), e),
+                     quality(qos(etx, delay, hc), e));
+          if(err > err_total) {
+            err_total = err;
+          }
+        }
+      }
+    }
+  }
+
+  fprintf(stderr, "fis-lut-gen: %u + %u bytes, max error qos %d, "
+          "quality %d, quality(qos) %d (bound %u)\n",
+          qos_size, quality_size, err_qos, err_quality, err_total, bound);
+
+  return err_total > (int)bound ? 1 : 0;
+}
+/*---------------------------------------------------------------------------*/